@@ -8,7 +8,13 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <type_traits>
 
 // Others from Include - folder
 #include <glew.h>
@@ -22,12 +28,40 @@
 #include "shader.h"
 #include "skeleton.h"
 #include "phyicsBone.h"
+#include "vertex.h"
+#include "model_cache.h"
+#include "thread_pool.h"
+#include "skeleton_pose.h"
+#include "bone_palette_buffer.h"
+#include "animation.h"
+#include "animation_compression.h"
+#include "pose_blend.h"
+#include "cpu_skinning.h"
+#include "streaming_vertex_buffer.h"
+#include "skinning_feedback.h"
+#include "gpu_timers.h"
+#include "palette_partition.h"
+#include "crowd.h"
+#include "influence_buckets.h"
+#include "vertex_packing.h"
+#include "mesh_optimizer.h"
+#include "dual_quat.h"
+#include "gl_state.h"
+#include "frame_constants.h"
+#include "shader_library.h"
+#include "render_queue.h"
 
 
 // Global variables & MACROS
 float gLastTime = 0.0f;
 
-#define MAX_NUM_BONES_PER_VERTEX 4  // ADJUSTABLE - Maximum nr of bones a single vertex can be affected by
+#define MAX_NUM_BONES_PER_VERTEX 4  // Default nr of bones a single vertex can be affected by (4 or 8), per model through gBonesPerVertex
+#define PARSE_CHUNK_SIZE 16384      // Nr of vertices/faces per work-item when parsing a model in parallel
+#define PARALLEL_LEVEL_MIN_BONES 512 // Skeleton-levels with at least this many bones are evaluated on all worker-threads
+#define MAX_BLEND_LAYERS 8          // Nr of clips that can be blended at the same time
+#define HEADLESS_FRAMES 600         // Nr of frames (at 60 Hz) simulated in headless mode
+#define CROWD_SIZE 100              // Nr of instances drawn when gDrawCrowd is on
+#define CROWD_SPACING 80.0f         // Distance between crowd-instances (boblamp is ~60 units tall)
 
 static int space_count = 0; // Counter for printig matrices
 
@@ -36,7 +70,11 @@ InputController input;
 Shader* weightShader = nullptr;
 Shader* debugLineShader = nullptr;
 Shader* skinningShader = nullptr;
+Shader* passthroughShader = nullptr;   // Draws pre-skinned vertices (skinning pre-pass or CPU skinning)
+Shader* bucketShaders[NUM_INFLUENCE_BUCKETS] = {};  // skinning.vs with NUM_INFLUENCES = 1..4 (gInfluenceBuckets)
+ShaderLibrary gShaderLibrary;   // Owns the shaders above, builds them together and caches the programs in SHADER_CACHE_DIR
 Skeleton gSkeleton;
+ThreadPool gWorkers;    // Worker-threads used for loading (one per core)
 
 
 // INSTANCES of other classes
@@ -44,11 +82,38 @@ GLFWwindow* gWindow = nullptr;  // Globally accesssable window - used in input-c
 const aiScene* gScene = nullptr;    // Globally accessable refrence to aiScene, used for retriving model-data via assimp
 GLuint gBoneVAO = 0;    // Bone-buffer input VAO
 GLuint gBoneVBO = 0;    // Bone-buffer input VBO
+size_t gBoneVBOCapacity = 0;    // DebugVertices gBoneVBO has room for
 
 // FLAGS
 bool gUseRagdoll = false; // Must also have bonelines or normalkinning true or both
-
-// The diffrent "modes" of the program
+bool gUseModelCache = true; // Load models from their baked .skcache when it is up to date (bypasses Assimp)
+bool gReportModelCache = false; // Prints load-time of Assimp vs the model-cache for every file in Models before starting
+bool gRunPoseBenchmark = false; // Prints timings of the SoA/SIMD pose-kernels vs the old per-Bone loops before starting
+bool gReportBoneUpdates = false; // Prints how many bones are evaluated and uploaded per frame (averaged every second)
+bool gPlayAnimation = true; // Plays the first animation-clip of the model if it has one (instead of the test-wobble on bone 1)
+bool gReportAnimationCompression = false; // Prints size and error of every clip before/after compression when a model is imported
+bool gCrossfadeClips = false; // Fades back and forth between the first two clips of the model through the blender (needs 2 clips)
+bool gRunBlendBenchmark = false; // Prints timings of the pose-blender with 2/4/8 layers before starting
+bool gCpuSkinning = false; // Skins the model on the worker-threads and draws it through passthrough.vs (normalSkinning) instead of skinning in skinning.vs
+bool gHeadless = false; // No window or GL-context: loads the model, runs HEADLESS_FRAMES frames of animation + CPU skinning and exits
+bool gRunSkinningBenchmark = false; // Prints vertices/second of the CPU skinning on the model and a synthetic 1M-vertex mesh after loading
+bool gSkinningPrepass = true; // Skins every vertex once per frame with transform feedback, all passes then draw the pre-skinned vertices
+bool gReportGpuTimes = false; // Prints the GPU time of every render-pass (timer queries), averaged every second
+bool gReportGLCalls = false; // Prints program-/vertex-array-binds and uniform-uploads per frame, issued and skipped as redundant, averaged every second
+bool gRunRenderQueueBenchmark = false; // Prints submit- and sort-time per draw of the render-queue with 1k/10k/100k draws before starting
+bool gReportShaderCache = false; // Builds the shaders twice at startup, without (cold) and with (warm) the program-binary cache, and prints both times
+bool gPartitionPalette = false; // Splits the mesh into draw-batches that fit a uniform-array palette (GL_MAX_VERTEX_UNIFORM_COMPONENTS), any skeleton-size without buffer-palettes
+bool gDrawCrowd = false; // Draws CROWD_SIZE animated copies of the model with one instanced draw (palettes in one shared texture-buffer)
+bool gRunCrowdBenchmark = false; // Prints frame-times of 100/1000/5000 crowd-instances after loading
+bool gInfluenceBuckets = false; // Draws the model in 4 parts by bones per triangle (1-4), each with a skinning.vs variant that only blends that many
+bool gPackVertices = false; // Uploads gVBO in the packed layout of vertex_packing.h (~20 instead of 56 bytes per vertex, 4-influence models only)
+bool gOptimizeMeshes = true; // Reorders indices/vertices of every mesh at import for the post-transform cache, overdraw and vertex-fetch (baked into the model-cache)
+bool gReportVertexPacking = false; // Prints memory, fetch-bandwidth and skinning-error of the packed layouts for every file in Models before starting
+bool gDualQuatSkinning = false; // Skins with dual quaternions (DUAL_QUAT_SKINNING-variant of skinning.vs, 32 bytes per bone, no volume-loss at twists) instead of matrices, set per model in main(). Not with the pre-pass, buckets or partitions
+bool gRunDualQuatBenchmark = false; // Prints palette-size, upload, vertex-shader time and max rig-size of matrix vs dual-quaternion skinning after loading
+int gBonesPerVertex = MAX_NUM_BONES_PER_VERTEX; // Influences per vertex of the next model: 4 (throughput) or 8 (quality, the strongest are kept and renormalized), set per model in main()
+
+// The diffrent "modes" of the program, the values at start (toggled at runtime with keys 1/2/3, see setup_pipelines)
 bool weightVisMode = true;     // Activates the weight-viz mode (need to drag model)
 bool boneLinesMode = false;     // Draws the skeleton as yellow lines (can be combine w.normalSkinning)
 bool normalSkinning = false;    // Normal shader for skinning
@@ -65,6 +130,14 @@ struct PhysicsSkeleton
 };
 PhysicsSkeleton gPhysicsSkeleton;   // Global variable
 
+// Animation-clips of the loaded model (compressed) and the player driving gSkeleton
+std::vector<CompressedClip> gAnimations;
+AnimationPlayer gAnimationPlayer;
+AnimationPlayer gCrossfadePlayer;   // Second clip when gCrossfadeClips is on
+PoseBlender gPoseBlender;           // Blends the players above into gSkeleton
+AnimationCompressionSettings gAnimationCompression;    // Allowed error when dropping keys, same for every bone by default
+PackedVertexFormat gPackedFormat;   // Layout used by gPackVertices (16-bit positions, 8-bit ids/weights by default)
+
 
 // For line-rendering - for debugging bone-viz (not really necessary, but I'm to lazy to remove)
 struct DebugVertex
@@ -73,82 +146,138 @@ struct DebugVertex
 };
 
 
-// Stores vertex-bone data, unique per vertex (boneId, weighs affecting the bone)
+// Stores vertex-bone data, unique per vertex (boneId, weighs affecting the bone), at most N (4 or 8) bones
+template<int N>
 struct VertexBoneData
 {
-    // Bone-data arrays: (bone-id;s, weights for each bone)
-    unsigned int BoneIDs[MAX_NUM_BONES_PER_VERTEX] = { 0 }; // Can only store 0 and positive nr;s
-    float Weights[MAX_NUM_BONES_PER_VERTEX] = { 0.0f };
+    // Bone-data arrays: (bone-id;s, weights for each bone), sorted by weight (strongest first)
+    unsigned int BoneIDs[N] = { 0 }; // Can only store 0 and positive nr;s
+    float Weights[N] = { 0.0f };
 
     // Constructor
     VertexBoneData()
     {
     }
 
-    // Fills upp bone-data arrays for this bone
-    void AddBoneData(unsigned int BoneID, float Weight)
+    // Fills upp bone-data arrays for this bone, keeps the N strongest when the vertex has more (top-K).
+    // Returns false if an influence was dropped, the weights are renormalized afterwards
+    bool AddBoneData(unsigned int BoneID, float Weight)
     {
-        // Go through all of BoneIds
-        for (unsigned int i = 0; i < MAX_NUM_BONES_PER_VERTEX; i++) {
-            
-            // Add data if there is none
-            if (Weights[i] == 0.0) {
-                BoneIDs[i] = BoneID;
-                Weights[i] = Weight;
-                //printf("Adding bone %d weight %f at index %i\n", BoneID, Weight, i);
-                return;
-            }
+        if (Weight <= 0.0f)
+            return true;
+
+        bool full = Weights[N - 1] != 0.0f;
+
+        // Slot after all stronger bones (empty slots have weight 0)
+        int slot = 0;
+        while (slot < N && Weights[slot] >= Weight)
+            slot++;
+
+        // Weaker than all N
+        if (slot == N)
+            return false;
+
+        // Move the weaker ones down, the weakest falls off when full
+        for (int i = N - 1; i > slot; i--) {
+            BoneIDs[i] = BoneIDs[i - 1];
+            Weights[i] = Weights[i - 1];
         }
+        BoneIDs[slot] = BoneID;
+        Weights[slot] = Weight;
+        //printf("Adding bone %d weight %f at index %i\n", BoneID, Weight, slot);
 
-        // should never get here - more bones than we have space for
-        assert(0);
+        return !full;
     }
 };
 
-// GPU-side vertex structure, needed to "render"
-struct VertexGPU
+// Rounds gBonesPerVertex to a vertex-layout that exists (4 or 8), the loader and the shader-defines both use the result.
+// Call once after setting it, before the model is loaded
+void round_bones_per_vertex()
 {
-    glm::vec3 Position;     // Vertex position
-    glm::vec3 Normal;       // Vertex normal
-    glm::ivec4 BoneIDs;     // Indices of bones affecting this vertex
-    glm::vec4 Weights;      // Corresponding weights
-};
+    int layout = gBonesPerVertex > 4 ? 8 : 4;
+    if (layout != gBonesPerVertex)
+        printf("%d bones per vertex rounded to %d (vertex-layouts hold 4 or 8)\n", gBonesPerVertex, layout);
+    gBonesPerVertex = layout;
+}
 
+// Calls fn with std::integral_constant<int, gBonesPerVertex>, for the loader-functions templated on the nr of influences
+template<class Fn>
+void with_bones_per_vertex(Fn&& fn)
+{
+    if (gBonesPerVertex == 8)
+        fn(std::integral_constant<int, 8>());
+    else
+        fn(std::integral_constant<int, 4>());
+}
 
 // Other structures: Mapping from vertices to the bones that influece them
-std::vector<VertexBoneData> vertex_to_bones;                    // Mapping from vertices to the bones that influece them
+template<int N>
+std::vector<VertexBoneData<N>> vertex_to_bones;                 // Mapping from vertices to the bones that influece them, N = gBonesPerVertex
 std::vector<int> mesh_base_vertex;                              // Stores all start-vertices of all meshes: Mesh 1 starts at index 0, Mesh 2 starts at index N (N = sizeof(Mesh 1))...
-std::vector<glm::mat4> gFinalBoneMatrices;                      // Stores transformations for final-bones used to render in vertex-shader
+std::vector<int> mesh_base_index;                               // Same as mesh_base_vertex but for gpuIndices
+std::vector<std::vector<int>> mesh_bone_ids;                    // Bone-id of every aiMesh::mBones entry, per mesh
+BonePaletteBuffer gBonePalette;                                 // Final-bones used to render in vertex-shader (3x4, last row is implicit), written straight into GPU-memory
+AlignedVector<Affine3x4> gDualQuatSource;                       // Matrix-palette gBonePalette's dual quaternions are converted from (gDualQuatSkinning)
+
+// CPU skinning (gCpuSkinning/gHeadless) -----------------
+SkinningStreams gSkinningStreams;                               // Bind-pose vertices as one stream per attribute
+AlignedVector<Affine3x4> gCpuPalette;                           // Final-bones in plain memory, replaces gBonePalette when skinning on the CPU
+std::vector<SkinnedVertex> gCpuSkinnedVertices;                 // Skinned output when headless
+StreamingVertexBuffer gSkinnedStream;                           // Skinned output otherwise, drawn through gSkinnedVAO
+
+// Skinning pre-pass (gSkinningPrepass) -----------------
+SkinningFeedback gSkinningFeedback;                             // Vertices skinned once per frame on the GPU, drawn through gSkinnedVAO
+GpuPassTimers gGpuTimers;                                       // GPU time per pass (gReportGpuTimes)
+FrameConstantBuffer gFrameConstants;                            // Camera/light once per frame + model-matrix per draw, read by every drawing shader
+RenderQueue gRenderQueue;                                       // Draws of all passes this frame, sorted by pass/program/VAO before they are issued
+
+// Palette-partitioning (gPartitionPalette) -----------------
+PartitionedMesh gPartitionedMesh;                               // Bone-limited draw-batches, vertices duplicated per batch with local bone-ids
+std::vector<Affine3x4> gBatchPalette;                           // Palette-slice of the batch being drawn, gathered from gCpuPalette
+int gBatchBonesLocation = -1;                                   // Location of uBones[] in skinningShader
+
+// Influence-buckets (gInfluenceBuckets) -----------------
+InfluenceBucketedMesh gInfluenceMesh;                           // Triangles sorted by bones per vertex, packed vertices per bucket
+
+// Crowd (gDrawCrowd) -----------------
+Crowd gCrowd;                                                   // Instanced copies of the model, own poses and players
 
 // Global GPU buffers and containers -----------------
 
 // GPU data containers, needed to "render"
 std::vector<VertexGPU> gpuVertices;
+std::vector<VertexGPUT<8>> gpuVerticesWide;    // Only for 8-influence models (gBonesPerVertex), uploaded instead of gpuVertices
+PackedVertices gPackedVertices;                 // Layout of gVBO when it is packed (gPackVertices), the data is dropped after the upload
 std::vector<unsigned int> gpuIndices;
 
 // OpenGL object handles, needed to "render"
 GLuint gVAO = 0;
 GLuint gVBO = 0;
 GLuint gEBO = 0;
+GLsizei gIndexCount = 0;    // Nr of indices in gEBO, gpuIndices is empty when the model came from the cache
+GLsizei gVertexCount = 0;   // Nr of vertices in gVBO
+GLuint gSkinnedVAO = 0;     // Pre-skinned position + normal (pre-pass or CPU skinning), bone-ids + weights from gVBO, indices from gEBO
+GLuint gBatchVAO = 0;       // gPartitionedMesh, drawn batch by batch
+GLuint gBatchVBO = 0;
+GLuint gBatchEBO = 0;
+GLuint gBucketVAO[NUM_INFLUENCE_BUCKETS] = {};  // gInfluenceMesh, one VAO/VBO/EBO per bucket (0 = empty bucket)
+GLuint gBucketVBO[NUM_INFLUENCE_BUCKETS] = {};
+GLuint gBucketEBO[NUM_INFLUENCE_BUCKETS] = {};
+
+// Mapping of the baked model, kept open while its model is loaded
+ModelCache gModelCache;
 
 
 // ------------------------- UTIL -------------------------
 
-// Apply physics, copies results of physics to localPose in Skeleton::Bone - will be rendered
+// Apply physics, copies results of physics to the local pose in Skeleton::pose - will be rendered
 void applyPhysicsToSkeleton(const PhysicsSkeleton& physics, Skeleton& skeleton)
 {
     // Go through all physics-bones
     for (const PhysicsBone& pb : physics.bones)
     {
-        // Get corresponding bone from "normal" skeleton
-        Bone& bone = skeleton.bones[pb.boneIndex];
-
-        // Get translation- and rotation-matrices from physics-bone
-        glm::mat4 T = glm::translate(glm::mat4(1.0f), pb.position);
-        glm::mat4 R = glm::mat4_cast(pb.rotation);
-
-        // Set local pose using translation and rotation instead of pose
-        bone.localPose = T * R;
+        // Set local pose of corresponding bone in "normal" skeleton using translation and rotation from physics-bone (no scale)
+        skeleton.pose.SetLocalPose(pb.boneIndex, pb.position, pb.rotation);
     }
 }
 
@@ -157,17 +286,17 @@ void applyPhysicsToSkeleton(const PhysicsSkeleton& physics, Skeleton& skeleton)
 void buildPhysicsSkeleton(const Skeleton& skeleton, PhysicsSkeleton& physics)
 {
     physics.bones.clear();
-    physics.bones.reserve(skeleton.bones.size());
+    physics.bones.reserve(skeleton.pose.Size());
 
     // Go through all bones i skeleton and copy everthing 1 to 1, initialize the rest
-    for (size_t i = 0; i < skeleton.bones.size(); i++)
+    for (size_t i = 0; i < skeleton.pose.Size(); i++)
     {
         PhysicsBone pb;
         pb.boneIndex = (int)i;  // Index should always be int
-        pb.parentIndex = skeleton.bones[i].parentIndex;
+        pb.parentIndex = skeleton.pose.parentIndices[i];
 
         // Initialize physics pose from bind pose
-        const glm::mat4& m = skeleton.bones[i].globalPose;
+        glm::mat4 m = AffineToMat4(skeleton.pose.globalPoses[i]);
         pb.position = glm::vec3(m[3]);
         pb.rotation = glm::quat_cast(m);
 
@@ -181,19 +310,17 @@ void buildBoneDebugLines(const Skeleton& skeleton, std::vector<DebugVertex>& out
     outVertices.clear();
 
     // Go through all bones
-    for (size_t i = 0; i < skeleton.bones.size(); i++)
+    for (size_t i = 0; i < skeleton.pose.Size(); i++)
     {
-        const Bone& bone = skeleton.bones[i];
+        int parentIndex = skeleton.pose.parentIndices[i];
 
         // Skipp children of root
-        if (bone.parentIndex == -1)
+        if (parentIndex == -1)
             continue;
 
-        const Bone& parent = skeleton.bones[bone.parentIndex];
-
         // Take pos from parent and child
-        glm::vec3 p0 = glm::vec3(parent.globalPose[3]);
-        glm::vec3 p1 = glm::vec3(bone.globalPose[3]);
+        glm::vec3 p0 = skeleton.pose.globalPoses[parentIndex].GetTranslation();
+        glm::vec3 p1 = skeleton.pose.globalPoses[i].GetTranslation();
 
         // Add to outVertices, removes all faces, keeps only relation
         outVertices.push_back({ p0 });
@@ -201,50 +328,311 @@ void buildBoneDebugLines(const Skeleton& skeleton, std::vector<DebugVertex>& out
     }
 }
 
-// Calculate FinalBoneMatrices - important for vertex-shader
-void buildFinalBoneMatrices(const Skeleton& skeleton, std::vector<glm::mat4>& outMatrices)
+// Calculate global-bone-transforms and FinalBoneMatrices in one pass - important for vertex-shader
+// FinalBoneMatrices (= global-pose * offset-matrix) are written straight into this frame's copy of gBonePalette,
+// only bones that changed (and their children) are evaluated
+PoseUpdateStats updateBonePalette(Skeleton& skeleton)
 {
-    outMatrices.resize(skeleton.bones.size());
-
-    // Go through all bones in skeleton
-    for (size_t i = 0; i < skeleton.bones.size(); i++)
+    // Skinning on the CPU reads the palette back, so it goes to plain memory instead of the (write-only) GPU-buffer.
+    // Dual quaternions are converted from matrices, those stay in plain memory as well
+    bool cpuPalette = !gCpuPalette.empty();
+    bool dualQuats = gBonePalette.UsesDualQuats();
+    Affine3x4* palette = cpuPalette ? gCpuPalette.data() : dualQuats ? gDualQuatSource.data() : gBonePalette.BeginFrame();
+    unsigned int copies = cpuPalette || dualQuats ? 1 : gBonePalette.GetCopyCount();
+
+    PoseUpdateStats stats;
+    if (palette)
+        stats = ComputePosePalette(skeleton.pose, palette, copies, &gWorkers, PARALLEL_LEVEL_MIN_BONES);
+    else
+        stats.bonesEvaluated = ComputeGlobalPoses(skeleton.pose, &gWorkers, PARALLEL_LEVEL_MIN_BONES);  // No buffer (no bones), lines still need the poses
+
+    // Every bone is converted, each buffer-copy needs the whole palette
+    if (dualQuats)
     {
-        outMatrices[i] = skeleton.bones[i].globalPose * skeleton.bones[i].offsetMatrix; // final-bone-matrices = global-pose * offset-matrix
+        DualQuat* out = gBonePalette.BeginFrameDualQuat();
+        if (out)
+            ConvertPaletteToDualQuat(gDualQuatSource.data(), out, gDualQuatSource.size(), &gWorkers);
+        stats.paletteWritten = out ? gDualQuatSource.size() : 0;
     }
+
+    if (!cpuPalette)
+        gBonePalette.EndWrite();
+    return stats;
 }
 
-// Computes the global-bone-transforms, needed for bone-world-transforms, parent-child-relationships and calculate final-bone-matrices (= global-pose * offset-matrix)
-void computeGlobalBoneTransforms(Skeleton& skeleton)
+// Points position + normal of gSkinnedVAO at the skinned vertices starting at offset (bytes) in buffer
+void set_skinned_vertex_source(GLuint buffer, size_t offset)
 {
-    // Go through all bones in skeleton
-    for (size_t i = 0; i < skeleton.bones.size(); i++)
-    {
-        Bone& bone = skeleton.bones[i];
+    BindVertexArray(gSkinnedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    // Skinned position
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offset);
+    glEnableVertexAttribArray(0);
+
+    // Skinned normal
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)(offset + offsetof(SkinnedVertex, Normal)));
+    glEnableVertexAttribArray(1);
+
+    BindVertexArray(0);
+}
+
+// Skins the model on the worker-threads with this frame's gCpuPalette, into the streaming VBO (gCpuSkinnedVertices when headless)
+void skinModelOnCpu()
+{
+    if (gCpuPalette.empty() || gSkinningStreams.Size() == 0)
+        return;
+
+    if (gHeadless) {
+        SkinVertices(gSkinningStreams, gCpuPalette.data(), gCpuSkinnedVertices.data(), &gWorkers);
+        return;
+    }
+
+    SkinnedVertex* out = (SkinnedVertex*)gSkinnedStream.BeginWrite();
+    SkinVertices(gSkinningStreams, gCpuPalette.data(), out, &gWorkers);
+    gSkinnedStream.EndWrite();
+
+    // Draws read the region written this frame
+    set_skinned_vertex_source(gSkinnedStream.GetBuffer(), gSkinnedStream.GetRegionOffset());
+}
 
-        if (bone.parentIndex == -1)
+// Palette-slice of batch into uBones[], right before the batch is drawn (skinningShader is in use then)
+void set_batch_palette(size_t batchIndex)
+{
+    const PaletteBatch& batch = gPartitionedMesh.batches[batchIndex];
+    for (size_t b = 0; b < batch.bones.size(); b++)
+        gBatchPalette[b] = gCpuPalette[batch.bones[b]];
+    skinningShader->SetMat3x4Array(gBatchBonesLocation, gBatchPalette.data(), (int)batch.bones.size());
+}
+
+// Submits the model with the normal shader, from the pre-skinned vertices when there are any
+void submitSkinnedModel(const glm::mat4& model, float depth)
+{
+    DrawCommand command;
+    command.model = model;
+
+    if (gSkinnedVAO && passthroughShader)
+    {
+        command.shader = passthroughShader;
+        command.vao = gSkinnedVAO;
+        command.count = gIndexCount;
+        gRenderQueue.Submit(RENDER_PASS_SHADED, command, depth);
+    }
+    else if (bucketShaders[0])
+    {
+        // One draw per bucket, each blending only the bones its vertices have
+        for (int b = 0; b < NUM_INFLUENCE_BUCKETS; b++)
         {
-            // Root bone: local = global (doesnt have parent)
-            bone.globalPose = bone.localPose;
+            if (!gBucketVAO[b])
+                continue;
+
+            command.shader = bucketShaders[b];
+            command.vao = gBucketVAO[b];
+            command.count = (int)gInfluenceMesh.buckets[b].indices.size();
+            gRenderQueue.Submit(RENDER_PASS_SHADED, command, depth);
         }
-        else
+    }
+    else if (!gPartitionedMesh.batches.empty())
+    {
+        // One draw per batch, each with its own slice of the palette in uBones[]
+        for (size_t i = 0; i < gPartitionedMesh.batches.size(); i++)
         {
-            // All bones that is not child of root
-            const Bone& parent = skeleton.bones[bone.parentIndex];  // Set parent
-            bone.globalPose = parent.globalPose * bone.localPose;   // Calculate global pose, follow chain-logic
+            const PaletteBatch& batch = gPartitionedMesh.batches[i];
+
+            command.shader = skinningShader;
+            command.vao = gBatchVAO;
+            command.count = batch.indexCount;
+            command.firstIndex = batch.firstIndex;
+            command.baseVertex = batch.baseVertex;
+            command.setup = set_batch_palette;
+            command.setupArg = i;
+            gRenderQueue.Submit(RENDER_PASS_SHADED, command, depth);
         }
     }
+    else
+    {
+        command.shader = skinningShader;
+        command.vao = gVAO;
+        command.count = gIndexCount;
+        gRenderQueue.Submit(RENDER_PASS_SHADED, command, depth);
+    }
 }
 
-// Initializes runtime-pose based on bind-pose
-void initializeSkeletonPose(Skeleton& skeleton)
+// Submits the weight-visualization, from the pre-skinned vertices when there are any
+void submitWeights(const glm::mat4& model, float depth)
+{
+    DrawCommand command;
+    command.model = model;
+    command.shader = weightShader;
+    command.vao = gSkinnedVAO ? gSkinnedVAO : gVAO;
+    command.count = gIndexCount;
+    gRenderQueue.Submit(RENDER_PASS_WEIGHTS, command, depth);
+}
+
+// Writes this frame's bone-lines into gBoneVBO and submits them (no depth-test)
+void submitBoneLines(const glm::mat4& model)
+{
+    if (!gBoneVAO)
+        return;
+
+    std::vector<DebugVertex> boneDebugVerts;
+    buildBoneDebugLines(gSkeleton, boneDebugVerts);
+
+    // Large rigs outgrow the first allocation
+    if (boneDebugVerts.size() > gBoneVBOCapacity) {
+        gBoneVBOCapacity = boneDebugVerts.size();
+        glBindBuffer(GL_ARRAY_BUFFER, gBoneVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(DebugVertex) * gBoneVBOCapacity, nullptr, GL_DYNAMIC_DRAW);
+    }
+    UpdateBuffer(gBoneVBO, 0, boneDebugVerts.size() * sizeof(DebugVertex), boneDebugVerts.data());
+
+    DrawCommand command;
+    command.model = model;
+    command.shader = debugLineShader;
+    command.vao = gBoneVAO;
+    command.primitive = GL_LINES;
+    command.indexed = false;
+    command.count = (int)boneDebugVerts.size();
+    gRenderQueue.Submit(RENDER_PASS_SKELETON, command);
+}
+
+// Steps the animation-clip(s) into the local pose, physics and test-wobble may override it afterwards
+void updateSkeletonAnimation(float deltaTime, float currentTime)
+{
+    if (gCrossfadePlayer.IsPlaying())
+    {
+        // Two clips through the blender, weight of the second goes 0 -> 1 -> 0 every ~6 seconds
+        gAnimationPlayer.Advance(deltaTime);
+        gCrossfadePlayer.Advance(deltaTime);
+
+        BlendLayer layers[2];
+        layers[0].player = &gAnimationPlayer;
+        layers[1].player = &gCrossfadePlayer;
+        layers[1].weight = 0.5f - 0.5f * cosf(currentTime);
+        gPoseBlender.Evaluate(layers, 2, gSkeleton.pose);
+    }
+    else if (gAnimationPlayer.IsPlaying())
+        gAnimationPlayer.Update(deltaTime, gSkeleton.pose);    // Single clip, straight into the pose
+}
+
+// Computes the global-bone-transforms, needed for bone-world-transforms, parent-child-relationships and calculate final-bone-matrices (= global-pose * offset-matrix)
+// Bones are sorted by depth (see sort_skeleton_by_depth) so parents are always done before their children.
+// Only changed bones and their subtrees are evaluated, returns how many
+size_t computeGlobalBoneTransforms(Skeleton& skeleton)
+{
+    return ComputeGlobalPoses(skeleton.pose, &gWorkers, PARALLEL_LEVEL_MIN_BONES);
+}
+
+// Prints the average nr of bones evaluated/written to the palette per frame, once per second
+void report_bone_updates(size_t evaluated, size_t written, float currentTime)
+{
+    static float windowStart = 0.0f;
+    static size_t frames = 0, sumEvaluated = 0, sumWritten = 0;
+
+    frames++;
+    sumEvaluated += evaluated;
+    sumWritten += written;
+
+    if (currentTime - windowStart < 1.0f)
+        return;
+
+    printf("Bones per frame: %.1f evaluated, %.1f palette-entries written (of %zu)\n",
+        (double)sumEvaluated / frames, (double)sumWritten / frames, gSkeleton.pose.Size());
+
+    windowStart = currentTime;
+    frames = sumEvaluated = sumWritten = 0;
+}
+
+// Fills desc.levelOffsets, bones must already be sorted by depth
+void compute_skeleton_levels(SkeletonDesc& desc)
+{
+    desc.levelOffsets.clear();
+    desc.levelOffsets.push_back(0);
+
+    std::vector<int> depth(desc.bones.size(), 0);
+    for (size_t i = 0; i < desc.bones.size(); i++)
+    {
+        int parent = desc.bones[i].parentIndex;
+        depth[i] = (parent == -1) ? 0 : depth[parent] + 1;
+
+        // New level starts
+        if (i > 0 && depth[i] != depth[i - 1])
+            desc.levelOffsets.push_back((int)i);
+    }
+
+    if (!desc.bones.empty())
+        desc.levelOffsets.push_back((int)desc.bones.size());
+}
+
+// Rewrites the bone-id of every influence in vertex_to_bones through remap (old id -> new id)
+template<int N>
+void remap_vertex_bone_ids(const std::vector<int>& remap)
+{
+    gWorkers.ParallelFor(vertex_to_bones<N>.size(), PARSE_CHUNK_SIZE, [&](size_t first, size_t last) {
+        for (size_t v = first; v < last; v++)
+            for (int i = 0; i < N; i++)
+                if (vertex_to_bones<N>[v].Weights[i] != 0.0f)
+                    vertex_to_bones<N>[v].BoneIDs[i] = remap[vertex_to_bones<N>[v].BoneIDs[i]];
+    });
+}
+
+// Reorders gSkeleton bones breadth-first (grouped by depth, parents before children) and remaps all bone-ids
+// get_bone_id() hands out ids in the order bones show up in the meshes, which has nothing to do with the hierarchy
+void sort_skeleton_by_depth()
 {
-    // Go through all bones in skeleton
-    for (Bone& bone : skeleton.bones)
+    SkeletonDesc& desc = gSkeleton.desc;
+    size_t num_bones = desc.bones.size();
+
+    // Depth of every bone, parents may have higher indices than their children here
+    std::vector<int> depth(num_bones, -1);
+    std::function<int(int)> depth_of = [&](int i) -> int {
+        if (depth[i] == -1) {
+            int parent = desc.bones[i].parentIndex;
+            depth[i] = (parent == -1) ? 0 : depth_of(parent) + 1;
+        }
+        return depth[i];
+    };
+    for (size_t i = 0; i < num_bones; i++)
+        depth_of((int)i);
+
+    // New order: by depth, ties keep their old order so it is the same every run
+    std::vector<int> order(num_bones);
+    for (size_t i = 0; i < num_bones; i++)
+        order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return depth[a] < depth[b]; });
+
+    // Remap-table: old bone-id -> new bone-id
+    std::vector<int> remap(num_bones);
+    for (size_t i = 0; i < num_bones; i++)
+        remap[order[i]] = (int)i;
+
+    // Move bones to their new place and rewrite parents and name-lookup
+    std::vector<Bone> sorted(num_bones);
+    for (size_t i = 0; i < num_bones; i++)
     {
-        // Start runtime pose equal to bind pose
-        bone.localPose = bone.localBindPose;
-        bone.globalPose = glm::mat4(1.0f);
+        sorted[i] = std::move(desc.bones[order[i]]);
+        if (sorted[i].parentIndex != -1)
+            sorted[i].parentIndex = remap[sorted[i].parentIndex];
+        desc.boneNameToIndex[sorted[i].name] = (int)i;
     }
+    desc.bones = std::move(sorted);
+
+    // Rewrite bone-ids of every vertex (empty slots keep id 0)
+    with_bones_per_vertex([&](auto n) { remap_vertex_bone_ids<decltype(n)::value>(remap); });
+
+    for (std::vector<int>& ids : mesh_bone_ids)
+        for (int& id : ids)
+            id = remap[id];
+
+    compute_skeleton_levels(desc);
+    printf("\nSorted %zu bones into %zu levels\n", num_bones, desc.levelOffsets.empty() ? 0 : desc.levelOffsets.size() - 1);
+}
+
+// Initializes runtime-pose based on bind-pose
+void initializeSkeletonPose(Skeleton& skeleton)
+{
+    // Start runtime pose equal to bind pose, copies the hot parts of the description
+    InitSkeletonPose(skeleton.pose, skeleton.desc);
 }
 
 // Returns bone-id from skeleton::boneNameToIndex of input-bone or adds bone to it then return, used when parsing nodes
@@ -253,17 +641,17 @@ int get_bone_id(const aiBone* pBone)
     std::string bone_name(pBone->mName.C_Str());
 
     // Check if bone exits in list, if so return id
-    auto it = gSkeleton.boneNameToIndex.find(bone_name);
-    if (it != gSkeleton.boneNameToIndex.end())
+    auto it = gSkeleton.desc.boneNameToIndex.find(bone_name);
+    if (it != gSkeleton.desc.boneNameToIndex.end())
         return it->second;  // Return id
 
     // Create new bone entry
     Bone bone;
     bone.name = bone_name;
     bone.offsetMatrix = glm::transpose(glm::make_mat4(&pBone->mOffsetMatrix.a1));
-    int newIndex = (int)gSkeleton.bones.size();
-    gSkeleton.bones.push_back(bone);
-    gSkeleton.boneNameToIndex[bone_name] = newIndex;
+    int newIndex = (int)gSkeleton.desc.bones.size();
+    gSkeleton.desc.bones.push_back(bone);
+    gSkeleton.desc.boneNameToIndex[bone_name] = newIndex;
 
     // Return index of new bone
     return newIndex;
@@ -287,30 +675,56 @@ void print_assimp_matrix(const aiMatrix4x4& m)
 }
 
 // Normalizes bone weights per vertex so that the sum equals 1.0, prevents "seams" and incorrect heat visualization
+// (also makes up for influences dropped by AddBoneData)
+template<int N>
 void normalize_vertex_bone_weights()
 {
-    for (size_t v = 0; v < vertex_to_bones.size(); v++)
-    {
-        float sum = 0.0f;
+    gWorkers.ParallelFor(vertex_to_bones<N>.size(), PARSE_CHUNK_SIZE, [](size_t first, size_t last) {
+        for (size_t v = first; v < last; v++)
+        {
+            float sum = 0.0f;
 
-        // Sum all weights for this vertex
-        for (int i = 0; i < MAX_NUM_BONES_PER_VERTEX; i++)
-            sum += vertex_to_bones[v].Weights[i];
+            // Sum all weights for this vertex
+            for (int i = 0; i < N; i++)
+                sum += vertex_to_bones<N>[v].Weights[i];
 
-        // If the vertex has any bone influence
-        if (sum > 0.0f)
-        {
-            // Normalize weights
-            for (int i = 0; i < MAX_NUM_BONES_PER_VERTEX; i++)
-                vertex_to_bones[v].Weights[i] /= sum;
+            // If the vertex has any bone influence
+            if (sum > 0.0f)
+            {
+                // Normalize weights
+                for (int i = 0; i < N; i++)
+                    vertex_to_bones<N>[v].Weights[i] /= sum;
+            }
         }
-    }
+    });
 }
 
 // ------------------------- PARSING -------------------------
 
-// Parses a single bone - fills bone_name_to_index_map and vertex_to_bones
-void parse_single_bone(int mesh_index, const aiBone* pBone)
+// A piece of one mesh's vertices (or faces), unit of work when parsing in parallel
+struct MeshRange
+{
+    unsigned int mesh;
+    unsigned int begin;
+    unsigned int end;
+};
+
+// Splits every mesh into ranges of at most chunk_size elements, count_of(mesh) gives nr of elements in a mesh
+template <typename CountFn>
+std::vector<MeshRange> split_mesh_ranges(const aiScene* pScene, unsigned int chunk_size, CountFn count_of)
+{
+    std::vector<MeshRange> ranges;
+    for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+    {
+        unsigned int count = count_of(pScene->mMeshes[i]);
+        for (unsigned int begin = 0; begin < count; begin += chunk_size)
+            ranges.push_back({ i, begin, std::min(count, begin + chunk_size) });
+    }
+    return ranges;
+}
+
+// Parses a single bone - registers it in skeleton::boneNameToIndex and returns its bone-id (weights are scattered later)
+int parse_single_bone(const aiBone* pBone)
 {
     printf("\t\tBone '%s': num vertices affected by this bone: %d\n", pBone->mName.C_Str(), pBone->mNumWeights);
 
@@ -321,36 +735,110 @@ void parse_single_bone(int mesh_index, const aiBone* pBone)
     // Print the offset-matrix of the current bone (vertex- to bone-coordintes or local-to-bone-space)
     printf("\t\tOffset-Matrix:\n");
     print_assimp_matrix(pBone->mOffsetMatrix);
-    
-    //printf("Called! %d", pBone->mNumWeights);
-    
-    // Loop through all weights for this bone
-    for (unsigned int i = 0; i < pBone->mNumWeights; i++) {
-        
-        if (i == 0) printf("\n");   // Skip first
 
-        const aiVertexWeight& vw = pBone->mWeights[i];  // Influence of this bone on a vertex
+    printf("\n");
+
+    return bone_id;
+}
+
+// One bone-influence, by index into its mesh's mBones and that bone's mWeights
+struct BoneWeightRef
+{
+    unsigned int bone;
+    unsigned int weight;
+};
+
+// Weights of all bones grouped by the MeshRange their vertex is in: range r owns weights [offsets[r], offsets[r + 1]).
+// Within a range they are in bone- then weight-order, the same order the serial loop visited them in
+struct RangeWeights
+{
+    std::vector<size_t> offsets;
+    std::vector<BoneWeightRef> weights;
+};
+
+// Buckets every bone's weights by range in two passes over them (count, then fill), so each weight is visited once
+// instead of once per range of its mesh. ranges must come from split_mesh_ranges with the same chunk_size
+RangeWeights bucket_bone_weights(const aiScene* pScene, const std::vector<MeshRange>& ranges, unsigned int chunk_size)
+{
+    // First range of every mesh, the range of a vertex follows from its index
+    std::vector<size_t> first_range(pScene->mNumMeshes, 0);
+    for (size_t r = ranges.size(); r-- > 0;)
+        first_range[ranges[r].mesh] = r;
+
+    RangeWeights buckets;
+    buckets.offsets.assign(ranges.size() + 1, 0);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned int m = 0; m < pScene->mNumMeshes; m++)
+        {
+            const aiMesh* pMesh = pScene->mMeshes[m];
+            for (unsigned int b = 0; b < pMesh->mNumBones; b++)
+            {
+                const aiBone* pBone = pMesh->mBones[b];
+                for (unsigned int i = 0; i < pBone->mNumWeights; i++)
+                {
+                    // Not a vertex of this mesh, no range would have added it
+                    unsigned int vertex = pBone->mWeights[i].mVertexId;
+                    if (vertex >= pMesh->mNumVertices)
+                        continue;
+
+                    size_t r = first_range[m] + vertex / chunk_size;
+                    if (pass == 0)
+                        buckets.offsets[r + 1]++;
+                    else
+                        buckets.weights[buckets.offsets[r]++] = { b, i };
+                }
+            }
+        }
+
+        // Counts to start of every range, the fill-pass moves each start to the next range's start
+        if (pass == 0)
+        {
+            for (size_t r = 0; r < ranges.size(); r++)
+                buckets.offsets[r + 1] += buckets.offsets[r];
+            buckets.weights.resize(buckets.offsets.back());
+        }
+    }
+
+    // Back to starts
+    for (size_t r = ranges.size(); r > 0; r--)
+        buckets.offsets[r] = buckets.offsets[r - 1];
+    buckets.offsets[0] = 0;
 
-        unsigned int global_vertex_id = mesh_base_vertex[mesh_index] + vw.mVertexId; // Vertex-id becomes: N (index of first vert in current mesh) + index of vert influenced by bone
-        //printf("\t\t\tVertex id %d \n", global_vertex_id);    // Global index = base index + local mesh index
+    return buckets;
+}
+
+// Adds the bucketed weights of one range to vertex_to_bones, the range only holds its own vertices.
+// Returns how many influences were dropped since their vertex already had N stronger ones
+template<int N>
+size_t scatter_range_weights(const aiMesh* pMesh, const MeshRange& range, const BoneWeightRef* first, const BoneWeightRef* last)
+{
+    size_t dropped = 0;
+
+    for (const BoneWeightRef* ref = first; ref != last; ref++) {
+
+        const aiVertexWeight& vw = pMesh->mBones[ref->bone]->mWeights[ref->weight];  // Influence of this bone on a vertex
+
+        unsigned int global_vertex_id = mesh_base_vertex[range.mesh] + vw.mVertexId; // Vertex-id becomes: N (index of first vert in current mesh) + index of vert influenced by bone
 
         // Assert if possible to add bone-data to vertex_to_bones and then do that
-        assert(global_vertex_id < vertex_to_bones.size());
-        vertex_to_bones[global_vertex_id].AddBoneData(bone_id, vw.mWeight);
-        
-        // Print bone-info: Bone.index, Vertex-index and it weight
-        //printf("\t\t %d: vertex id %d weight %.2f\n", i, vw.mVertexId, vw.mWeight);   // OLD
+        assert(global_vertex_id < vertex_to_bones<N>.size());
+        if (!vertex_to_bones<N>[global_vertex_id].AddBoneData(mesh_bone_ids[range.mesh][ref->bone], vw.mWeight))
+            dropped++;
     }
 
-    printf("\n");
+    return dropped;
 }
 
-// Parses all bones in a mesh
+// Parses all bones in a mesh, registration is done in mesh/bone order so bone-ids are the same every run
 void parse_mesh_bones(int mesh_index, const aiMesh* pMesh)
 {
+    mesh_bone_ids[mesh_index].resize(pMesh->mNumBones);
+
     // Loop as many times as there are bones in mesh - prase every bone in mesh
     for (unsigned int i = 0; i < pMesh->mNumBones; i++) {
-        parse_single_bone(mesh_index, pMesh->mBones[i]);    // Connects bone with mesh-index
+        mesh_bone_ids[mesh_index][i] = parse_single_bone(pMesh->mBones[i]);    // Connects bone with mesh-index
     }
 }
 
@@ -364,14 +852,17 @@ void parse_meshes(const aiScene* pScene)
     int total_indices = 0;
     int total_bones = 0;
 
-    // Resize to fit all meshes's base vertices
+    // Resize to fit all meshes's base vertices/indices and bone-ids
     mesh_base_vertex.resize(pScene->mNumMeshes);
+    mesh_base_index.resize(pScene->mNumMeshes);
+    mesh_bone_ids.resize(pScene->mNumMeshes);
 
-    // Loop as many times as there are meshes in the scene
+    // Phase 1 (serial): prefix sum over vertex/index counts + bone registration
     for (unsigned int i = 0; i < pScene->mNumMeshes; i++) {
         
-        // Set base vertex as index total nr of vertices before adding new ones 
+        // Set base vertex/index as total nr of vertices/indices before adding new ones 
         mesh_base_vertex[i] = total_vertices;
+        mesh_base_index[i] = total_indices;
         
         // Get mesh at index i from mMeshes array (stores all meshes in the scene)
         const aiMesh* pMesh = pScene->mMeshes[i];
@@ -389,15 +880,42 @@ void parse_meshes(const aiScene* pScene)
         total_indices += num_indices;
         total_bones += num_bones;
 
-        // Resize, per mesh, so it can contain all vertices's bone-data (must be done repeatitly bc parse_mesh_bone() uses it)
-        vertex_to_bones.resize(total_vertices);
-        
-        // Test if current mesh has bones, and if so, parse them
+        // Test if current mesh has bones, and if so, register them
         if (pMesh->HasBones())
             parse_mesh_bones(i, pMesh); // Conects mesh with mesh-index
 
         printf("\n");
     }
+
+    // Phase 2 (parallel): every range only writes its own vertices in vertex_to_bones, bones are visited in
+    // the same order as the serial loop so every vertex gets the same influences (and order on equal weights) as before
+    std::vector<MeshRange> ranges = split_mesh_ranges(pScene, PARSE_CHUNK_SIZE,
+        [](const aiMesh* pMesh) { return pMesh->HasBones() ? pMesh->mNumVertices : 0u; });
+    RangeWeights range_weights = bucket_bone_weights(pScene, ranges, PARSE_CHUNK_SIZE);
+
+    std::atomic<size_t> dropped(0);
+    with_bones_per_vertex([&](auto n) {
+        constexpr int N = decltype(n)::value;
+
+        // One allocation for all vertices's bone-data
+        vertex_to_bones<N>.resize(total_vertices);
+
+        gWorkers.ParallelFor(ranges.size(), 1, [&](size_t first, size_t last) {
+            size_t rangeDropped = 0;
+            for (size_t r = first; r < last; r++)
+            {
+                const BoneWeightRef* weights = range_weights.weights.data();
+                rangeDropped += scatter_range_weights<N>(pScene->mMeshes[ranges[r].mesh], ranges[r],
+                    weights + range_weights.offsets[r], weights + range_weights.offsets[r + 1]);
+            }
+            dropped += rangeDropped;
+        });
+    });
+
+    // Vertices with more influences than gBonesPerVertex keep their strongest ones
+    if (dropped > 0)
+        printf("\nDropped %zu weakest bone-influences to fit %d per vertex (weights renormalized)\n", dropped.load(), gBonesPerVertex);
+
     // Print total nr of nertices, indices and bones in scene
     printf("\nTotal vertices %d total indices %d total bones %d\n", total_vertices, total_indices, total_bones);
 }
@@ -418,12 +936,12 @@ void parse_node(const aiNode* pNode, int parentBoneIndex = -1)
     int currentBoneIndex = parentBoneIndex;
 
     // If this node corresponds to a bone, store hierarchy
-    auto it = gSkeleton.boneNameToIndex.find(pNode->mName.C_Str());
-    if (it != gSkeleton.boneNameToIndex.end())
+    auto it = gSkeleton.desc.boneNameToIndex.find(pNode->mName.C_Str());
+    if (it != gSkeleton.desc.boneNameToIndex.end())
     {
         currentBoneIndex = it->second;
-        gSkeleton.bones[currentBoneIndex].parentIndex = parentBoneIndex;
-        gSkeleton.bones[currentBoneIndex].localBindPose = glm::transpose(glm::make_mat4(&pNode->mTransformation.a1));
+        gSkeleton.desc.bones[currentBoneIndex].parentIndex = parentBoneIndex;
+        gSkeleton.desc.bones[currentBoneIndex].localBindPose = glm::transpose(glm::make_mat4(&pNode->mTransformation.a1));
     }
 
     space_count += 4;   // Only used for printing matrices
@@ -446,6 +964,23 @@ void parse_hierarchy(const aiScene* pScene)
     parse_node(pScene->mRootNode, -1);
 }
 
+// Parses all animations of the scene and compresses them into gAnimations
+void parse_animations(const aiScene* pScene)
+{
+    printf("\n**************************************************\n");
+    printf("Parsing %d animations\n", pScene->mNumAnimations);
+
+    std::vector<AnimationClip> rawClips;
+    ImportAnimations(pScene, gSkeleton.desc, rawClips);
+
+    gAnimations.resize(rawClips.size());
+    for (size_t i = 0; i < rawClips.size(); i++)
+        CompressAnimationClip(rawClips[i], gAnimationCompression, gAnimations[i]);
+
+    if (gReportAnimationCompression)
+        ReportAnimationCompression(rawClips, gAnimations, gSkeleton.desc.bones.size());
+}
+
 // Parses the file-read scene, fills up many data structures
 void parse_scene(const aiScene* pScene)
 {
@@ -454,76 +989,116 @@ void parse_scene(const aiScene* pScene)
 
     // Go through scene-node and find all nodes and their realationships (parent-child, like blender)
     parse_hierarchy(pScene);
-}
-
-// ------------------------- LOADING & UPLOADING  -------------------------
 
-// Upload bones as uniform attribute to shader
-void uploadBoneMatrices(Shader* shader, const std::vector<glm::mat4>& matrices)
-{
-    // Safety clamp in case model has more bones than shader supports
-    int count = (int)matrices.size();
-    count = std::min(count, 128);
+    // Put parents before children so the pose can be computed in one pass
+    sort_skeleton_by_depth();
 
-    // Upload bones as uniform attribute to shader
-    shader->SetMat4Array("uBones", matrices.data(), count);
+    // Animations last, channels are mapped to the final (sorted) bone-indices
+    parse_animations(pScene);
 }
 
-// Converts parsed Assimp + bone data into GPU-ready buffers, fills GPU vertex-data
+// ------------------------- LOADING & UPLOADING  -------------------------
+
+// Converts parsed Assimp + bone data into GPU-ready buffers, fills GPU vertex-data.
+// 8-influence models also fill gpuVerticesWide, gpuVertices then gets the 4 strongest of every vertex (for the CPU-side paths)
+template<int N>
 void build_gpu_buffers(const aiScene* pScene)
 {
-    gpuVertices.resize(vertex_to_bones.size());
-
-    // Go through all meshes
-    for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
-    {
-        const aiMesh* pMesh = pScene->mMeshes[i];
-        
-        // Go through all vertices within current mesh
-        for (unsigned int v = 0; v < pMesh->mNumVertices; v++)
+    // Sizes are known from parse_meshes, so every range can write straight into its own slice
+    gpuVertices.resize(vertex_to_bones<N>.size());
+    if (N > 4)
+        gpuVerticesWide.resize(vertex_to_bones<N>.size());
+    gpuIndices.resize(pScene->mNumMeshes > 0
+        ? mesh_base_index.back() + pScene->mMeshes[pScene->mNumMeshes - 1]->mNumFaces * 3
+        : 0);
+
+    // Go through all vertices, split in ranges over all worker-threads
+    std::vector<MeshRange> vertex_ranges = split_mesh_ranges(pScene, PARSE_CHUNK_SIZE,
+        [](const aiMesh* pMesh) { return pMesh->mNumVertices; });
+
+    gWorkers.ParallelFor(vertex_ranges.size(), 1, [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; r++)
         {
-            unsigned int globalID = mesh_base_vertex[i] + v;
-
-            // Copy position
-            gpuVertices[globalID].Position = glm::vec3(
-                pMesh->mVertices[v].x,
-                pMesh->mVertices[v].y,
-                pMesh->mVertices[v].z
-            );
-
-            // Copy normals
-            gpuVertices[globalID].Normal = glm::vec3(
-                pMesh->mNormals[v].x,
-                pMesh->mNormals[v].y,
-                pMesh->mNormals[v].z
-            );
+            const MeshRange& range = vertex_ranges[r];
+            const aiMesh* pMesh = pScene->mMeshes[range.mesh];
 
-            // Copy bone IDs
-            gpuVertices[globalID].BoneIDs = glm::ivec4(
-                vertex_to_bones[globalID].BoneIDs[0],
-                vertex_to_bones[globalID].BoneIDs[1],
-                vertex_to_bones[globalID].BoneIDs[2],
-                vertex_to_bones[globalID].BoneIDs[3]
-            );
-
-            // Copy bone weights
-            gpuVertices[globalID].Weights = glm::vec4(
-                vertex_to_bones[globalID].Weights[0],
-                vertex_to_bones[globalID].Weights[1],
-                vertex_to_bones[globalID].Weights[2],
-                vertex_to_bones[globalID].Weights[3]
-            );
+            // Go through all vertices within current range
+            for (unsigned int v = range.begin; v < range.end; v++)
+            {
+                unsigned int globalID = mesh_base_vertex[range.mesh] + v;
+
+                // Copy position
+                gpuVertices[globalID].Position = glm::vec3(
+                    pMesh->mVertices[v].x,
+                    pMesh->mVertices[v].y,
+                    pMesh->mVertices[v].z
+                );
+
+                // Copy normals
+                gpuVertices[globalID].Normal = glm::vec3(
+                    pMesh->mNormals[v].x,
+                    pMesh->mNormals[v].y,
+                    pMesh->mNormals[v].z
+                );
+
+                const VertexBoneData<N>& bones = vertex_to_bones<N>[globalID];
+
+                // Copy bone IDs (the 4 strongest)
+                gpuVertices[globalID].BoneIDs = glm::ivec4(
+                    bones.BoneIDs[0],
+                    bones.BoneIDs[1],
+                    bones.BoneIDs[2],
+                    bones.BoneIDs[3]
+                );
+
+                // Copy bone weights
+                gpuVertices[globalID].Weights = glm::vec4(
+                    bones.Weights[0],
+                    bones.Weights[1],
+                    bones.Weights[2],
+                    bones.Weights[3]
+                );
+
+                // All 8 for the GPU, the 4 strongest renormalized for everything else
+                if constexpr (N > 4)
+                {
+                    VertexGPUT<N>& wide = gpuVerticesWide[globalID];
+                    wide.Position = gpuVertices[globalID].Position;
+                    wide.Normal = gpuVertices[globalID].Normal;
+                    for (int k = 0; k < N; k++) {
+                        wide.BoneIDs[k] = bones.BoneIDs[k];
+                        wide.Weights[k] = bones.Weights[k];
+                    }
+
+                    float sum = glm::dot(gpuVertices[globalID].Weights, glm::vec4(1.0f));
+                    if (sum > 0.0f)
+                        gpuVertices[globalID].Weights /= sum;
+                }
+            }
         }
+    });
+
+    // Build index buffer by going through all faces, also split in ranges
+    std::vector<MeshRange> face_ranges = split_mesh_ranges(pScene, PARSE_CHUNK_SIZE,
+        [](const aiMesh* pMesh) { return pMesh->mNumFaces; });
 
-        // Build index buffer by going through all faces within current mesh
-        for (unsigned int f = 0; f < pMesh->mNumFaces; f++)
+    gWorkers.ParallelFor(face_ranges.size(), 1, [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; r++)
         {
-            const aiFace& face = pMesh->mFaces[f];
-            gpuIndices.push_back(mesh_base_vertex[i] + face.mIndices[0]);
-            gpuIndices.push_back(mesh_base_vertex[i] + face.mIndices[1]);
-            gpuIndices.push_back(mesh_base_vertex[i] + face.mIndices[2]);
+            const MeshRange& range = face_ranges[r];
+            const aiMesh* pMesh = pScene->mMeshes[range.mesh];
+            unsigned int base_vertex = mesh_base_vertex[range.mesh];
+
+            for (unsigned int f = range.begin; f < range.end; f++)
+            {
+                const aiFace& face = pMesh->mFaces[f];
+                unsigned int* out = &gpuIndices[mesh_base_index[range.mesh] + f * 3];
+                out[0] = base_vertex + face.mIndices[0];
+                out[1] = base_vertex + face.mIndices[1];
+                out[2] = base_vertex + face.mIndices[2];
+            }
         }
-    }
+    });
 
     // Check Assimp metadata makes it to the CPU-buffer
     /*for (int i = 0; i < 5 && i < gpuVertices.size(); i++)
@@ -539,8 +1114,36 @@ void build_gpu_buffers(const aiScene* pScene)
 
 }
 
-// Uploads GPU vertex/index data to OpenGL bu creating VAO, VBO and EBO
-void create_opengl_buffers()
+// Nr of influences the skinning-shaders blend from gVBO (skinning.vs defaults to 4)
+std::string get_influence_defines()
+{
+    return gBonesPerVertex == 8 ? "#define NUM_INFLUENCES 8\n" : "";
+}
+
+// Packed layout and dequantisation of gVBO, empty when it holds plain vertices
+std::string get_packing_defines()
+{
+    return gPackedVertices.count > 0 ? GetPackedVertexDefines(gPackedVertices) : "";
+}
+
+// Everything a shader reading gVBO as it is needs to know about its layout
+std::string get_vertex_defines()
+{
+    return get_influence_defines() + get_packing_defines();
+}
+
+// Vertex-layout of gVBO for the bound VAO, 8-influence models have the wide layout there
+void set_model_vertex_attributes()
+{
+    if (gPackedVertices.count > 0)
+        SetPackedVertexAttributes(gPackedVertices);
+    else
+        with_bones_per_vertex([](auto n) { SetVertexGPUAttributes<decltype(n)::value>(); });
+}
+
+// Uploads GPU vertex/index data to OpenGL bu creating VAO, VBO and EBO, data may point into gpuVertices/gpuIndices or straight into the model-cache
+template<int N>
+void create_opengl_buffers(const VertexGPUT<N>* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
 {
     // Create VAO, VBO and EBO
     glGenVertexArrays(1, &gVAO);
@@ -548,57 +1151,135 @@ void create_opengl_buffers()
     glGenBuffers(1, &gEBO);
 
     // Bind attributes to shader via VAO
-    glBindVertexArray(gVAO);
+    BindVertexArray(gVAO);
+
+    // Pack the vertices first if asked to, the layout only has 4 influences
+    if constexpr (N == 4) {
+        if (gPackVertices)
+            PackVertices(vertices, vertexCount, gSkeleton.desc.bones.size(), gPackedFormat, gPackedVertices);
+    }
+    else if (gPackVertices)
+        printf("Vertex-packing needs 4 influences per vertex, uploading %d-influence vertices as they are\n", N);
 
     // Bind vertices to VBO
     glBindBuffer(GL_ARRAY_BUFFER, gVBO);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        gpuVertices.size() * sizeof(VertexGPU),
-        gpuVertices.data(),
-        GL_STATIC_DRAW
-    );
+    if (gPackedVertices.count > 0)
+    {
+        glBufferData(GL_ARRAY_BUFFER, gPackedVertices.data.size(), gPackedVertices.data.data(), GL_STATIC_DRAW);
+        printf("Packed vertices: %zu bytes each instead of %zu\n", gPackedVertices.stride, sizeof(VertexGPUT<N>));
+
+        // Only the layout is needed from now on
+        gPackedVertices.data.clear();
+        gPackedVertices.data.shrink_to_fit();
+    }
+    else
+    {
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            vertexCount * sizeof(VertexGPUT<N>),
+            vertices,
+            GL_STATIC_DRAW
+        );
+    }
 
     // Bind indices to EBO
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gEBO);
     glBufferData(
         GL_ELEMENT_ARRAY_BUFFER,
-        gpuIndices.size() * sizeof(unsigned int),
-        gpuIndices.data(),
+        indexCount * sizeof(unsigned int),
+        indices,
         GL_STATIC_DRAW
     );
+    gIndexCount = (GLsizei)indexCount;
+    gVertexCount = (GLsizei)vertexCount;
 
     // Upload attributes to shader (ordered) ----------------------
+    set_model_vertex_attributes();
 
-    // Vertex position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexGPU), (void*)0);
-    glEnableVertexAttribArray(0);
+    BindVertexArray(0);
+}
 
-    // Vertex normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexGPU),(void*)offsetof(VertexGPU, Normal));
-    glEnableVertexAttribArray(1);
+// Optimizes the index- and vertex-order of every mesh (see mesh_optimizer.h), meshes are done in parallel.
+// Vertices stay inside their mesh so mesh_base_vertex/mesh_base_index still hold
+void optimize_model_meshes()
+{
+    using Clock = std::chrono::high_resolution_clock;
+    Clock::time_point t0 = Clock::now();
+
+    VertexCacheStats before = AnalyzeVertexCache(gpuIndices.data(), gpuIndices.size(), gpuVertices.size());
 
-    // Bone IDs (integer attribute!)
-    glVertexAttribIPointer(2, 4, GL_INT, sizeof(VertexGPU), (void*)offsetof(VertexGPU, BoneIDs));
-    glEnableVertexAttribArray(2);
+    gWorkers.ParallelFor(mesh_base_vertex.size(), 1, [](size_t first, size_t last) {
+        for (size_t m = first; m < last; m++)
+        {
+            // Vertex- and index-range of the mesh
+            size_t baseVertex = mesh_base_vertex[m];
+            size_t vertexCount = (m + 1 < mesh_base_vertex.size() ? mesh_base_vertex[m + 1] : gpuVertices.size()) - baseVertex;
+            size_t baseIndex = mesh_base_index[m];
+            size_t indexCount = (m + 1 < mesh_base_index.size() ? mesh_base_index[m + 1] : gpuIndices.size()) - baseIndex;
+            if (vertexCount == 0 || indexCount < 3)
+                continue;
+
+            // Mesh-local indices
+            unsigned int* indices = &gpuIndices[baseIndex];
+            for (size_t i = 0; i < indexCount; i++)
+                indices[i] -= (unsigned int)baseVertex;
+
+            OptimizeVertexCache(indices, indexCount, vertexCount);
+            OptimizeOverdraw(indices, indexCount, &gpuVertices[baseVertex].Position, vertexCount, sizeof(VertexGPU));
+
+            // Renumber vertices by first use
+            std::vector<unsigned int> remap;
+            BuildVertexFetchRemap(indices, indexCount, vertexCount, remap);
+            RemapVertices(&gpuVertices[baseVertex], vertexCount, remap);
+            if (!gpuVerticesWide.empty())
+                RemapVertices(&gpuVerticesWide[baseVertex], vertexCount, remap);
+
+            for (size_t i = 0; i < indexCount; i++)
+                indices[i] = remap[indices[i]] + (unsigned int)baseVertex;
+        }
+    });
 
-    // Bone weights
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(VertexGPU), (void*)offsetof(VertexGPU, Weights));
-    glEnableVertexAttribArray(3);
+    VertexCacheStats after = AnalyzeVertexCache(gpuIndices.data(), gpuIndices.size(), gpuVertices.size());
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
 
-    glBindVertexArray(0);
+    printf("Mesh optimization (%zu meshes, %.1f ms): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+        mesh_base_vertex.size(), ms, before.acmr, after.acmr, before.atvr, after.atvr);
 }
 
 
 // Load-flags for reading: Triangulate all polygons in mesh + generate normals + join identical vertices (may needed after triangulate)
 #define ASSIMP_LOAD_FLAGS (aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_JoinIdenticalVertices)
 
-// Loads model in "Models"-folder and initializes new structurs
-bool loadModel(const std::string& filename)
+// IMPORTANT:
+// Clear previous data so loading multiple models works correctly and bone indices start from 0 again
+void clear_model_data()
 {
-    // Build full path: Models/<filename>
-    std::string fullPath = "../Models/" + filename;
+    vertex_to_bones<4>.clear();
+    vertex_to_bones<8>.clear();
+    mesh_base_vertex.clear();
+    mesh_base_index.clear();
+    mesh_bone_ids.clear();
+    gpuVertices.clear();
+    gpuVerticesWide.clear();
+    gPackedVertices = PackedVertices();
+    gpuIndices.clear();
+    gSkeleton.desc = SkeletonDesc();
+    gSkeleton.pose = SkeletonPose();
+    gAnimationPlayer.Stop();
+    gCrossfadePlayer.Stop();
+    gAnimations.clear();
+    gSkinningStreams = SkinningStreams();
+    gCpuPalette.clear();
+    gCpuSkinnedVertices.clear();
+    gPartitionedMesh = PartitionedMesh();
+    gInfluenceMesh = InfluenceBucketedMesh();
+    gDualQuatSource.clear();
+    gModelCache.Close();
+}
 
+// Imports a model through Assimp, fills gSkeleton, mesh_base_vertex and gpuVertices/gpuIndices
+bool import_model_assimp(const std::string& fullPath)
+{
     Assimp::Importer importer;  // Assimp importer, handles Assimp parsing
     const aiScene* pScene = importer.ReadFile(fullPath, ASSIMP_LOAD_FLAGS); // Use flags from above
 
@@ -609,154 +1290,881 @@ bool loadModel(const std::string& filename)
         return false;
     }
 
-    // IMPORTANT:
-    // Clear previous data so loading multiple models works correctly and bone indices start from 0 again
-    vertex_to_bones.clear();
-    mesh_base_vertex.clear();
-    gpuVertices.clear();
-    gpuIndices.clear();
-    gSkeleton.bones.clear();               
-    gSkeleton.boneNameToIndex.clear();      
+    clear_model_data();
 
     // Parse scene (meshes + bones + hierarchy)
     parse_scene(pScene);
 
     // Normalize weights AFTER all bones are known
-    normalize_vertex_bone_weights();
-
-    // Initialize runtime pose from bind pose
-    initializeSkeletonPose(gSkeleton);
-
-    // Compute initial global transforms (bind pose)
-    computeGlobalBoneTransforms(gSkeleton);
-
-    // Build physics skeleton ONCE from bind pose
-    buildPhysicsSkeleton(gSkeleton, gPhysicsSkeleton);
+    with_bones_per_vertex([](auto n) { normalize_vertex_bone_weights<decltype(n)::value>(); });
 
     // Set global aiScene
     gScene = pScene;
 
-    // Build and create GPU buffers
-    build_gpu_buffers(importer.GetScene());
-    create_opengl_buffers();
+    // Build GPU buffers (CPU-side)
+    with_bones_per_vertex([&](auto n) { build_gpu_buffers<decltype(n)::value>(importer.GetScene()); });
 
-    // Inform input controller how many bones are available
-    input.SetMaxBoneIndex(static_cast<int>(gSkeleton.bones.size()));
+    // Reorder for the GPU before anything (cache, packing, partitions) copies the buffers
+    if (gOptimizeMeshes)
+        optimize_model_meshes();
 
-    // Only returns true if all previous steps succeed
     return true;
 }
 
-// ------------------------- MAIN -------------------------
-int main()
+// Import-settings that change the baked data, a cache made with others is re-imported
+uint32_t get_import_flags()
 {
+    return gOptimizeMeshes ? MODEL_CACHE_OPTIMIZED_MESHES : 0u;
+}
 
-    // ----------------------------------------------------
-    // Initialize GLFW (make veiwing-window)
-    // ----------------------------------------------------
-    if (!glfwInit()) {
-        std::cerr << "Failed to init GLFW\n";
-        return -1;
-    }
+// Maps the baked model-cache, fills gSkeleton and mesh_base_vertex (vertices/indices stay in gModelCache)
+bool load_model_cache(const std::string& fullPath)
+{
+    clear_model_data();
 
-    // Request an OpenGL 3.3 core profile context before creating a window
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (!gModelCache.Open(fullPath, get_import_flags()))
+        return false;
 
-    // Create the application window
-    gWindow = glfwCreateWindow(1280, 720, "Model Viewer", nullptr, nullptr);
-    if (!gWindow) {
-        glfwTerminate();
-        return -1;
+    gModelCache.ReadSkeleton(gSkeleton.desc);    // Already sorted by depth when it was baked
+    compute_skeleton_levels(gSkeleton.desc);
+    gModelCache.ReadMeshBaseVertices(mesh_base_vertex);
+    gModelCache.ReadAnimations(gAnimations);
+    gScene = nullptr;   // No Assimp scene when loading from the cache
+
+    return true;
+}
+
+// Vertices of the loaded model, in gpuVertices or straight in the model-cache mapping
+const VertexGPU* get_model_vertices(size_t& outCount)
+{
+    if (gModelCache.IsOpen()) {
+        outCount = gModelCache.GetVertexCount();
+        return gModelCache.GetVertices();
     }
 
-    // Make the OpenGL context current for this window
-    glfwMakeContextCurrent(gWindow);
+    outCount = gpuVertices.size();
+    return gpuVertices.data();
+}
 
-    // ----------------------------------------------------
-    // Initialize GLEW (loads OpenGL function pointers)
-    // ----------------------------------------------------
-    
-    // Start GLEW
-    glewExperimental = GL_TRUE;
-    GLenum glewErr = glewInit();
-    if (glewErr != GLEW_OK) {
-        std::cerr << "GLEW error: " << glewGetErrorString(glewErr) << std::endl;
-        return -1;
+// Indices of the loaded model, in gpuIndices or straight in the model-cache mapping
+const unsigned int* get_model_indices(size_t& outCount)
+{
+    if (gModelCache.IsOpen()) {
+        outCount = gModelCache.GetIndexCount();
+        return gModelCache.GetIndices();
     }
 
-    if (boneLinesMode) {
-        
-        // Upload and draw debugging-bones, use DebugVertex
-        glGenVertexArrays(1, &gBoneVAO);
-        glGenBuffers(1, &gBoneVBO);
+    outCount = gpuIndices.size();
+    return gpuIndices.data();
+}
 
-        glBindVertexArray(gBoneVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, gBoneVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(DebugVertex) * 256, nullptr, GL_DYNAMIC_DRAW);
+// Splits the model into draw-batches with at most as many bones as fit in the vertex-uniforms, with their own VAO/VBO/EBO.
+// The palette goes to gCpuPalette and is sliced per batch when drawing
+bool create_palette_batches()
+{
+    size_t vertexCount = 0, indexCount = 0;
+    const VertexGPU* vertices = get_model_vertices(vertexCount);
+    const unsigned int* indices = get_model_indices(indexCount);
+
+    GLint components = 1024;
+    glGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS, &components);
+    size_t maxBones = MaxBonesForUniformComponents(components);
+
+    if (!PartitionByBones(vertices, vertexCount, indices, indexCount, mesh_base_vertex, maxBones, gPartitionedMesh))
+        return false;
+
+    gCpuPalette.resize(gSkeleton.pose.Size());
+    gBatchPalette.resize(maxBones);
+
+    glGenVertexArrays(1, &gBatchVAO);
+    glGenBuffers(1, &gBatchVBO);
+    glGenBuffers(1, &gBatchEBO);
+
+    BindVertexArray(gBatchVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gBatchVBO);
+    glBufferData(GL_ARRAY_BUFFER, gPartitionedMesh.vertices.size() * sizeof(VertexGPU),
+        gPartitionedMesh.vertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBatchEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, gPartitionedMesh.indices.size() * sizeof(unsigned int),
+        gPartitionedMesh.indices.data(), GL_STATIC_DRAW);
+
+    SetVertexGPUAttributes<4>();
+
+    BindVertexArray(0);
+    return true;
+}
+
+// Sorts the model's triangles into influence-buckets and uploads each bucket with its packed vertex-layout
+void create_influence_buckets()
+{
+    size_t vertexCount = 0, indexCount = 0;
+    const VertexGPU* vertices = get_model_vertices(vertexCount);
+    const unsigned int* indices = get_model_indices(indexCount);
+
+    BucketByInfluences(vertices, vertexCount, indices, indexCount, gInfluenceMesh);
+    ReportInfluenceBuckets(gInfluenceMesh);
+
+    for (int b = 0; b < NUM_INFLUENCE_BUCKETS; b++)
+    {
+        const InfluenceBucket& bucket = gInfluenceMesh.buckets[b];
+        if (bucket.indices.empty())
+            continue;
+
+        glGenVertexArrays(1, &gBucketVAO[b]);
+        glGenBuffers(1, &gBucketVBO[b]);
+        glGenBuffers(1, &gBucketEBO[b]);
+
+        BindVertexArray(gBucketVAO[b]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, gBucketVBO[b]);
+        glBufferData(GL_ARRAY_BUFFER, bucket.vertices.size(), bucket.vertices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBucketEBO[b]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, bucket.indices.size() * sizeof(unsigned int), bucket.indices.data(), GL_STATIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)0);
+        // Same locations as VertexGPU, bone-ids and weights only have K components (the shader-variant never reads the rest)
+        GLsizei stride = (GLsizei)InfluenceVertexStride(bucket.influences);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
         glEnableVertexAttribArray(0);
-        glBindVertexArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(2, bucket.influences, GL_INT, stride, (void*)InfluenceBoneIdsOffset());
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(3, bucket.influences, GL_FLOAT, GL_FALSE, stride, (void*)InfluenceWeightsOffset(bucket.influences));
+        glEnableVertexAttribArray(3);
+
+        BindVertexArray(0);
     }
+}
 
-    // Clear the spurious OpenGL error caused by GLEW + core profile
-    glGetError();
+// Pass-through VAO for pre-skinned vertices: position + normal from skinnedBuffer, bone-ids + weights still from gVBO
+// (weight-visualization needs them), indices from gEBO
+void create_skinned_vao(GLuint skinnedBuffer)
+{
+    if (!gSkinnedVAO)
+        glGenVertexArrays(1, &gSkinnedVAO);
+    BindVertexArray(gSkinnedVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gEBO);
+    glBindBuffer(GL_ARRAY_BUFFER, gVBO);
 
-    // Print some OpenGL info to check OpenGL works
-    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
-    std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
+    // Bone IDs + weights, position + normal are replaced below
+    set_model_vertex_attributes();
 
-    // ----------------------------------------------------
-    // Global OpenGL settings
-    // ----------------------------------------------------
+    BindVertexArray(0);
 
-    // Set the background color (dark bluish gray)
-    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+    set_skinned_vertex_source(skinnedBuffer, 0);
+}
 
-    // Enable depth testing so triangles are occluded
-    glEnable(GL_DEPTH_TEST);
+// Streams, CPU-palette and output-buffer for skinning on the CPU, nothing for models without bones
+void create_cpu_skinning(const VertexGPU* vertices, size_t vertexCount)
+{
+    size_t numBones = gSkeleton.pose.Size();
+    if (numBones == 0 || vertexCount == 0)
+        return;
 
-    // Disable face culling temporarily to avoid winding issues, turned on later again
-    glDisable(GL_CULL_FACE);
+    BuildSkinningStreams(vertices, vertexCount, numBones, gSkinningStreams);
+    gCpuPalette.resize(numBones);
 
+    // No GL-context, skin into plain memory
+    if (gHeadless) {
+        gCpuSkinnedVertices.resize(vertexCount);
+        return;
+    }
+
+    if (gSkinnedStream.Create(vertexCount, sizeof(SkinnedVertex)))
+        create_skinned_vao(gSkinnedStream.GetBuffer());
+}
+
+// Loads model in "Models"-folder and initializes new structurs
+bool loadModel(const std::string& filename)
+{
+    // Build full path: Models/<filename>
+    std::string fullPath = "../Models/" + filename;
+
+    // The model-cache stores VertexGPU, 8-influence models always go through Assimp
+    bool useCache = gUseModelCache && gBonesPerVertex == 4;
+
+    if (useCache && load_model_cache(fullPath))
+    {
+        printf("Loaded '%s' from model cache\n", filename.c_str());
+
+        // Upload straight from the mapping
+        if (!gHeadless)
+            create_opengl_buffers(
+                gModelCache.GetVertices(), gModelCache.GetVertexCount(),
+                gModelCache.GetIndices(), gModelCache.GetIndexCount());
+    }
+    else
+    {
+        if (!import_model_assimp(fullPath))
+            return false;
+
+        // Bake result so the next load can skip Assimp
+        if (useCache)
+            ModelCache::Write(fullPath, get_import_flags(), gpuVertices, gpuIndices, mesh_base_vertex, gSkeleton.desc, gAnimations);
+
+        if (!gHeadless && !gpuVerticesWide.empty())
+            create_opengl_buffers(gpuVerticesWide.data(), gpuVerticesWide.size(), gpuIndices.data(), gpuIndices.size());
+        else if (!gHeadless)
+            create_opengl_buffers(gpuVertices.data(), gpuVertices.size(), gpuIndices.data(), gpuIndices.size());
+    }
+
+    // Initialize runtime pose from bind pose
+    initializeSkeletonPose(gSkeleton);
+
+    // Compute initial global transforms (bind pose)
+    computeGlobalBoneTransforms(gSkeleton);
+
+    // Bone-palette, filled by the first frames: GPU-copies, or plain memory when skinning on the CPU
+    if (gCpuSkinning || gHeadless)
+    {
+        size_t vertexCount = 0;
+        const VertexGPU* vertices = get_model_vertices(vertexCount);
+        create_cpu_skinning(vertices, vertexCount);
+    }
+    else if (gPartitionPalette && gSkeleton.pose.Size() > 0)
+        create_palette_batches();   // Palette is sliced per draw-batch on the CPU, no palette-buffer or pre-pass
+    else if (!gBonePalette.Create(gSkeleton.pose.Size(), BONE_PALETTE_TEXTURE_UNIT, false, gDualQuatSkinning) && gSkeleton.pose.Size() > 0)
+    {
+        // Rig too large for a palette-buffer, batches with uniform-array slices work for any size (matrices only)
+        std::cerr << "Falling back to palette-partitioning\n";
+        gDualQuatSkinning = false;
+        if (!create_palette_batches())
+            std::cerr << "Could not partition the mesh by bones, the model will not be skinned\n";
+    }
+    else
+    {
+
+        // Skin once per frame for all passes, unless the model is drawn bucket by bucket (or with dual quaternions)
+        if (gDualQuatSkinning)
+            gDualQuatSource.resize(gSkeleton.pose.Size());
+        else if (gInfluenceBuckets && gSkeleton.pose.Size() > 0)
+            create_influence_buckets();
+        else if (gSkinningPrepass && gSkeleton.pose.Size() > 0 && gSkinningFeedback.Create(gVertexCount, gBonePalette, gShaderLibrary, get_vertex_defines()))
+            create_skinned_vao(gSkinningFeedback.GetBuffer());
+    }
+
+    // Build physics skeleton ONCE from bind pose
+    buildPhysicsSkeleton(gSkeleton, gPhysicsSkeleton);
+
+    // Inform input controller how many bones are available
+    input.SetMaxBoneIndex(static_cast<int>(gSkeleton.desc.bones.size()));
+
+    // Start first clip, if any
+    if (gPlayAnimation && !gAnimations.empty())
+    {
+        gAnimationPlayer.Play(&gAnimations[0]);
+        printf("Playing animation '%s'\n", gAnimations[0].name.c_str());
+
+        if (gCrossfadeClips && gAnimations.size() > 1)
+        {
+            gCrossfadePlayer.Play(&gAnimations[1]);
+            printf("Crossfading with animation '%s'\n", gAnimations[1].name.c_str());
+        }
+    }
+
+    // Layer-buffers for blending, allocated once per model
+    gPoseBlender.Init(gSkeleton.pose.Size(), MAX_BLEND_LAYERS);
+
+    // Only returns true if all previous steps succeed
+    return true;
+}
+
+// Prints load-time through Assimp vs through the model-cache for every model in "Models"-folder (no GPU upload in either)
+void report_model_cache_speedup()
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Row { std::string name; double assimpMs; double cacheMs; };
+    std::vector<Row> rows;
+
+    Assimp::Importer extensionCheck;    // Only used to skip files Assimp can't read (textures, .mtl...)
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("../Models", ec))
+    {
+        if (!entry.is_regular_file())
+            continue;
+
+        std::string ext = entry.path().extension().string();
+        if (ext == ".skcache" || ext == ".tmp" || !extensionCheck.IsExtensionSupported(ext))
+            continue;
+
+        std::string fullPath = entry.path().string();
+
+        // Assimp path, also (re)bakes the cache so the second path has something to read
+        auto t0 = Clock::now();
+        if (!import_model_assimp(fullPath))
+            continue;
+        auto t1 = Clock::now();
+        ModelCache::Write(fullPath, get_import_flags(), gpuVertices, gpuIndices, mesh_base_vertex, gSkeleton.desc, gAnimations);
+
+        // Cache path, touch every vertex once so the mapping is actually paged in
+        auto t2 = Clock::now();
+        if (!load_model_cache(fullPath))
+            continue;
+        volatile float checksum = 0.0f;
+        const VertexGPU* vertices = gModelCache.GetVertices();
+        for (size_t v = 0; v < gModelCache.GetVertexCount(); v++)
+            checksum = checksum + vertices[v].Position.x;
+        auto t3 = Clock::now();
+
+        rows.push_back({ entry.path().filename().string(),
+            std::chrono::duration<double, std::milli>(t1 - t0).count(),
+            std::chrono::duration<double, std::milli>(t3 - t2).count() });
+    }
+
+    clear_model_data();
+
+    printf("\n**************************************************\n");
+    printf("Model cache vs Assimp load-time\n\n");
+    printf("%-40s %12s %12s %10s\n", "Model", "Assimp (ms)", "Cache (ms)", "Speedup");
+    for (const Row& row : rows)
+    {
+        printf("%-40s %12.2f %12.2f %9.1fx\n", row.name.c_str(), row.assimpMs, row.cacheMs,
+            row.cacheMs > 0.0 ? row.assimpMs / row.cacheMs : 0.0);
+    }
+    printf("\n");
+}
+
+// Prints GPU-memory, vertex-fetch bandwidth and skinning-error of the packed layouts for every model in "Models"-folder.
+// The error is measured after skinning with the middle of the first clip (bind pose without clips)
+void report_vertex_packing()
+{
+    struct Layout { const char* name; PackedVertexFormat format; };
+    Layout layouts[3];
+    layouts[0].name = "16-bit pos, 8-bit weights";
+    layouts[1].name = "float pos, 8-bit weights";
+    layouts[1].format.quantizePositions = false;
+    layouts[2].name = "16-bit pos, 16-bit weights";
+    layouts[2].format.wideWeights = true;
+
+    Assimp::Importer extensionCheck;    // Only used to skip files Assimp can't read (textures, .mtl...)
+
+    printf("\n**************************************************\n");
+    printf("Vertex-packing (vs %zu-byte VertexGPU, fetch = one skinning-pass at 60 Hz)\n\n", sizeof(VertexGPU));
+    printf("%-32s %-28s %6s %12s %14s %12s %12s\n", "Model", "Layout", "Bytes", "Memory (KB)", "Fetch (MB/s)", "Pos-error", "Normal (deg)");
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("../Models", ec))
+    {
+        if (!entry.is_regular_file())
+            continue;
+
+        std::string ext = entry.path().extension().string();
+        if (ext == ".skcache" || ext == ".tmp" || !extensionCheck.IsExtensionSupported(ext))
+            continue;
+
+        if (!import_model_assimp(entry.path().string()))
+            continue;
+
+        size_t vertexCount = 0;
+        const VertexGPU* vertices = get_model_vertices(vertexCount);
+        size_t numBones = gSkeleton.desc.bones.size();
+
+        // Pose to skin with
+        SkeletonPose pose;
+        InitSkeletonPose(pose, gSkeleton.desc);
+        if (!gAnimations.empty()) {
+            AnimationPlayer player;
+            player.Play(&gAnimations[0]);
+            player.Update(gAnimations[0].duration * 0.5f, pose);
+        }
+        std::vector<Affine3x4> palette(numBones);
+        ComputePosePalette(pose, palette.data());
+
+        std::string name = entry.path().filename().string();
+        printf("%-32s %-28s %6zu %12.1f %14.1f %12s %12s\n", name.c_str(), "VertexGPU", sizeof(VertexGPU),
+            vertexCount * sizeof(VertexGPU) / 1024.0, vertexCount * sizeof(VertexGPU) * 60.0 / (1024.0 * 1024.0), "-", "-");
+
+        for (const Layout& layout : layouts)
+        {
+            PackedVertices packed;
+            PackVertices(vertices, vertexCount, numBones, layout.format, packed);
+            PackingError error = MeasurePackingError(vertices, vertexCount, packed, palette.data(), numBones);
+
+            printf("%-32s %-28s %6zu %12.1f %14.1f %12.5f %12.3f\n", "", layout.name, packed.stride,
+                packed.data.size() / 1024.0, packed.data.size() * 60.0 / (1024.0 * 1024.0),
+                error.maxPosition, error.maxNormalDegrees);
+        }
+    }
+
+    clear_model_data();
+    printf("\n");
+}
+
+// Palette-declaration for the skinning-shaders: uniform-array of a batch, or whatever gBonePalette uses
+std::string get_palette_defines()
+{
+    if (!gPartitionedMesh.batches.empty())
+        return "#define BONE_PALETTE_UNIFORM\n#define MAX_SHADER_BONES " + std::to_string(gPartitionedMesh.maxBones) + "\n";
+
+    return gBonePalette.GetShaderDefines();
+}
+
+// CPU skinning benchmark on the loaded model (in its current pose) and on a synthetic 1M-vertex mesh
+void run_skinning_benchmark(const std::string& modelName)
+{
+    size_t vertexCount = 0;
+    const VertexGPU* vertices = get_model_vertices(vertexCount);
+    const SkeletonPose& pose = gSkeleton.pose;
+
+    // Palette straight from the global poses, ComputePosePalette would clear the dirty-flags the real palette still needs
+    AlignedVector<Affine3x4> palette(pose.Size());
+    for (size_t i = 0; i < pose.Size(); i++)
+        palette[i] = AffineMul(pose.globalPoses[i], pose.offsetMatrices[i]);
+
+    BenchmarkCpuSkinning(modelName.c_str(), vertices, palette.empty() ? 0 : vertexCount,
+        palette.data(), palette.size(), gWorkers);
+}
+
+// Runs animation + CPU skinning without a window or GL-context and prints the average cost per frame
+int run_headless(const std::string& modelName)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    if (!loadModel(modelName)) {
+        std::cerr << "Failed to load model.\n";
+        return 1;
+    }
+
+    printf("\nHeadless: %zu vertices, %zu bones, %d frames\n",
+        gSkinningStreams.Size(), gSkeleton.pose.Size(), HEADLESS_FRAMES);
+
+    const float deltaTime = 1.0f / 60.0f;
+    double poseMs = 0.0, skinMs = 0.0;
+
+    for (int frame = 0; frame < HEADLESS_FRAMES; frame++)
+    {
+        float currentTime = frame * deltaTime;
+
+        auto t0 = Clock::now();
+        updateSkeletonAnimation(deltaTime, currentTime);
+        PoseUpdateStats poseStats = updateBonePalette(gSkeleton);
+        auto t1 = Clock::now();
+        skinModelOnCpu();
+        auto t2 = Clock::now();
+
+        poseMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        skinMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+        if (gReportBoneUpdates)
+            report_bone_updates(poseStats.bonesEvaluated, poseStats.paletteWritten, currentTime);
+    }
+
+    printf("Per frame: %.3f ms animation + palette, %.3f ms skinning (%u threads)\n",
+        poseMs / HEADLESS_FRAMES, skinMs / HEADLESS_FRAMES, gWorkers.GetThreadCount());
+
+    if (gRunSkinningBenchmark)
+        run_skinning_benchmark(modelName);
+
+    clear_model_data();
+    return 0;
+}
+
+// Frame-time of crowds of 100/1000/5000 instances: CPU animation + palettes, then the instanced draw until the GPU is done
+void run_crowd_benchmark(const glm::mat4& viewProjection)
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    const size_t sizes[] = { 100, 1000, 5000 };
+    const int warmupFrames = 10;
+    const int frames = 100;
+    const float deltaTime = 1.0f / 60.0f;
+    const CompressedClip* clip = gAnimations.empty() ? nullptr : &gAnimations[0];
+
+    printf("\n**************************************************\n");
+    printf("Crowd benchmark (%d frames, %u threads)\n\n", frames, gWorkers.GetThreadCount());
+    printf("%10s %14s %14s %14s\n", "Instances", "Update (ms)", "Frame (ms)", "Bones/frame");
+
+    for (size_t size : sizes)
+    {
+        Crowd crowd;
+        if (!crowd.Create(gSkeleton.desc, clip, size, CROWD_SPACING, gVBO, gEBO, set_model_vertex_attributes, get_vertex_defines(), gShaderLibrary)) {
+            std::cerr << "Failed to create crowd of " << size << " instances\n";
+            return;
+        }
+
+        double updateMs = 0.0, frameMs = 0.0;
+        for (int frame = 0; frame < warmupFrames + frames; frame++)
+        {
+            auto t0 = Clock::now();
+            crowd.Update(deltaTime, &gWorkers);
+            auto t1 = Clock::now();
+
+            FrameConstants constants;
+            constants.viewProjection = viewProjection;
+            gFrameConstants.BeginFrame(constants);
+
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            crowd.Submit(gRenderQueue, gIndexCount);
+            gRenderQueue.Execute(gFrameConstants);
+            glFinish();
+            auto t2 = Clock::now();
+
+            crowd.EndFrame();
+            gFrameConstants.EndFrame();
+
+            if (frame < warmupFrames)
+                continue;
+            updateMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            frameMs += std::chrono::duration<double, std::milli>(t2 - t0).count();
+        }
+
+        printf("%10zu %14.3f %14.3f %14zu\n", size, updateMs / frames, frameMs / frames, size * gSkeleton.desc.bones.size());
+        crowd.Destroy();
+    }
+    printf("\n");
+}
+
+// CPU-cost per draw of the render-queue (submit, sort, execute) with 1k/10k/100k draws spread over the built programs and
+// 64 empty VAOs, each draw with its own model-matrix. Executed with the rasterizer off, the GPU-work is waited for outside the timing
+void run_render_queue_benchmark()
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    std::vector<const Shader*> shaders;
+    for (const Shader* shader : { weightShader, debugLineShader, skinningShader, passthroughShader })
+        if (shader && shader->IsLinked())
+            shaders.push_back(shader);
+    if (shaders.empty()) {
+        std::cerr << "No built shader for the render-queue benchmark\n";
+        return;
+    }
+
+    // Own draw-slots, 100k of them would stay allocated in gFrameConstants
+    FrameConstantBuffer constants;
+    if (!constants.Create()) {
+        std::cerr << "Failed to create frame-constants for the render-queue benchmark\n";
+        return;
+    }
+
+    // Non-indexed draws without attributes, any VAO works
+    const int numVAOs = 64;
+    GLuint vaos[numVAOs] = {};
+    glGenVertexArrays(numVAOs, vaos);
+
+    const int repeats = 20;
+    const size_t sizes[] = { 1000, 10000, 100000 };
+
+    printf("\n**************************************************\n");
+    printf("Render-queue, %zu programs\n\n", shaders.size());
+    printf("%10s %14s %14s %14s %14s\n", "Draws", "Submit (ms)", "Sort (ms)", "Execute (ms)", "ns/draw");
+
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    RenderQueue queue;
+    for (size_t size : sizes)
+    {
+        double submitMs = 0.0, sortMs = 0.0, executeMs = 0.0;
+        for (int repeat = 0; repeat < repeats; repeat++)
+        {
+            // Grown before the timing, a real frame only pays for that once
+            constants.BeginFrame(FrameConstants());
+            constants.ReserveDraws(size);
+
+            // Same pseudo-random draws every repeat (xorshift)
+            uint32_t state = 2463534242u;
+            auto t0 = Clock::now();
+            for (size_t i = 0; i < size; i++)
+            {
+                state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+
+                DrawCommand command;
+                command.shader = shaders[state % shaders.size()];
+                command.vao = vaos[(state >> 8) % numVAOs];
+                command.primitive = GL_POINTS;
+                command.indexed = false;
+                command.count = 1;
+                command.model[3] = glm::vec4((float)i, 0.0f, 0.0f, 1.0f);
+                queue.Submit((RenderPass)((state >> 16) % NUM_RENDER_PASSES), command, (float)(state >> 20));
+            }
+            auto t1 = Clock::now();
+            queue.Sort();
+            auto t2 = Clock::now();
+            queue.Execute(constants);
+            auto t3 = Clock::now();
+
+            glFinish();
+            constants.EndFrame();
+
+            submitMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            sortMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+            executeMs += std::chrono::duration<double, std::milli>(t3 - t2).count();
+        }
+
+        submitMs /= repeats;
+        sortMs /= repeats;
+        executeMs /= repeats;
+        printf("%10zu %14.3f %14.3f %14.3f %14.1f\n", size, submitMs, sortMs, executeMs, (submitMs + sortMs + executeMs) * 1e6 / size);
+    }
+    printf("\n");
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    BindVertexArray(0);
+    glDeleteVertexArrays(numVAOs, vaos);
+    constants.Destroy();
+}
+
+// Matrix (LBS) vs dual-quaternion (DQS) skinning of the loaded model in its current pose: bytes per bone, palette-upload
+// per frame, CPU time to fill the palette, GPU time of the vertex-shader and the largest rig each layout fits in one block/buffer
+void run_dual_quat_benchmark()
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    const int warmupFrames = 10;
+    const int frames = 100;
+    const int drawsPerFrame = 20;
+    const SkeletonPose& pose = gSkeleton.pose;
+    size_t numBones = pose.Size();
+
+    // Palette straight from the global poses, ComputePosePalette would clear the dirty-flags the real palette still needs
+    AlignedVector<Affine3x4> source(numBones);
+    for (size_t i = 0; i < numBones; i++)
+        source[i] = AffineMul(pose.globalPoses[i], pose.offsetMatrices[i]);
+
+    GLuint query = 0;
+    glGenQueries(1, &query);
+
+    printf("\n**************************************************\n");
+    printf("Skinning benchmark LBS vs DQS (%zu bones, %d vertices, %d frames x %d draws)\n\n",
+        numBones, gVertexCount, frames, drawsPerFrame);
+    printf("%5s %16s %11s %12s %14s %14s %10s %10s\n",
+        "Mode", "Palette", "Bytes/bone", "Upload (KB)", "Palette (ms)", "Vertex (ms)", "Max UBO", "Max TBO");
+
+    for (int dualQuats = 0; dualQuats < 2; dualQuats++)
+    {
+        BonePaletteBuffer buffer;
+        if (!buffer.Create(numBones, BONE_PALETTE_TEXTURE_UNIT, false, dualQuats == 1)) {
+            std::cerr << "Failed to create bone-palette for the skinning benchmark\n";
+            break;
+        }
+
+        // Only compiled when the benchmark runs, the permutation stays in the library afterwards
+        Shader& shader = *gShaderLibrary.Get("skinning.vs", "skinning.fs", buffer.GetShaderDefines() + get_vertex_defines());
+        buffer.BindToShader(shader);
+        shader.Use();
+
+        // Nothing is rasterized, the query only measures the vertex-work
+        glEnable(GL_RASTERIZER_DISCARD);
+        BindVertexArray(gVAO);
+
+        double paletteMs = 0.0, vertexMs = 0.0;
+        for (int frame = 0; frame < warmupFrames + frames; frame++)
+        {
+            auto t0 = Clock::now();
+            if (dualQuats) {
+                DualQuat* out = buffer.BeginFrameDualQuat();
+                if (out)
+                    ConvertPaletteToDualQuat(source.data(), out, numBones, &gWorkers);
+            }
+            else {
+                Affine3x4* out = buffer.BeginFrame();
+                if (out)
+                    std::copy(source.begin(), source.end(), out);
+            }
+            auto t1 = Clock::now();
+            buffer.EndWrite();
+
+            // Identity camera and model, nothing reaches the screen anyway
+            gFrameConstants.BeginFrame(FrameConstants());
+            gFrameConstants.SetDraw(glm::mat4(1.0f));
+
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int draw = 0; draw < drawsPerFrame; draw++)
+                glDrawElements(GL_TRIANGLES, gIndexCount, GL_UNSIGNED_INT, 0);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            // Waits for the GPU
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsedNs);
+            buffer.EndFrame();
+            gFrameConstants.EndFrame();
+
+            if (frame < warmupFrames)
+                continue;
+            paletteMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            vertexMs += elapsedNs / 1.0e6;
+        }
+
+        BindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        size_t boneSize = buffer.GetBoneSize();
+        printf("%5s %16s %11zu %12.2f %14.4f %14.4f %10zu %10zu\n",
+            dualQuats ? "DQS" : "LBS", buffer.UsesTextureBuffer() ? "texture-buffer" : "uniform-block",
+            boneSize, numBones * boneSize / 1024.0, paletteMs / frames, vertexMs / (frames * drawsPerFrame),
+            BonePaletteBuffer::GetMaxUniformBlockBones(boneSize), BonePaletteBuffer::GetMaxTextureBufferBones(boneSize));
+
+        buffer.Destroy();
+    }
+
+    glDeleteQueries(1, &query);
+
+    // DQS can't represent scale, those bones are only approximated
+    size_t nonRigid = CountNonRigidBones(source.data(), numBones);
+    if (nonRigid > 0)
+        printf("\n%zu of %zu bones have scale or shear in this pose, DQS keeps only their rotation + translation\n", nonRigid, numBones);
+    printf("\n");
+}
+
+// Upload and draw debugging-bones, use DebugVertex
+void create_bone_line_buffers()
+{
+    glGenVertexArrays(1, &gBoneVAO);
+    glGenBuffers(1, &gBoneVBO);
+
+    BindVertexArray(gBoneVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, gBoneVBO);
+    gBoneVBOCapacity = 256;
+    glBufferData(GL_ARRAY_BUFFER, sizeof(DebugVertex) * gBoneVBOCapacity, nullptr, GL_DYNAMIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)0);
+    glEnableVertexAttribArray(0);
+    BindVertexArray(0);
+}
+
+// Requests the shaders (and creates the buffers) of every enabled pipeline, already requested ones are returned as they are.
+// Nothing is compiled until the next build
+void request_pipeline_resources()
+{
+    if (boneLinesMode && !gBoneVAO)
+        create_bone_line_buffers();
+
+    // CPU skinning creates no bone-palette, only programs that don't declare one are requested then
+    bool gpuPalette = !gCpuSkinning;
 
-    // ----------------------------------------------------
-    // Create and compile shaders
-    // ----------------------------------------------------
-    
     if (weightVisMode) {
-        weightShader = new Shader(
+        // Never reads the palette: pre-skinned positions/normals are plain floats, only the bone-ids still come from gVBO then
+        weightShader = gShaderLibrary.Request(
             "weight_visualization.vs",
-            "weight_visualization.fs"
+            "weight_visualization.fs",
+            gSkinnedVAO ? (gPackedVertices.count > 0 ? "#define PACKED_BONE_IDS\n" : "") : get_packing_defines()
         );
     }
 
     if (boneLinesMode) {
-        debugLineShader = new Shader(
+        debugLineShader = gShaderLibrary.Request(
             "debugLine_Shader.vs",
             "debugLine_Shader.fs"
         );
     }
 
-    if (normalSkinning || boneLinesMode) {
-        skinningShader = new Shader(
+    // Palette-declaration depends on the rig (uniform-block or texture-buffer), so this needs the loaded model
+    if ((normalSkinning || boneLinesMode) && gpuPalette) {
+        // Batches have their own 4-influence vertices, otherwise gVBO is drawn as it is
+        skinningShader = gShaderLibrary.Request(
             "skinning.vs",
+            "skinning.fs",
+            get_palette_defines() + (gPartitionedMesh.batches.empty() ? get_vertex_defines() : "")
+        );
+    }
+
+    // Pre-skinned vertices are drawn with the same fragment-shader
+    if ((gSkinningPrepass || gCpuSkinning) && normalSkinning) {
+        passthroughShader = gShaderLibrary.Request(
+            "passthrough.vs",
             "skinning.fs"
         );
     }
 
+    // One variant per influence-bucket, only when the model was bucketed
+    if (normalSkinning && gpuPalette && gInfluenceMesh.buckets[0].influences > 0) {
+        for (int b = 0; b < NUM_INFLUENCE_BUCKETS; b++) {
+            bucketShaders[b] = gShaderLibrary.Request(
+                "skinning.vs",
+                "skinning.fs",
+                ShaderDefines(get_palette_defines()).Set("NUM_INFLUENCES", b + 1)
+            );
+        }
+    }
+}
+
+// Connects the skinning programs to gBonePalette after a build, cheap to repeat for programs that are already connected
+void bind_pipeline_shaders()
+{
+    // Every skinning program reads the bone-palette from the same binding
+    if (skinningShader) {
+        gBonePalette.BindToShader(*skinningShader);
+        gBatchBonesLocation = skinningShader->GetUniformLocation("uBones");
+    }
+    for (Shader* bucketShader : bucketShaders) {
+        if (bucketShader)
+            gBonePalette.BindToShader(*bucketShader);
+    }
+
+    // Made before the other programs (with the model), but unloaded and rebuilt with them
+    if (gSkinningFeedback.GetProgram())
+        gBonePalette.BindToShader(*gSkinningFeedback.GetProgram());
+}
+
+// Switches the pipelines whose key was pressed, the shaders of a pipeline are built the first time it is turned on
+void setup_pipelines(unsigned int toggles)
+{
+    if (toggles & 1)
+        weightVisMode = !weightVisMode;
+    if (toggles & 2)
+        boneLinesMode = !boneLinesMode;
+    if (toggles & 4)
+        normalSkinning = !normalSkinning;
+
+    request_pipeline_resources();
+    gShaderLibrary.Build();
+    bind_pipeline_shaders();
+
+    printf("Pipelines: weights %s, bone-lines %s, skinning %s\n",
+        weightVisMode ? "on" : "off", boneLinesMode ? "on" : "off", normalSkinning ? "on" : "off");
+}
+
+// Builds every requested shader in one go (parallel compile + program-binary cache).
+// With gReportShaderCache they are built cold (compiled from source) first, then thrown away and loaded warm from the cache
+void build_shaders()
+{
+    if (!gReportShaderCache)
+    {
+        ShaderBuildStats stats = gShaderLibrary.Build();
+        printf("Shaders: %zu programs in %.2f ms (%zu from cache, %zu compiled, %zu failed)\n",
+            stats.programs, stats.ms, stats.fromCache, stats.compiled, stats.failed);
+        return;
+    }
+
+    ShaderBuildStats cold = gShaderLibrary.Build(false);
+    gShaderLibrary.Unload();
+    ShaderBuildStats warm = gShaderLibrary.Build(true);
+
+    printf("\n**************************************************\n");
+    printf("Shader startup, cold vs warm program-cache\n\n");
+    printf("Binaries supported: %s\n", ShaderLibrary::SupportsBinaries() ? "yes" : "no");
+    printf("Parallel compile:   %s\n\n", (GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile) ? "yes" : "no");
+    printf("%-8s %10s %12s %10s %8s %12s\n", "", "Programs", "From cache", "Compiled", "Failed", "Time (ms)");
+    printf("%-8s %10zu %12zu %10zu %8zu %12.2f\n", "Cold", cold.programs, cold.fromCache, cold.compiled, cold.failed, cold.ms);
+    printf("%-8s %10zu %12zu %10zu %8zu %12.2f\n", "Warm", warm.programs, warm.fromCache, warm.compiled, warm.failed, warm.ms);
+    printf("Speedup: %.1fx\n\n", warm.ms > 0.0 ? cold.ms / warm.ms : 0.0);
+}
+
+// ------------------------- MAIN -------------------------
+int main()
+{
+
     // ----------------------------------------------------
-    // Load model using Assimp and build GPU buffers
+    // Model to load and optional reports (no GL needed)
     // ----------------------------------------------------
     
     // Change this to load any model in the Models folder
     std::string modelName = "boblampclean.md5mesh";
 
+    // Bone-influences per vertex for this model: 4 is faster, 8 keeps more of rigs like Vanguard (needs 7)
+    gBonesPerVertex = 4;
+    round_bones_per_vertex();
+
+    // Skinning for this model: matrices (false) or dual quaternions (true, better for rigs with twisting joints)
+    gDualQuatSkinning = false;
+
     /*
         Examples:
-        * Vanguard.dae          // RIGGED (many bones, Doom 3 test model increase max-boness to 7), super large
+        * Vanguard.dae          // RIGGED (many bones, Doom 3 test model, needs 7 bones per vertex: set gBonesPerVertex to 8), super large
         * boblampclean.md5mesh  // RIGGED (best for testing, may need to be rotated to be in view)
         * spider.obj            // NOT RIGGED
         * dragon.obj            // NOT RIGGED, ONE MESH
@@ -769,6 +2177,93 @@ int main()
         WARNING: You probably have to press Q to see most models since I tested on a large one.
     */
 
+    // Optional report of how much the model-cache saves, rebakes every cache in Models
+    if (gReportModelCache)
+        report_model_cache_speedup();
+
+    // Optional report of the packed vertex-layouts, imports every model in Models
+    if (gReportVertexPacking)
+        report_vertex_packing();
+
+    // Optional benchmark of the hierarchy- and palette-passes on synthetic skeletons
+    if (gRunPoseBenchmark)
+        BenchmarkPoseKernels();
+
+    // Optional benchmark of the pose-blender
+    if (gRunBlendBenchmark)
+        BenchmarkPoseBlending();
+
+    // No window at all, animation + skinning on the CPU only
+    if (gHeadless)
+        return run_headless(modelName);
+
+    // ----------------------------------------------------
+    // Initialize GLFW (make veiwing-window)
+    // ----------------------------------------------------
+    if (!glfwInit()) {
+        std::cerr << "Failed to init GLFW\n";
+        return -1;
+    }
+
+    // Request an OpenGL 3.3 core profile context before creating a window
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    // Create the application window
+    gWindow = glfwCreateWindow(1280, 720, "Model Viewer", nullptr, nullptr);
+    if (!gWindow) {
+        glfwTerminate();
+        return -1;
+    }
+
+    // Make the OpenGL context current for this window
+    glfwMakeContextCurrent(gWindow);
+
+    // ----------------------------------------------------
+    // Initialize GLEW (loads OpenGL function pointers)
+    // ----------------------------------------------------
+    
+    // Start GLEW
+    glewExperimental = GL_TRUE;
+    GLenum glewErr = glewInit();
+    if (glewErr != GLEW_OK) {
+        std::cerr << "GLEW error: " << glewGetErrorString(glewErr) << std::endl;
+        return -1;
+    }
+
+    // Clear the spurious OpenGL error caused by GLEW + core profile
+    glGetError();
+
+    // Timer-queries for the per-pass GPU times
+    if (gReportGpuTimes)
+        gGpuTimers.Create();
+
+    // Per-frame/per-draw constants of all shaders, also used by the benchmarks before the render-loop
+    gFrameConstants.Create();
+
+    // Print some OpenGL info to check OpenGL works
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+    std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
+
+    // ----------------------------------------------------
+    // Global OpenGL settings
+    // ----------------------------------------------------
+
+    // Set the background color (dark bluish gray)
+    glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+
+    // Enable depth testing so triangles are occluded
+    glEnable(GL_DEPTH_TEST);
+
+    // Disable face culling temporarily to avoid winding issues, turned on later again
+    glDisable(GL_CULL_FACE);
+
+
+    // ----------------------------------------------------
+    // Load model using Assimp and build GPU buffers
+    // ----------------------------------------------------
+
     // Load model, parse meshes + bones, build VBO/VAO/EBO
     if (!loadModel(modelName)) {
         std::cerr << "Failed to load model.\n";
@@ -777,13 +2272,49 @@ int main()
 
     // Check skeleton (parent '-1' means parent is root)
     printf("\nSkeleton summary:\n");
-    printf("Total bones: %zu\n", gSkeleton.bones.size());
-    for (size_t i = 0; i < gSkeleton.bones.size(); i++)
+    printf("Total bones: %zu\n", gSkeleton.desc.bones.size());
+    for (size_t i = 0; i < gSkeleton.desc.bones.size(); i++)
     {
         printf("Bone %zu: '%s' parent %d\n",
             i,
-            gSkeleton.bones[i].name.c_str(),
-            gSkeleton.bones[i].parentIndex);
+            gSkeleton.desc.bones[i].name.c_str(),
+            gSkeleton.desc.bones[i].parentIndex);
+    }
+
+    // Optional benchmark of the CPU skinning, on the loaded model
+    if (gRunSkinningBenchmark)
+        run_skinning_benchmark(modelName);
+
+    // ----------------------------------------------------
+    // Create and compile shaders
+    // ----------------------------------------------------
+
+    // Only requested here, all of them are compiled (or loaded from the cache) together by build_shaders()
+    request_pipeline_resources();
+    build_shaders();
+    bind_pipeline_shaders();
+
+    // Optional benchmark of the render-queue, on the programs just built
+    if (gRunRenderQueueBenchmark)
+        run_render_queue_benchmark();
+
+    // Skinning-modes compared on the loaded model (uses its own palette-buffers, gBonePalette is rebound every frame)
+    if (gRunDualQuatBenchmark && gSkeleton.pose.Size() > 0)
+        run_dual_quat_benchmark();
+
+    // Crowd of the loaded model, uses the mesh in gVBO/gEBO
+    if (gRunCrowdBenchmark || gDrawCrowd) {
+        int width, height;
+        glfwGetFramebufferSize(gWindow, &width, &height);
+        glm::mat4 viewProjection =
+            input.GetCamera().GetProjectionMatrix((float)width / (float)height) *
+            input.GetCamera().GetViewMatrix();
+
+        if (gRunCrowdBenchmark)
+            run_crowd_benchmark(viewProjection);
+
+        if (gDrawCrowd)
+            gCrowd.Create(gSkeleton.desc, gAnimations.empty() ? nullptr : &gAnimations[0], CROWD_SIZE, CROWD_SPACING, gVBO, gEBO, set_model_vertex_attributes, get_vertex_defines(), gShaderLibrary);
     }
 
     // ----------------------------------------------------
@@ -808,10 +2339,17 @@ int main()
         // Update input controller based on input
         input.Update(deltaTime);
 
+        // Pipelines switched with 1/2/3
+        if (unsigned int toggles = input.GetPipelineToggles())
+            setup_pipelines(toggles);
+
         // ------------------------------------------------
         // Update skeleton pose (animation / physics step)
         // ------------------------------------------------
         
+        // Animation first, physics may override it
+        updateSkeletonAnimation(deltaTime, currentTime);
+
         // Currently streches model in funny way
         if (gUseRagdoll)
         {
@@ -833,23 +2371,26 @@ int main()
 
         // TESTING - Makes model bend over, MUST USE SKINNING SHADER or Lines, NOT UseRagdoll
         // Comment out for a static model
-        if ((skinningShader || boneLinesMode) && gSkeleton.bones.size() > 1)
+        if ((skinningShader || boneLinesMode) && gSkeleton.pose.Size() > 1 && !gAnimationPlayer.IsPlaying())
         {
-            gSkeleton.bones[1].localPose =
-                glm::rotate(glm::mat4(1.0f),
-                    sinf((float)glfwGetTime()) * 0.5f,
-                    glm::vec3(0, 0, 1));
+            gSkeleton.pose.SetLocalPose(1, glm::vec3(0.0f),
+                glm::angleAxis(sinf((float)glfwGetTime()) * 0.5f,
+                    glm::vec3(0, 0, 1)));
         }
 
-        // Rebuild transforms
-        computeGlobalBoneTransforms(gSkeleton);
-        buildFinalBoneMatrices(gSkeleton, gFinalBoneMatrices);
-        if (weightVisMode)
-        {
-            uploadBoneMatrices(weightShader, gFinalBoneMatrices); // Use weight-shader
-        }
-        else {
-            uploadBoneMatrices(skinningShader, gFinalBoneMatrices); // Use skinning-shader
+        // Rebuild transforms, only for bones that changed (and their children), straight into the bone-palette buffer
+        PoseUpdateStats poseStats = updateBonePalette(gSkeleton);
+
+        if (gReportBoneUpdates)
+            report_bone_updates(poseStats.bonesEvaluated, poseStats.paletteWritten, currentTime);
+
+        // Skinned vertices for all passes, when not skinned in every pass' vertex-shader
+        if (gCpuSkinning)
+            skinModelOnCpu();
+        else if (weightVisMode || normalSkinning) {
+            gGpuTimers.Begin("skinning");
+            gSkinningFeedback.Run(gVAO);
+            gGpuTimers.End();
         }
 
 
@@ -877,127 +2418,71 @@ int main()
         modelMatrix = input.GetModelRotationMatrix() * modelMatrix;
 
         // The camera matrices MUST come from the camera object.
-        glm::mat4 MVP =
-            input.GetCamera().GetProjectionMatrix(aspect) *
-            input.GetCamera().GetViewMatrix() *
-            modelMatrix;
+        glm::mat4 view = input.GetCamera().GetViewMatrix();
+
+        // Written once for all passes (FrameConstants block), every queued draw carries its own model-matrix (DrawConstants)
+        FrameConstants frameConstants;
+        frameConstants.viewProjection = input.GetCamera().GetProjectionMatrix(aspect) * view;
+        frameConstants.lightDir = glm::vec4(glm::normalize(glm::vec3(7.5f, 10.0f, 1.5f)), 0.0f);   // World-space light direction
+        frameConstants.viewPos = glm::vec4(glm::vec3(glm::inverse(view)[3]), 1.0f);                 // Camera position
+        frameConstants.selectedBone = input.GetCurrentBoneIndex();                                  // Used in fragment shader for weight visualization
+        frameConstants.time = currentTime;
+        gFrameConstants.BeginFrame(frameConstants);
 
         // ------------------------------------------------
-        // Rendering logic based on mode
+        // Rendering - every enabled pipeline submits its draws
         // ------------------------------------------------
-        
-        // If "fake physics" is used, may be rendered using debugLine and/or skinning shader
-        if (gUseRagdoll) {
-            
-            // ------------------------------------------------
-            // Rendering - Bones as lines
-            // ------------------------------------------------
 
-            if (boneLinesMode) {
-                glDisable(GL_DEPTH_TEST);
+        // Near draws first, all passes draw the same dragged model
+        float modelDepth = glm::length(glm::vec3(frameConstants.viewPos) - glm::vec3(modelMatrix[3]));
 
-                std::vector<DebugVertex> boneDebugVerts;
-                buildBoneDebugLines(gSkeleton, boneDebugVerts);
+        // Bones as lines, first pass and without depth-test
+        if (boneLinesMode)
+            submitBoneLines(modelMatrix);
 
-                glBindBuffer(GL_ARRAY_BUFFER, gBoneVBO);
-                glBufferSubData(GL_ARRAY_BUFFER, 0, boneDebugVerts.size() * sizeof(DebugVertex), boneDebugVerts.data());
+        // Weights, not with "fake physics" (only lines and/or the skinning shader then)
+        if (weightVisMode && !gUseRagdoll)
+            submitWeights(modelMatrix, modelDepth);
 
-                debugLineShader->Use();
-                debugLineShader->SetMat4("MVP", MVP);
+        // Normal skinning shader
+        if (normalSkinning)
+            submitSkinnedModel(modelMatrix, modelDepth);
 
-                glBindVertexArray(gBoneVAO);
-                glDrawArrays(GL_LINES, 0, (GLsizei)boneDebugVerts.size());
-                glBindVertexArray(0);
-
-                glEnable(GL_DEPTH_TEST);
-            }
-
-            // ------------------------------------------------
-            // Rendering - Normal shader
-            // ------------------------------------------------
-            if (normalSkinning) {
-                skinningShader->Use();
-                skinningShader->SetMat4("MVP", MVP);
-
-                glBindVertexArray(gVAO);
-                glDrawElements(GL_TRIANGLES, (GLsizei)gpuIndices.size(), GL_UNSIGNED_INT, 0);
-                glBindVertexArray(0);
-            }
+        // Crowd (own animation, not dragged)
+        if (gCrowd.GetInstanceCount() > 0) {
+            gCrowd.Update(deltaTime, &gWorkers);
+            gCrowd.Submit(gRenderQueue, gIndexCount);
         }
-        else {  // No "physics"
-            
-            // ------------------------------------------------
-            // Rendering - Bones as lines
-            // ------------------------------------------------
-            if (boneLinesMode) {
-                glDisable(GL_DEPTH_TEST);
-
-                std::vector<DebugVertex> boneDebugVerts;
-                buildBoneDebugLines(gSkeleton, boneDebugVerts);
-
-                glBindBuffer(GL_ARRAY_BUFFER, gBoneVBO);
-                glBufferSubData(GL_ARRAY_BUFFER, 0, boneDebugVerts.size() * sizeof(DebugVertex), boneDebugVerts.data());
-
-                debugLineShader->Use();
-                debugLineShader->SetMat4("MVP", MVP);
-
-                glBindVertexArray(gBoneVAO);
-                glDrawArrays(GL_LINES, 0, (GLsizei)boneDebugVerts.size());
-                glBindVertexArray(0);
-
-                glEnable(GL_DEPTH_TEST);
-            }
-            
-            // ------------------------------------------------
-            // Rendering - Weights
-            // ------------------------------------------------
-            if (weightVisMode) {
 
-                // Activate the shader program
-                weightShader->Use();
-
-                // Upload MVP matrix to the shader
-                weightShader->SetMat4("MVP", MVP);
-
-                // World-space light direction
-                weightShader->SetVec3("uLightDir", glm::normalize(glm::vec3(7.5f, 10.0f, 1.5f)));
-
-                // Camera position
-                weightShader->SetVec3("uViewPos", glm::vec3(0, 2, 5));
-
-                // Upload currently selected bone index
-                // Used in fragment shader for weight visualization
-                weightShader->SetInt("uSelectedBone", input.GetCurrentBoneIndex());
-
-                // Bind the VAO containing vertex + index buffers
-                glBindVertexArray(gVAO);
-
-                // Draw the entire mesh using indexed triangles
-                glDrawElements(GL_TRIANGLES, (GLsizei)gpuIndices.size(), GL_UNSIGNED_INT, 0);
-
-                // Unbind VAO (just for clean code)
-                glBindVertexArray(0);
+        // Sorted by pass, program and VAO, each pass is timed as a whole
+        gRenderQueue.Execute(gFrameConstants, &gGpuTimers);
+        
+        // GPU may read this frame's bone-palette copy (and skinned vertices) until here
+        gBonePalette.EndFrame();
+        gSkinnedStream.EndFrame();
+        gCrowd.EndFrame();
+        gFrameConstants.EndFrame();
 
-            }
+        gGpuTimers.EndFrame();
+        if (gReportGpuTimes)
+            gGpuTimers.Report(currentTime);
 
-            // ------------------------------------------------
-            // Rendering - Normal Skinning Shader
-            // ------------------------------------------------
-            if (normalSkinning) {
-                skinningShader->Use();
-                skinningShader->SetMat4("MVP", MVP);
+        EndGLCallFrame();
+        if (gReportGLCalls)
+            ReportGLCalls(currentTime);
 
-                glBindVertexArray(gVAO);
-                glDrawElements(GL_TRIANGLES, (GLsizei)gpuIndices.size(), GL_UNSIGNED_INT, 0);
-                glBindVertexArray(0);
-            }
-        }
-        
         // Present rendered image to the screen
         glfwSwapBuffers(gWindow);
     }
 
     // Cleanup and exit
+    gBonePalette.Destroy();
+    gSkinnedStream.Destroy();
+    gSkinningFeedback.Destroy();
+    gCrowd.Destroy();
+    gGpuTimers.Destroy();
+    gFrameConstants.Destroy();
+    gShaderLibrary.Unload();
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/*
+* 3x4 affine transform (rotation/scale + translation), the last
+* row of a 4x4 bone-matrix is always (0, 0, 0, 1) so it is never stored.
+*
+* Stored as 3 rows: rows[i] = (m[0][i], m[1][i], m[2][i], m[3][i]) in glm terms.
+* That is exactly what GLSL expects for a mat3x4 uploaded without transpose,
+* so bone-palettes can be sent to the shaders as is (48 instead of 64 bytes per bone).
+*/
+
+struct alignas(16) Affine3x4
+{
+    glm::vec4 rows[3] = {
+        glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+        glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+        glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)
+    };
+
+    glm::vec3 GetTranslation() const
+    {
+        return glm::vec3(rows[0].w, rows[1].w, rows[2].w);
+    }
+};
+
+// Drops the last row of a (affine) glm-matrix
+inline Affine3x4 AffineFromMat4(const glm::mat4& m)
+{
+    Affine3x4 a;
+    for (int r = 0; r < 3; r++)
+        a.rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    return a;
+}
+
+// Back to a glm-matrix, e.g. for debugging or physics
+inline glm::mat4 AffineToMat4(const Affine3x4& a)
+{
+    glm::mat4 m(1.0f);
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 4; c++)
+            m[c][r] = a.rows[r][c];
+    return m;
+}
+
+// T * R * S in affine form
+inline Affine3x4 AffineFromTRS(const glm::vec3& t, const glm::quat& q, const glm::vec3& s)
+{
+    // Rotation-matrix from unit quaternion
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    Affine3x4 a;
+    a.rows[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * s.x, (2.0f * (xy - wz)) * s.y, (2.0f * (xz + wy)) * s.z, t.x);
+    a.rows[1] = glm::vec4((2.0f * (xy + wz)) * s.x, (1.0f - 2.0f * (xx + zz)) * s.y, (2.0f * (yz - wx)) * s.z, t.y);
+    a.rows[2] = glm::vec4((2.0f * (xz - wy)) * s.x, (2.0f * (yz + wx)) * s.y, (1.0f - 2.0f * (xx + yy)) * s.z, t.z);
+    return a;
+}
+
+// a * b (as if both had the row (0, 0, 0, 1) at the bottom)
+inline Affine3x4 AffineMul(const Affine3x4& a, const Affine3x4& b)
+{
+    Affine3x4 out;
+    for (int r = 0; r < 3; r++)
+    {
+        out.rows[r] = a.rows[r].x * b.rows[0] + a.rows[r].y * b.rows[1] + a.rows[r].z * b.rows[2];
+        out.rows[r].w += a.rows[r].w;
+    }
+    return out;
+}
+
+// Splits an affine glm-matrix into translation, rotation and (possibly negative) scale
+inline void DecomposeTRS(const glm::mat4& m, glm::vec3& outT, glm::quat& outR, glm::vec3& outS)
+{
+    outT = glm::vec3(m[3]);
+
+    glm::mat3 basis(m);
+    outS = glm::vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+
+    // Mirrored basis, put the flip in one scale-axis so the rest is a proper rotation
+    if (glm::determinant(basis) < 0.0f)
+        outS.x = -outS.x;
+
+    for (int c = 0; c < 3; c++)
+        if (outS[c] != 0.0f)
+            basis[c] /= outS[c];
+
+    outR = glm::normalize(glm::quat_cast(basis));
+}
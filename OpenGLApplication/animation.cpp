@@ -0,0 +1,306 @@
+#include "animation.h"
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+/*
+* Skeletal animation clips imported from aiScene::mAnimations.
+*
+* Sampling is linear for translation/scale and a normalized lerp
+* (shortest way) for rotations, cheaper than slerp and keys are
+* close enough for the difference to not be visible. Compressed clips
+* only decode the 2 keys around the sample time.
+*/
+
+// ------------------------- IMPORT -------------------------
+
+void ImportAnimations(const aiScene* pScene, const SkeletonDesc& skeleton, std::vector<AnimationClip>& outClips)
+{
+    outClips.clear();
+    if (!pScene)
+        return;
+
+    outClips.reserve(pScene->mNumAnimations);
+
+    for (unsigned int a = 0; a < pScene->mNumAnimations; a++)
+    {
+        const aiAnimation* pAnim = pScene->mAnimations[a];
+
+        // Key-times are in ticks, 0 means the file didn't say
+        double ticksPerSecond = pAnim->mTicksPerSecond != 0.0 ? pAnim->mTicksPerSecond : 25.0;
+        float toSeconds = (float)(1.0 / ticksPerSecond);
+
+        AnimationClip clip;
+        clip.name = pAnim->mName.C_Str();
+        clip.duration = (float)pAnim->mDuration * toSeconds;
+
+        // Map channels to bones, sorted by bone so the pose is written in order
+        std::vector<std::pair<int, const aiNodeAnim*>> mapped;
+        for (unsigned int c = 0; c < pAnim->mNumChannels; c++)
+        {
+            const aiNodeAnim* pChannel = pAnim->mChannels[c];
+            auto it = skeleton.boneNameToIndex.find(pChannel->mNodeName.C_Str());
+            if (it != skeleton.boneNameToIndex.end())
+                mapped.push_back({ it->second, pChannel });
+        }
+        std::sort(mapped.begin(), mapped.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        // Copy keys into the contiguous arrays
+        for (const auto& [boneIndex, pChannel] : mapped)
+        {
+            AnimationChannel channel = {};
+            channel.boneIndex = boneIndex;
+
+            channel.firstPosKey = (uint32_t)clip.posTimes.size();
+            channel.numPosKeys = pChannel->mNumPositionKeys;
+            for (unsigned int k = 0; k < pChannel->mNumPositionKeys; k++)
+            {
+                const aiVectorKey& key = pChannel->mPositionKeys[k];
+                clip.posTimes.push_back((float)key.mTime * toSeconds);
+                clip.posValues.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+
+            channel.firstRotKey = (uint32_t)clip.rotTimes.size();
+            channel.numRotKeys = pChannel->mNumRotationKeys;
+            for (unsigned int k = 0; k < pChannel->mNumRotationKeys; k++)
+            {
+                const aiQuatKey& key = pChannel->mRotationKeys[k];
+                clip.rotTimes.push_back((float)key.mTime * toSeconds);
+                clip.rotValues.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+
+            channel.firstScaleKey = (uint32_t)clip.scaleTimes.size();
+            channel.numScaleKeys = pChannel->mNumScalingKeys;
+            for (unsigned int k = 0; k < pChannel->mNumScalingKeys; k++)
+            {
+                const aiVectorKey& key = pChannel->mScalingKeys[k];
+                clip.scaleTimes.push_back((float)key.mTime * toSeconds);
+                clip.scaleValues.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+
+            clip.channels.push_back(channel);
+        }
+
+        printf("Animation '%s': %.2f s, %zu of %u channels are bones\n",
+            clip.name.c_str(), clip.duration, clip.channels.size(), pAnim->mNumChannels);
+
+        outClips.push_back(std::move(clip));
+    }
+}
+
+// ------------------------- SAMPLING -------------------------
+
+// Finds k so that times[k] <= t < times[k + 1], starting at cursor. Walks forward from the cursor
+// (normally 0-1 steps per frame), only searches from scratch when time went backwards (loop/rewind)
+static uint32_t FindKey(const float* times, uint32_t count, float t, uint32_t& cursor)
+{
+    if (cursor + 1 >= count || times[cursor] > t)
+    {
+        const float* it = std::upper_bound(times, times + count, t);
+        cursor = (it == times) ? 0 : (uint32_t)(it - times - 1);
+    }
+
+    while (cursor + 2 < count && times[cursor + 1] <= t)
+        cursor++;
+
+    return std::min(cursor, count - 2);
+}
+
+// How far t is between key k and k + 1, clamped to [0, 1]
+static float KeyFactor(const float* times, uint32_t k, float t)
+{
+    float span = times[k + 1] - times[k];
+    if (span <= 0.0f)
+        return 0.0f;
+    return std::clamp((t - times[k]) / span, 0.0f, 1.0f);
+}
+
+static glm::vec3 SampleVec3(const float* times, const glm::vec3* values, uint32_t count, float t, uint32_t& cursor)
+{
+    if (count == 1)
+        return values[0];
+
+    uint32_t k = FindKey(times, count, t, cursor);
+    return glm::mix(values[k], values[k + 1], KeyFactor(times, k, t));
+}
+
+static glm::quat SampleQuat(const float* times, const glm::quat* values, uint32_t count, float t, uint32_t& cursor)
+{
+    if (count == 1)
+        return values[0];
+
+    uint32_t k = FindKey(times, count, t, cursor);
+    return NlerpShortest(values[k], values[k + 1], KeyFactor(times, k, t));
+}
+
+// Same as SampleVec3 but the keys are 16 bits per axis, only the 2 keys used are decoded
+static glm::vec3 SampleRange16(const float* times, const uint16_t* values, uint32_t count, float t, uint32_t& cursor,
+    const glm::vec3& min, const glm::vec3& extent)
+{
+    if (count == 1)
+        return DecodeRange16(values, min, extent);
+
+    uint32_t k = FindKey(times, count, t, cursor);
+    glm::vec3 v0 = DecodeRange16(values + k * 3, min, extent);
+    glm::vec3 v1 = DecodeRange16(values + (k + 1) * 3, min, extent);
+    return glm::mix(v0, v1, KeyFactor(times, k, t));
+}
+
+static glm::quat SampleRotation48(const float* times, const uint16_t* values, uint32_t count, float t, uint32_t& cursor)
+{
+    if (count == 1)
+        return DecodeRotation48(values);
+
+    uint32_t k = FindKey(times, count, t, cursor);
+    return NlerpShortest(DecodeRotation48(values + k * 3), DecodeRotation48(values + (k + 1) * 3), KeyFactor(times, k, t));
+}
+
+// ------------------------- PLAYER -------------------------
+
+void AnimationPlayer::Play(const AnimationClip* newClip, bool shouldLoop)
+{
+    Stop();
+    clip = newClip;
+    loop = shouldLoop;
+    cursors.assign(clip ? clip->channels.size() : 0, ChannelCursor());
+}
+
+void AnimationPlayer::Play(const CompressedClip* newClip, bool shouldLoop)
+{
+    Stop();
+    compressed = newClip;
+    loop = shouldLoop;
+    cursors.assign(compressed ? compressed->channels.size() : 0, ChannelCursor());
+}
+
+void AnimationPlayer::Stop()
+{
+    clip = nullptr;
+    compressed = nullptr;
+    cursors.clear();
+    time = 0.0f;
+}
+
+float AnimationPlayer::Duration() const
+{
+    if (clip) return clip->duration;
+    if (compressed) return compressed->duration;
+    return 0.0f;
+}
+
+void AnimationPlayer::Update(float deltaTime, SkeletonPose& pose)
+{
+    if (!IsPlaying())
+        return;
+
+    Advance(deltaTime);
+    Sample(time, pose);
+}
+
+void AnimationPlayer::Advance(float deltaTime)
+{
+    if (!IsPlaying())
+        return;
+
+    time += deltaTime * speed;
+
+    // Wrap or hold the last frame
+    float duration = Duration();
+    if (duration > 0.0f)
+    {
+        if (loop)
+        {
+            time = std::fmod(time, duration);
+            if (time < 0.0f)
+                time += duration;
+        }
+        else
+            time = std::clamp(time, 0.0f, duration);
+    }
+}
+
+void AnimationPlayer::Sample(float t, SkeletonPose& pose)
+{
+    Sample(t, MakePoseTarget(pose));
+}
+
+void AnimationPlayer::Sample(float t, const LocalPoseTarget& target)
+{
+    if (clip)
+        SampleRaw(t, target);
+    else if (compressed)
+        SampleCompressed(t, target);
+}
+
+void AnimationPlayer::SampleRaw(float t, const LocalPoseTarget& target)
+{
+    for (size_t c = 0; c < clip->channels.size(); c++)
+    {
+        const AnimationChannel& channel = clip->channels[c];
+        ChannelCursor& cursor = cursors[c];
+
+        // Pose may be from another (smaller) skeleton, masked out bones aren't sampled at all
+        size_t bone = (size_t)channel.boneIndex;
+        if (bone >= target.count || (target.mask && target.mask[bone] <= 0.0f))
+            continue;
+
+        // Channels without keys of a kind keep that part of the current local pose
+        glm::vec3 translation = target.translations[bone];
+        glm::quat rotation = target.rotations[bone];
+        glm::vec3 scale = target.scales[bone];
+
+        if (channel.numPosKeys)
+            translation = SampleVec3(&clip->posTimes[channel.firstPosKey], &clip->posValues[channel.firstPosKey],
+                channel.numPosKeys, t, cursor.pos);
+        if (channel.numRotKeys)
+            rotation = SampleQuat(&clip->rotTimes[channel.firstRotKey], &clip->rotValues[channel.firstRotKey],
+                channel.numRotKeys, t, cursor.rot);
+        if (channel.numScaleKeys)
+            scale = SampleVec3(&clip->scaleTimes[channel.firstScaleKey], &clip->scaleValues[channel.firstScaleKey],
+                channel.numScaleKeys, t, cursor.scale);
+
+        target.translations[bone] = translation;
+        target.rotations[bone] = rotation;
+        target.scales[bone] = scale;
+        if (target.dirty)
+            target.dirty[bone] = 1;
+    }
+}
+
+void AnimationPlayer::SampleCompressed(float t, const LocalPoseTarget& target)
+{
+    for (size_t c = 0; c < compressed->channels.size(); c++)
+    {
+        const CompressedChannel& channel = compressed->channels[c];
+        ChannelCursor& cursor = cursors[c];
+
+        // Pose may be from another (smaller) skeleton, masked out bones aren't sampled at all
+        size_t bone = (size_t)channel.boneIndex;
+        if (bone >= target.count || (target.mask && target.mask[bone] <= 0.0f))
+            continue;
+
+        // Channels without keys of a kind keep that part of the current local pose
+        glm::vec3 translation = target.translations[bone];
+        glm::quat rotation = target.rotations[bone];
+        glm::vec3 scale = target.scales[bone];
+
+        if (channel.numPosKeys)
+            translation = SampleRange16(&compressed->posTimes[channel.firstPosKey], &compressed->posValues[channel.firstPosKey * 3],
+                channel.numPosKeys, t, cursor.pos, channel.posMin, channel.posExtent);
+        if (channel.numRotKeys)
+            rotation = SampleRotation48(&compressed->rotTimes[channel.firstRotKey], &compressed->rotValues[channel.firstRotKey * 3],
+                channel.numRotKeys, t, cursor.rot);
+        if (channel.numScaleKeys)
+            scale = SampleRange16(&compressed->scaleTimes[channel.firstScaleKey], &compressed->scaleValues[channel.firstScaleKey * 3],
+                channel.numScaleKeys, t, cursor.scale, channel.scaleMin, channel.scaleExtent);
+
+        target.translations[bone] = translation;
+        target.rotations[bone] = rotation;
+        target.scales[bone] = scale;
+        if (target.dirty)
+            target.dirty[bone] = 1;
+    }
+}
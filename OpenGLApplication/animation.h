@@ -0,0 +1,201 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "skeleton.h"
+
+struct aiScene;
+
+/*
+* Skeletal animation clips imported from aiScene::mAnimations.
+*
+* Every clip keeps its keys in a few contiguous arrays (times and values
+* apart so a key-search only walks the times), a channel is a slice of
+* those arrays belonging to one bone of the Skeleton.
+*
+* The player remembers the last key used per channel, time normally only
+* moves forward by a frame so the next key is found in a step or two
+* instead of searching the whole channel every frame. Sampled poses are
+* written straight into SkeletonPose (and marked dirty).
+*
+* Clips are stored and played compressed (CompressedClip, see
+* animation_compression.h), the raw AnimationClip is what the importer
+* produces and what the compressor is measured against.
+*/
+
+// Keys of one bone in a clip, indices are into the arrays of the clip
+struct AnimationChannel
+{
+    int32_t boneIndex;          // Index in Skeleton
+    uint32_t firstPosKey;
+    uint32_t numPosKeys;
+    uint32_t firstRotKey;
+    uint32_t numRotKeys;
+    uint32_t firstScaleKey;
+    uint32_t numScaleKeys;
+    uint32_t reserved;          // Keeps the struct a multiple of 16 bytes in the model-cache
+};
+
+// One animation (e.g. "walk"), times are in seconds
+struct AnimationClip
+{
+    std::string name;
+    float duration = 0.0f;
+
+    std::vector<AnimationChannel> channels;     // Sorted by bone-index
+
+    std::vector<float> posTimes;
+    std::vector<glm::vec3> posValues;
+    std::vector<float> rotTimes;
+    std::vector<glm::quat> rotValues;
+    std::vector<float> scaleTimes;
+    std::vector<glm::vec3> scaleValues;
+};
+
+// Keys of one bone in a compressed clip. Translations/scales are 16 bits per axis inside [min, min + extent],
+// rotations are 48 bits (smallest three). A channel that doesn't move has a single key
+struct CompressedChannel
+{
+    int32_t boneIndex;
+    uint32_t firstPosKey;
+    uint32_t numPosKeys;
+    uint32_t firstRotKey;
+    uint32_t numRotKeys;
+    uint32_t firstScaleKey;
+    uint32_t numScaleKeys;
+    uint32_t reserved;
+
+    glm::vec3 posMin;
+    glm::vec3 posExtent;
+    glm::vec3 scaleMin;
+    glm::vec3 scaleExtent;
+};
+
+// Compressed version of AnimationClip, every value-array holds 3 uint16_t per key
+struct CompressedClip
+{
+    std::string name;
+    float duration = 0.0f;
+
+    std::vector<CompressedChannel> channels;    // Sorted by bone-index
+
+    std::vector<float> posTimes;
+    std::vector<uint16_t> posValues;
+    std::vector<float> rotTimes;
+    std::vector<uint16_t> rotValues;
+    std::vector<float> scaleTimes;
+    std::vector<uint16_t> scaleValues;
+};
+
+// Normalized lerp the shortest way around, used by the sampler (and the compressor, so both agree)
+inline glm::quat NlerpShortest(const glm::quat& q0, glm::quat q1, float f)
+{
+    if (glm::dot(q0, q1) < 0.0f)
+        q1 = -q1;
+    return glm::normalize(q0 * (1.0f - f) + q1 * f);
+}
+
+// 16-bit value inside [min, min + extent] per axis
+inline glm::vec3 DecodeRange16(const uint16_t* q, const glm::vec3& min, const glm::vec3& extent)
+{
+    return min + glm::vec3(q[0], q[1], q[2]) * (extent * (1.0f / 65535.0f));
+}
+
+// Smallest three: the 2 top bits of q[0], q[1] say which component was dropped (the largest),
+// the other 3 are 15 bits in [-1/sqrt(2), 1/sqrt(2)]. The dropped one is always positive
+inline glm::quat DecodeRotation48(const uint16_t* q)
+{
+    const float scale = 1.41421356f / 32767.0f;    // [0, 32767] -> [0, sqrt(2)]
+    const float offset = 0.70710678f;
+
+    int largest = ((q[0] >> 15) << 1) | (q[1] >> 15);
+    float a = (float)(q[0] & 0x7FFF) * scale - offset;
+    float b = (float)(q[1] & 0x7FFF) * scale - offset;
+    float c = (float)(q[2] & 0x7FFF) * scale - offset;
+    float d = std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+
+    // Components in x, y, z, w order with the largest put back
+    switch (largest)
+    {
+    case 0:  return glm::quat(c, d, a, b);
+    case 1:  return glm::quat(c, a, d, b);
+    case 2:  return glm::quat(c, a, b, d);
+    default: return glm::quat(d, a, b, c);
+    }
+}
+
+// Where sampled local poses are written, a SkeletonPose or a blend-buffer (see pose_blend.h)
+struct LocalPoseTarget
+{
+    glm::vec3* translations = nullptr;
+    glm::quat* rotations = nullptr;
+    glm::vec3* scales = nullptr;
+    uint8_t* dirty = nullptr;       // Set for every bone written (SkeletonPose::dirty), may be nullptr
+    const float* mask = nullptr;    // Per-bone weight, bones at 0 are not sampled at all, nullptr = every bone
+    size_t count = 0;
+};
+
+// Target writing straight into the local pose of a SkeletonPose
+inline LocalPoseTarget MakePoseTarget(SkeletonPose& pose)
+{
+    LocalPoseTarget target;
+    target.translations = pose.localTranslations.data();
+    target.rotations = pose.localRotations.data();
+    target.scales = pose.localScales.data();
+    target.dirty = pose.dirty.data();
+    target.count = pose.Size();
+    return target;
+}
+
+// Imports every animation of the scene, channels of nodes that aren't bones of the skeleton are skipped
+void ImportAnimations(const aiScene* pScene, const SkeletonDesc& skeleton, std::vector<AnimationClip>& outClips);
+
+// Plays one clip on a SkeletonPose
+class AnimationPlayer
+{
+public:
+    void Play(const AnimationClip* clip, bool loop = true);
+    void Play(const CompressedClip* clip, bool loop = true);
+    void Stop();
+
+    // Moves time forward (deltaTime * speed) and samples every channel into the local pose of its bone
+    void Update(float deltaTime, SkeletonPose& pose);
+
+    // Only moves time forward (wraps or holds at the end), for players sampled by a blender
+    void Advance(float deltaTime);
+
+    // Samples the clip at time without moving the player's time
+    void Sample(float t, SkeletonPose& pose);
+    void Sample(float t, const LocalPoseTarget& target);
+
+    bool IsPlaying() const { return clip != nullptr || compressed != nullptr; }
+    float GetTime() const { return time; }
+    void SetSpeed(float newSpeed) { speed = newSpeed; }
+
+private:
+    // Key-pair used last time per channel
+    struct ChannelCursor
+    {
+        uint32_t pos = 0;
+        uint32_t rot = 0;
+        uint32_t scale = 0;
+    };
+
+    // Duration of whichever clip is playing
+    float Duration() const;
+
+    void SampleRaw(float t, const LocalPoseTarget& target);
+    void SampleCompressed(float t, const LocalPoseTarget& target);
+
+    const AnimationClip* clip = nullptr;        // Only one of clip/compressed is set
+    const CompressedClip* compressed = nullptr;
+    std::vector<ChannelCursor> cursors;         // One per channel of the clip
+    float time = 0.0f;
+    float speed = 1.0f;
+    bool loop = true;
+};
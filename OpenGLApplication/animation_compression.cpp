@@ -0,0 +1,308 @@
+#include "animation_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+/*
+* Import-time compression of animation clips (AnimationClip -> CompressedClip).
+*/
+
+// ------------------------- QUANTIZATION -------------------------
+
+// Range of a channel's values, extent is 0 on axes that don't move
+static void ComputeRange(const glm::vec3* values, uint32_t count, glm::vec3& outMin, glm::vec3& outExtent)
+{
+    glm::vec3 lo = values[0], hi = values[0];
+    for (uint32_t k = 1; k < count; k++)
+    {
+        lo = glm::min(lo, values[k]);
+        hi = glm::max(hi, values[k]);
+    }
+    outMin = lo;
+    outExtent = hi - lo;
+}
+
+static void EncodeRange16(const glm::vec3& v, const glm::vec3& min, const glm::vec3& extent, uint16_t* out)
+{
+    for (int a = 0; a < 3; a++)
+    {
+        float n = extent[a] > 0.0f ? (v[a] - min[a]) / extent[a] : 0.0f;
+        out[a] = (uint16_t)std::lround(std::clamp(n, 0.0f, 1.0f) * 65535.0f);
+    }
+}
+
+// Smallest three, see DecodeRotation48
+static void EncodeRotation48(glm::quat q, uint16_t* out)
+{
+    q = glm::normalize(q);
+    float comps[4] = { q.x, q.y, q.z, q.w };
+
+    // Drop the largest, flip the sign of the whole quaternion so it is positive
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+        if (std::abs(comps[i]) > std::abs(comps[largest]))
+            largest = i;
+    float sign = comps[largest] < 0.0f ? -1.0f : 1.0f;
+
+    uint16_t packed[3];
+    int n = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+        float v = (comps[i] * sign + 0.70710678f) / 1.41421356f;   // [-1/sqrt(2), 1/sqrt(2)] -> [0, 1]
+        packed[n++] = (uint16_t)std::lround(std::clamp(v, 0.0f, 1.0f) * 32767.0f);
+    }
+
+    out[0] = (uint16_t)(packed[0] | ((largest >> 1) << 15));
+    out[1] = (uint16_t)(packed[1] | ((largest & 1) << 15));
+    out[2] = packed[2];
+}
+
+// ------------------------- ERRORS -------------------------
+
+static float PositionError(const glm::vec3& a, const glm::vec3& b)
+{
+    return glm::length(a - b);
+}
+
+// Angle between two rotations in radians (atan2 of the difference-rotation, acos of the dot is too coarse near 0)
+static float RotationError(const glm::quat& a, const glm::quat& b)
+{
+    glm::quat diff = glm::inverse(glm::normalize(a)) * glm::normalize(b);
+    return 2.0f * std::atan2(glm::length(glm::vec3(diff.x, diff.y, diff.z)), std::abs(diff.w));
+}
+
+static float BoneLimit(const std::vector<float>& perBone, int bone, float fallback)
+{
+    if (bone >= 0 && (size_t)bone < perBone.size() && perBone[bone] > 0.0f)
+        return perBone[bone];
+    return fallback;
+}
+
+// ------------------------- KEY REDUCTION -------------------------
+
+// Picks which keys to keep: first and last are always kept, from every kept key the next one is the
+// furthest key that still rebuilds all keys in between within maxError. decoded = values after quantization,
+// raw = original values (what the error is measured against). A channel within maxError of its
+// first key everywhere keeps only that key
+template <typename T, typename LerpFn, typename ErrorFn>
+static std::vector<uint32_t> ReduceKeys(const float* times, const T* decoded, const T* raw, uint32_t count,
+    float maxError, LerpFn lerp, ErrorFn error)
+{
+    std::vector<uint32_t> kept;
+    if (count == 0)
+        return kept;
+
+    // Constant channel
+    bool constant = true;
+    for (uint32_t k = 0; k < count && constant; k++)
+        constant = error(decoded[0], raw[k]) <= maxError;
+    if (constant) {
+        kept.push_back(0);
+        return kept;
+    }
+
+    uint32_t anchor = 0;
+    kept.push_back(0);
+    while (anchor + 1 < count)
+    {
+        // Try to reach as far as possible from anchor
+        uint32_t next = anchor + 1;
+        for (uint32_t candidate = anchor + 2; candidate < count; candidate++)
+        {
+            bool fits = true;
+            float span = times[candidate] - times[anchor];
+            for (uint32_t k = anchor + 1; k < candidate && fits; k++)
+            {
+                float f = span > 0.0f ? (times[k] - times[anchor]) / span : 0.0f;
+                fits = error(lerp(decoded[anchor], decoded[candidate], f), raw[k]) <= maxError;
+            }
+            if (!fits)
+                break;
+            next = candidate;
+        }
+
+        kept.push_back(next);
+        anchor = next;
+    }
+    return kept;
+}
+
+// ------------------------- COMPRESSION -------------------------
+
+void CompressAnimationClip(const AnimationClip& clip, const AnimationCompressionSettings& settings, CompressedClip& outClip)
+{
+    outClip = CompressedClip();
+    outClip.name = clip.name;
+    outClip.duration = clip.duration;
+    outClip.channels.reserve(clip.channels.size());
+
+    auto lerpVec3 = [](const glm::vec3& a, const glm::vec3& b, float f) { return glm::mix(a, b, f); };
+    auto lerpQuat = [](const glm::quat& a, const glm::quat& b, float f) { return NlerpShortest(a, b, f); };
+
+    for (const AnimationChannel& channel : clip.channels)
+    {
+        CompressedChannel out = {};
+        out.boneIndex = channel.boneIndex;
+
+        float posLimit = BoneLimit(settings.bonePositionError, channel.boneIndex, settings.maxPositionError);
+        float rotLimit = BoneLimit(settings.boneRotationError, channel.boneIndex, settings.maxRotationError);
+
+        // Translation
+        out.firstPosKey = (uint32_t)outClip.posTimes.size();
+        if (channel.numPosKeys)
+        {
+            const float* times = &clip.posTimes[channel.firstPosKey];
+            const glm::vec3* raw = &clip.posValues[channel.firstPosKey];
+            ComputeRange(raw, channel.numPosKeys, out.posMin, out.posExtent);
+
+            // Quantize everything first, keys are reduced on what the sampler will see
+            std::vector<uint16_t> quantized(channel.numPosKeys * 3);
+            std::vector<glm::vec3> decoded(channel.numPosKeys);
+            for (uint32_t k = 0; k < channel.numPosKeys; k++)
+            {
+                EncodeRange16(raw[k], out.posMin, out.posExtent, &quantized[k * 3]);
+                decoded[k] = DecodeRange16(&quantized[k * 3], out.posMin, out.posExtent);
+            }
+
+            std::vector<uint32_t> kept = ReduceKeys(times, decoded.data(), raw, channel.numPosKeys, posLimit, lerpVec3, PositionError);
+            for (uint32_t k : kept)
+            {
+                outClip.posTimes.push_back(times[k]);
+                outClip.posValues.insert(outClip.posValues.end(), &quantized[k * 3], &quantized[k * 3] + 3);
+            }
+            out.numPosKeys = (uint32_t)kept.size();
+        }
+
+        // Rotation
+        out.firstRotKey = (uint32_t)outClip.rotTimes.size();
+        if (channel.numRotKeys)
+        {
+            const float* times = &clip.rotTimes[channel.firstRotKey];
+            const glm::quat* raw = &clip.rotValues[channel.firstRotKey];
+
+            std::vector<uint16_t> quantized(channel.numRotKeys * 3);
+            std::vector<glm::quat> decoded(channel.numRotKeys);
+            for (uint32_t k = 0; k < channel.numRotKeys; k++)
+            {
+                EncodeRotation48(raw[k], &quantized[k * 3]);
+                decoded[k] = DecodeRotation48(&quantized[k * 3]);
+            }
+
+            std::vector<uint32_t> kept = ReduceKeys(times, decoded.data(), raw, channel.numRotKeys, rotLimit, lerpQuat, RotationError);
+            for (uint32_t k : kept)
+            {
+                outClip.rotTimes.push_back(times[k]);
+                outClip.rotValues.insert(outClip.rotValues.end(), &quantized[k * 3], &quantized[k * 3] + 3);
+            }
+            out.numRotKeys = (uint32_t)kept.size();
+        }
+
+        // Scale
+        out.firstScaleKey = (uint32_t)outClip.scaleTimes.size();
+        if (channel.numScaleKeys)
+        {
+            const float* times = &clip.scaleTimes[channel.firstScaleKey];
+            const glm::vec3* raw = &clip.scaleValues[channel.firstScaleKey];
+            ComputeRange(raw, channel.numScaleKeys, out.scaleMin, out.scaleExtent);
+
+            std::vector<uint16_t> quantized(channel.numScaleKeys * 3);
+            std::vector<glm::vec3> decoded(channel.numScaleKeys);
+            for (uint32_t k = 0; k < channel.numScaleKeys; k++)
+            {
+                EncodeRange16(raw[k], out.scaleMin, out.scaleExtent, &quantized[k * 3]);
+                decoded[k] = DecodeRange16(&quantized[k * 3], out.scaleMin, out.scaleExtent);
+            }
+
+            std::vector<uint32_t> kept = ReduceKeys(times, decoded.data(), raw, channel.numScaleKeys, settings.maxScaleError, lerpVec3, PositionError);
+            for (uint32_t k : kept)
+            {
+                outClip.scaleTimes.push_back(times[k]);
+                outClip.scaleValues.insert(outClip.scaleValues.end(), &quantized[k * 3], &quantized[k * 3] + 3);
+            }
+            out.numScaleKeys = (uint32_t)kept.size();
+        }
+
+        outClip.channels.push_back(out);
+    }
+}
+
+// ------------------------- REPORT -------------------------
+
+size_t AnimationClipBytes(const AnimationClip& clip)
+{
+    return clip.channels.size() * sizeof(AnimationChannel)
+        + clip.posTimes.size() * sizeof(float) + clip.posValues.size() * sizeof(glm::vec3)
+        + clip.rotTimes.size() * sizeof(float) + clip.rotValues.size() * sizeof(glm::quat)
+        + clip.scaleTimes.size() * sizeof(float) + clip.scaleValues.size() * sizeof(glm::vec3);
+}
+
+size_t CompressedClipBytes(const CompressedClip& clip)
+{
+    return clip.channels.size() * sizeof(CompressedChannel)
+        + (clip.posTimes.size() + clip.rotTimes.size() + clip.scaleTimes.size()) * sizeof(float)
+        + (clip.posValues.size() + clip.rotValues.size() + clip.scaleValues.size()) * sizeof(uint16_t);
+}
+
+// Pose with every bone at identity, only the arrays the sampler touches
+static void MakeReportPose(size_t numBones, SkeletonPose& pose)
+{
+    pose.localTranslations.assign(numBones, glm::vec3(0.0f));
+    pose.localRotations.assign(numBones, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    pose.localScales.assign(numBones, glm::vec3(1.0f));
+    pose.parentIndices.assign(numBones, -1);
+    pose.dirty.assign(numBones, 0);
+}
+
+void ReportAnimationCompression(const std::vector<AnimationClip>& clips, const std::vector<CompressedClip>& compressed, size_t numBones)
+{
+    printf("\n**************************************************\n");
+    printf("Animation compression\n\n");
+    printf("%-24s %10s %10s %8s %12s %12s %14s\n", "Clip", "Raw (B)", "Packed (B)", "Ratio", "Keys", "Max pos err", "Max rot (deg)");
+
+    SkeletonPose rawPose, packedPose;
+    MakeReportPose(numBones, rawPose);
+    MakeReportPose(numBones, packedPose);
+
+    for (size_t i = 0; i < clips.size() && i < compressed.size(); i++)
+    {
+        const AnimationClip& clip = clips[i];
+        const CompressedClip& packed = compressed[i];
+
+        AnimationPlayer rawPlayer, packedPlayer;
+        rawPlayer.Play(&clip, false);
+        packedPlayer.Play(&packed, false);
+
+        // Compare both at 120 Hz (plus the end), covers the original keys and the spans between them
+        float maxPos = 0.0f, maxRot = 0.0f;
+        int samples = std::max(1, (int)std::ceil(clip.duration * 120.0f));
+        for (int s = 0; s <= samples; s++)
+        {
+            float t = clip.duration * (float)s / (float)samples;
+            rawPlayer.Sample(t, rawPose);
+            packedPlayer.Sample(t, packedPose);
+
+            for (const AnimationChannel& channel : clip.channels)
+            {
+                if ((size_t)channel.boneIndex >= numBones)
+                    continue;
+                maxPos = std::max(maxPos, PositionError(rawPose.localTranslations[channel.boneIndex], packedPose.localTranslations[channel.boneIndex]));
+                maxRot = std::max(maxRot, RotationError(rawPose.localRotations[channel.boneIndex], packedPose.localRotations[channel.boneIndex]));
+            }
+        }
+
+        size_t rawBytes = AnimationClipBytes(clip);
+        size_t packedBytes = CompressedClipBytes(packed);
+        size_t rawKeys = clip.posTimes.size() + clip.rotTimes.size() + clip.scaleTimes.size();
+        size_t packedKeys = packed.posTimes.size() + packed.rotTimes.size() + packed.scaleTimes.size();
+
+        char keys[32];
+        snprintf(keys, sizeof(keys), "%zu->%zu", rawKeys, packedKeys);
+        printf("%-24.24s %10zu %10zu %7.2fx %12s %12.6f %14.4f\n",
+            clip.name.c_str(), rawBytes, packedBytes, packedBytes ? (double)rawBytes / packedBytes : 0.0,
+            keys, maxPos, glm::degrees(maxRot));
+    }
+    printf("\n");
+}
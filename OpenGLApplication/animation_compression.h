@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+
+#include "animation.h"
+
+/*
+* Import-time compression of animation clips (AnimationClip -> CompressedClip).
+*
+* 1. Keys that can be rebuilt by interpolating their neighbours (within
+*    the allowed error of the bone) are dropped, a channel that doesn't
+*    move at all keeps a single key.
+* 2. Rotations are stored as "smallest three" in 48 bits.
+* 3. Translations and scales are stored as 16 bits per axis inside the
+*    range (min/extent) of their channel.
+*
+* The reduction is checked against the quantized values so the error
+* at every original key stays inside the limit (as long as the limit is
+* larger than the quantization step).
+*/
+
+struct AnimationCompressionSettings
+{
+    float maxPositionError = 0.0005f;   // Model-units
+    float maxRotationError = 0.0005f;   // Radians
+    float maxScaleError = 0.0005f;
+
+    // Optional per-bone limits (indexed by bone, <= 0 or out of range = use the limit above)
+    std::vector<float> bonePositionError;
+    std::vector<float> boneRotationError;
+};
+
+// Compresses one clip
+void CompressAnimationClip(const AnimationClip& clip, const AnimationCompressionSettings& settings, CompressedClip& outClip);
+
+// Bytes used by the keys and channels of a clip (what the model-cache stores)
+size_t AnimationClipBytes(const AnimationClip& clip);
+size_t CompressedClipBytes(const CompressedClip& clip);
+
+// Prints size before/after, compression ratio and the largest local position/rotation error of every clip
+void ReportAnimationCompression(const std::vector<AnimationClip>& clips, const std::vector<CompressedClip>& compressed, size_t numBones);
@@ -0,0 +1,53 @@
+// Bone-palette declaration shared by the skinning-shaders, see bone_palette_buffer.h.
+// Declaration is picked by the defines of BonePaletteBuffer::GetShaderDefines() (or get_palette_defines() for partitions):
+// either 3x4 affine bone-matrices (last row is always 0, 0, 0, 1) multiplied from the right: v * M,
+// or unit dual quaternions (DUAL_QUAT_SKINNING): column 0 = rotation (real), column 1 = translation (dual).
+// PALETTE_OFFSET may be set to the first bone of the vertex's palette (crowds), 0 otherwise
+#ifndef PALETTE_OFFSET
+#define PALETTE_OFFSET 0
+#endif
+
+#ifdef DUAL_QUAT_SKINNING
+#define Bone mat2x4
+#define BONE_TEXELS 2
+#else
+#define Bone mat3x4
+#define BONE_TEXELS 3
+#endif
+
+#ifdef BONE_PALETTE_TBO
+// Large rigs and crowds: texture-buffer, BONE_TEXELS texels (the columns) per bone, instances after each other
+uniform samplerBuffer uBonePalette;
+
+Bone GetBone(int id)
+{
+    int texel = (PALETTE_OFFSET + id) * BONE_TEXELS;
+#ifdef DUAL_QUAT_SKINNING
+    return Bone(texelFetch(uBonePalette, texel), texelFetch(uBonePalette, texel + 1));
+#else
+    return Bone(texelFetch(uBonePalette, texel), texelFetch(uBonePalette, texel + 1), texelFetch(uBonePalette, texel + 2));
+#endif
+}
+#elif defined(BONE_PALETTE_UNIFORM)
+// Palette-partitioned mesh: plain uniform-array with the slice of the current draw-batch
+uniform Bone uBones[MAX_SHADER_BONES];
+
+Bone GetBone(int id)
+{
+    return uBones[id];
+}
+#else
+#ifndef MAX_SHADER_BONES
+#define MAX_SHADER_BONES 128
+#endif
+// Written by the CPU straight into a mapped buffer, sized for the rig
+layout (std140) uniform BonePalette
+{
+    Bone uBones[MAX_SHADER_BONES];
+};
+
+Bone GetBone(int id)
+{
+    return uBones[id];
+}
+#endif
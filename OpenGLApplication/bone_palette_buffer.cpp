@@ -0,0 +1,252 @@
+#include "bone_palette_buffer.h"
+#include "shader.h"
+#include "dual_quat.h"
+#include <glew.h>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+/*
+* GPU-buffer the bone-palette (final bone-matrices) is written straight into.
+*
+* Replaces building the palette in a std::vector and copying it again
+* through glUniform every frame, the pose-pass writes the mapped memory
+* directly (see ComputePosePalette).
+*
+* All buffer-calls go through GL_COPY_WRITE_BUFFER so they never disturb the
+* uniform-/texture-bindings the shaders read from.
+*/
+
+// ------------------------- SETUP -------------------------
+
+bool BonePaletteBuffer::Create(size_t count, unsigned int unit, bool forceTextureBuffer, bool useDualQuats)
+{
+    Destroy();
+
+    if (count == 0)
+        return false;
+
+    numBones = count;
+    textureUnit = unit;
+    dualQuats = useDualQuats;
+    boneSize = dualQuats ? sizeof(DualQuat) : sizeof(Affine3x4);
+
+    // Small rigs in a uniform-block, anything larger in a texture-buffer
+    textureBuffer = forceTextureBuffer || numBones > GetMaxUniformBlockBones(boneSize);
+
+    // Each copy must start on the offset-alignment to be bound as a range, texture-buffers need ARB_texture_buffer_range for that
+    GLint alignment = 256;
+    if (!textureBuffer)
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    else if (GLEW_ARB_texture_buffer_range || GLEW_VERSION_4_3)
+        glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    else
+        numCopies = 1;      // Whole buffer only, the fence makes each frame wait for the previous one
+
+    // Too large for either binding, the caller falls back to another palette-path
+    if (textureBuffer && numBones > GetMaxTextureBufferBones(boneSize))
+    {
+        std::cerr << "Bone-palette: " << numBones << " bones exceed the texture-buffer size (" << GetMaxTextureBufferBones(boneSize) << " bones)\n";
+        Destroy();
+        return false;
+    }
+
+    copySize = numBones * boneSize;
+    copySize = (copySize + alignment - 1) / alignment * alignment;
+    boundSize = numBones * boneSize;
+
+    size_t totalSize = copySize * numCopies;
+    persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+
+    // Neutral target for allocating and mapping, the shaders see it through the uniform- or texture-binding
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    if (persistent)
+    {
+        // Mapped once for the lifetime of the buffer, coherent so no flushing is needed
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, nullptr, flags);
+        persistentPtr = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+
+        if (!persistentPtr) {
+            std::cerr << "Could not persistently map bone-palette buffer\n";
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            Destroy();
+            return false;
+        }
+    }
+    else
+        glBufferData(GL_COPY_WRITE_BUFFER, totalSize, nullptr, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // One texture per copy, each viewing its own range of the buffer
+    if (textureBuffer)
+    {
+        glGenTextures(numCopies, textures);
+        for (unsigned int i = 0; i < numCopies; i++)
+        {
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            if (numCopies > 1)
+                glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer, i * copySize, boundSize);
+            else
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    printf("Bone-palette buffer: %zu bones x %u copies (%s, %s, %s)\n",
+        numBones, numCopies, dualQuats ? "dual quaternions" : "matrices", textureBuffer ? "texture-buffer" : "uniform-block",
+        persistent ? "persistent map" : "unsynchronized map");
+    return true;
+}
+
+void BonePaletteBuffer::Destroy()
+{
+    for (void*& fence : fences)
+    {
+        if (fence)
+            glDeleteSync((GLsync)fence);
+        fence = nullptr;
+    }
+
+    if (textures[0])
+        glDeleteTextures(numCopies, textures);
+    for (unsigned int& texture : textures)
+        texture = 0;
+
+    if (buffer)
+    {
+        if (persistentPtr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    buffer = 0;
+    persistentPtr = nullptr;
+    writePtr = nullptr;
+    numBones = copySize = boundSize = 0;
+    boneSize = sizeof(Affine3x4);
+    numCopies = NUM_COPIES;
+    textureUnit = BONE_PALETTE_TEXTURE_UNIT;
+    current = 0;
+    textureBuffer = false;
+    dualQuats = false;
+}
+
+size_t BonePaletteBuffer::GetMaxUniformBlockBones(size_t boneSize)
+{
+    GLint maxBlockSize = 16384;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+    return (size_t)maxBlockSize / boneSize;
+}
+
+size_t BonePaletteBuffer::GetMaxTextureBufferBones(size_t boneSize)
+{
+    // One RGBA32F texel = 16 bytes
+    GLint maxTexels = 65536;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    return (size_t)maxTexels / (boneSize / 16);
+}
+
+// ------------------------- PER FRAME -------------------------
+
+Affine3x4* BonePaletteBuffer::BeginFrame()
+{
+    return dualQuats ? nullptr : (Affine3x4*)MapNextCopy();
+}
+
+DualQuat* BonePaletteBuffer::BeginFrameDualQuat()
+{
+    return dualQuats ? (DualQuat*)MapNextCopy() : nullptr;
+}
+
+void* BonePaletteBuffer::MapNextCopy()
+{
+    if (!buffer)
+        return nullptr;
+
+    current = (current + 1) % numCopies;
+
+    // Wait for the frame that last read this copy, normally already done since it was NUM_COPIES - 1 frames ago
+    if (fences[current])
+    {
+        GLsync fence = (GLsync)fences[current];
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);   // 1 ms
+
+        glDeleteSync(fence);
+        fences[current] = nullptr;
+    }
+
+    if (persistent)
+        writePtr = (char*)persistentPtr + current * copySize;
+    else
+    {
+        // Fence already guarantees the GPU is done with this copy, no need for the driver to sync
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        writePtr = glMapBufferRange(GL_COPY_WRITE_BUFFER, current * copySize, copySize,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    return writePtr;
+}
+
+void BonePaletteBuffer::EndWrite()
+{
+    if (!buffer)
+        return;
+
+    if (!persistent && writePtr)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    writePtr = nullptr;
+
+    // The same binding is shared by every program, only the copy changes
+    if (textureBuffer)
+    {
+        glActiveTexture(GL_TEXTURE0 + textureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[current]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    else
+        glBindBufferRange(GL_UNIFORM_BUFFER, BONE_PALETTE_BINDING, buffer, current * copySize, boundSize);
+}
+
+void BonePaletteBuffer::EndFrame()
+{
+    if (!buffer)
+        return;
+
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// ------------------------- SHADERS -------------------------
+
+std::string BonePaletteBuffer::GetShaderDefines() const
+{
+    // Skinning-method is part of the palette, skinning.vs blends whatever the buffer holds
+    std::string defines = dualQuats ? "#define DUAL_QUAT_SKINNING\n" : "";
+
+    if (textureBuffer)
+        return defines + "#define BONE_PALETTE_TBO\n";
+
+    // Uniform-block sized for this rig exactly
+    return defines + "#define MAX_SHADER_BONES " + std::to_string(std::max<size_t>(numBones, 1)) + "\n";
+}
+
+void BonePaletteBuffer::BindToShader(const Shader& shader) const
+{
+    // Only one of them exists in the program, the other call is ignored
+    shader.BindUniformBlock("BonePalette", BONE_PALETTE_BINDING);
+    shader.BindSampler("uBonePalette", (int)textureUnit);
+}
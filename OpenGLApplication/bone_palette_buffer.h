@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "affine.h"
+
+class Shader;
+struct DualQuat;
+
+/*
+* GPU-buffer the bone-palette (final bone-matrices) is written straight into.
+*
+* The buffer holds NUM_COPIES copies of the palette. Each frame the CPU
+* writes one copy while the GPU may still be drawing the previous ones,
+* a fence per copy makes sure a copy is never overwritten while in use.
+*
+* With ARB_buffer_storage the buffer is mapped once (persistent + coherent)
+* and stays mapped, otherwise the current copy is mapped unsynchronized every
+* frame (the fences do the syncing).
+*
+* Rigs that fit in a uniform-block (GL_MAX_UNIFORM_BLOCK_SIZE, at least 16 KB
+* = 341 bones) are read as the uniform-block "BonePalette" on binding point
+* BONE_PALETTE_BINDING. Larger rigs use a texture-buffer (3 RGBA32F texels per
+* bone) on texture-unit BONE_PALETTE_TEXTURE_UNIT instead, so nothing is clamped.
+* The shaders pick the matching declaration through GetShaderDefines().
+*
+* For dual-quaternion skinning (DUAL_QUAT_SKINNING in skinning.vs) the buffer holds a DualQuat
+* (32 bytes, 2 texels) per bone instead, so larger rigs still fit the block.
+*/
+
+#define BONE_PALETTE_BINDING 0          // Uniform-block binding point of BonePalette
+#define BONE_PALETTE_TEXTURE_UNIT 8     // Texture-unit of uBonePalette (texture-buffer path)
+#define CROWD_PALETTE_TEXTURE_UNIT 9    // Texture-unit of the crowd's palettes (see Crowd), so both can be bound at once
+
+class BonePaletteBuffer
+{
+public:
+    static const unsigned int NUM_COPIES = 3;
+
+    BonePaletteBuffer() = default;
+
+    BonePaletteBuffer(const BonePaletteBuffer&) = delete;
+    BonePaletteBuffer& operator=(const BonePaletteBuffer&) = delete;
+
+    // (Re)creates the buffer for numBones bones, needs a current GL-context.
+    // textureUnit is used by the texture-buffer path, forceTextureBuffer skips the uniform-block even for small palettes,
+    // dualQuats stores a DualQuat per bone instead of an Affine3x4. Fails when the rig does not fit the texture-buffer either
+    bool Create(size_t numBones, unsigned int textureUnit = BONE_PALETTE_TEXTURE_UNIT, bool forceTextureBuffer = false,
+        bool dualQuats = false);
+
+    // Frees the buffer and fences, must be called while the context is still alive
+    void Destroy();
+
+    // Waits until the GPU is done with the next copy and returns where this frame's palette goes (nullptr if not created).
+    // BeginFrame() is for matrix-palettes, BeginFrameDualQuat() for dual-quaternion palettes (nullptr for the other kind)
+    Affine3x4* BeginFrame();
+    DualQuat* BeginFrameDualQuat();
+
+    // Done writing, binds the copy to BONE_PALETTE_BINDING (or its texture-unit)
+    void EndWrite();
+
+    // Call after the last draw reading this frame's copy
+    void EndFrame();
+
+    // GLSL-defines for the vertex-shaders: BONE_PALETTE_TBO or the size of the uniform-block (MAX_SHADER_BONES), plus DUAL_QUAT_SKINNING
+    std::string GetShaderDefines() const;
+
+    // Connects the palette of a program (built with GetShaderDefines) to this buffer, once per program
+    void BindToShader(const Shader& shader) const;
+
+    unsigned int GetCopyCount() const { return numCopies; }
+    bool IsPersistent() const { return persistent; }
+    bool UsesTextureBuffer() const { return textureBuffer; }
+    bool UsesDualQuats() const { return dualQuats; }
+    size_t GetBoneSize() const { return boneSize; }  // Bytes per bone in the buffer
+
+    // Bones that fit one uniform-block / texture-buffer on this GPU, boneSize = sizeof(Affine3x4) or sizeof(DualQuat)
+    static size_t GetMaxUniformBlockBones(size_t boneSize);
+    static size_t GetMaxTextureBufferBones(size_t boneSize);
+
+private:
+    void* MapNextCopy();
+
+    unsigned int buffer = 0;
+    unsigned int textures[NUM_COPIES] = {}; // Texture-buffer view of each copy (texture-buffer path only)
+    void* fences[NUM_COPIES] = {};      // GLsync of the last frame that used each copy
+    void* persistentPtr = nullptr;      // Start of the whole buffer when persistently mapped
+    void* writePtr = nullptr;           // Copy being written this frame
+
+    size_t numBones = 0;
+    size_t boneSize = sizeof(Affine3x4); // Bytes per bone, 3 texels for matrices and 2 for dual quaternions
+    size_t copySize = 0;                // Bytes per copy, rounded up to the offset-alignment
+    size_t boundSize = 0;               // Bytes visible to the shaders
+    unsigned int numCopies = NUM_COPIES; // 1 for texture-buffers without ARB_texture_buffer_range
+    unsigned int textureUnit = BONE_PALETTE_TEXTURE_UNIT;
+    unsigned int current = 0;           // Copy used this frame
+    bool persistent = false;
+    bool textureBuffer = false;
+    bool dualQuats = false;
+};
@@ -0,0 +1,330 @@
+#include "cpu_skinning.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+* Skinning on the CPU.
+*
+* One vertex per iteration: the 4 palette-entries are blended row by row
+* (3 rows = 3 SSE-registers, or rows 0-1 in one AVX-register), the blended
+* rows are transposed into columns once and then applied to both the
+* position and the normal with broadcasts. Writes are sequential so the
+* output can go straight into a mapped (write-combined) VBO.
+*/
+
+// ------------------------- STREAMS -------------------------
+
+void BuildSkinningStreams(const VertexGPU* vertices, size_t count, size_t numBones, SkinningStreams& out)
+{
+    out.positions.resize(count);
+    out.normals.resize(count);
+    out.boneIds.resize(count);
+    out.weights.resize(count);
+
+    int maxId = numBones > 0 ? (int)numBones - 1 : 0;
+
+    for (size_t v = 0; v < count; v++)
+    {
+        const VertexGPU& vertex = vertices[v];
+        out.positions[v] = glm::vec4(vertex.Position, 1.0f);
+        out.normals[v] = glm::vec4(vertex.Normal, 0.0f);
+        out.boneIds[v] = glm::clamp(vertex.BoneIDs, glm::ivec4(0), glm::ivec4(maxId));
+        out.weights[v] = vertex.Weights;
+    }
+}
+
+// ------------------------- KERNELS -------------------------
+
+typedef void (*SkinRangeFn)(const SkinningStreams& streams, const float* palette, float* out, size_t first, size_t last);
+
+// Plain glm, exactly what skinning.vs does, reference for the SIMD-versions
+static void SkinRangeScalar(const SkinningStreams& streams, const float* palette, float* out, size_t first, size_t last)
+{
+    const Affine3x4* bones = reinterpret_cast<const Affine3x4*>(palette);
+    SkinnedVertex* outVertices = reinterpret_cast<SkinnedVertex*>(out);
+
+    for (size_t v = first; v < last; v++)
+    {
+        const glm::ivec4& ids = streams.boneIds[v];
+        const glm::vec4& w = streams.weights[v];
+
+        glm::vec4 rows[3];
+        for (int r = 0; r < 3; r++)
+        {
+            rows[r] = w.x * bones[ids.x].rows[r] + w.y * bones[ids.y].rows[r]
+                + w.z * bones[ids.z].rows[r] + w.w * bones[ids.w].rows[r];
+        }
+
+        const glm::vec4& p = streams.positions[v];
+        const glm::vec4& n = streams.normals[v];
+        outVertices[v].Position = glm::vec3(glm::dot(rows[0], p), glm::dot(rows[1], p), glm::dot(rows[2], p));
+        outVertices[v].Normal = glm::vec3(glm::dot(rows[0], n), glm::dot(rows[1], n), glm::dot(rows[2], n));
+    }
+}
+
+// Writes position and normal (6 floats) of one SkinnedVertex
+static inline void StoreSkinnedVertex(float* out, __m128 position, __m128 normal)
+{
+    _mm_storeu_ps(out, position);                       // position.w lands on Normal.x, overwritten below
+    _mm_storel_pi((__m64*)(out + 3), normal);
+    _mm_store_ss(out + 5, _mm_movehl_ps(normal, normal));
+}
+
+static void SkinRangeSSE(const SkinningStreams& streams, const float* palette, float* out, size_t first, size_t last)
+{
+    const float* positions = &streams.positions[0].x;
+    const float* normals = &streams.normals[0].x;
+    const float* weights = &streams.weights[0].x;
+    const int* ids = &streams.boneIds[0].x;
+
+    for (size_t v = first; v < last; v++)
+    {
+        const float* m0 = palette + ids[v * 4 + 0] * 12;
+        const float* m1 = palette + ids[v * 4 + 1] * 12;
+        const float* m2 = palette + ids[v * 4 + 2] * 12;
+        const float* m3 = palette + ids[v * 4 + 3] * 12;
+
+        __m128 w = _mm_load_ps(weights + v * 4);
+        __m128 w0 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 w1 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 w2 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 2, 2));
+        __m128 w3 = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 3));
+
+        // Blended skin-matrix, row by row
+        __m128 r0 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(w0, _mm_load_ps(m0)), _mm_mul_ps(w1, _mm_load_ps(m1))),
+            _mm_add_ps(_mm_mul_ps(w2, _mm_load_ps(m2)), _mm_mul_ps(w3, _mm_load_ps(m3))));
+        __m128 r1 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(w0, _mm_load_ps(m0 + 4)), _mm_mul_ps(w1, _mm_load_ps(m1 + 4))),
+            _mm_add_ps(_mm_mul_ps(w2, _mm_load_ps(m2 + 4)), _mm_mul_ps(w3, _mm_load_ps(m3 + 4))));
+        __m128 r2 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(w0, _mm_load_ps(m0 + 8)), _mm_mul_ps(w1, _mm_load_ps(m1 + 8))),
+            _mm_add_ps(_mm_mul_ps(w2, _mm_load_ps(m2 + 8)), _mm_mul_ps(w3, _mm_load_ps(m3 + 8))));
+        __m128 r3 = _mm_setzero_ps();
+
+        // Rows -> columns, r3 becomes the translation
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        __m128 p = _mm_load_ps(positions + v * 4);
+        __m128 n = _mm_load_ps(normals + v * 4);
+
+        __m128 position = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(r0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(r1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)))),
+            _mm_add_ps(_mm_mul_ps(r2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))), r3));
+        __m128 normal = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(r0, _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(r1, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1)))),
+            _mm_mul_ps(r2, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2))));
+
+        StoreSkinnedVertex(out + v * 6, position, normal);
+    }
+}
+
+// Same as the SSE-version, rows 0 and 1 of each palette-entry are blended in one AVX-register with FMA
+SIMD_TARGET_AVX2 static void SkinRangeAVX(const SkinningStreams& streams, const float* palette, float* out, size_t first, size_t last)
+{
+    const float* positions = &streams.positions[0].x;
+    const float* normals = &streams.normals[0].x;
+    const float* weights = &streams.weights[0].x;
+    const int* ids = &streams.boneIds[0].x;
+
+    for (size_t v = first; v < last; v++)
+    {
+        const float* m0 = palette + ids[v * 4 + 0] * 12;
+        const float* m1 = palette + ids[v * 4 + 1] * 12;
+        const float* m2 = palette + ids[v * 4 + 2] * 12;
+        const float* m3 = palette + ids[v * 4 + 3] * 12;
+
+        __m256 w0 = _mm256_broadcast_ss(weights + v * 4 + 0);
+        __m256 w1 = _mm256_broadcast_ss(weights + v * 4 + 1);
+        __m256 w2 = _mm256_broadcast_ss(weights + v * 4 + 2);
+        __m256 w3 = _mm256_broadcast_ss(weights + v * 4 + 3);
+
+        // Rows 0-1 (palette-entries are only 16-byte aligned)
+        __m256 r01 = _mm256_mul_ps(w0, _mm256_loadu_ps(m0));
+        r01 = _mm256_fmadd_ps(w1, _mm256_loadu_ps(m1), r01);
+        r01 = _mm256_fmadd_ps(w2, _mm256_loadu_ps(m2), r01);
+        r01 = _mm256_fmadd_ps(w3, _mm256_loadu_ps(m3), r01);
+
+        // Row 2
+        __m128 r2 = _mm_mul_ps(_mm256_castps256_ps128(w0), _mm_load_ps(m0 + 8));
+        r2 = _mm_fmadd_ps(_mm256_castps256_ps128(w1), _mm_load_ps(m1 + 8), r2);
+        r2 = _mm_fmadd_ps(_mm256_castps256_ps128(w2), _mm_load_ps(m2 + 8), r2);
+        r2 = _mm_fmadd_ps(_mm256_castps256_ps128(w3), _mm_load_ps(m3 + 8), r2);
+
+        __m128 r0 = _mm256_castps256_ps128(r01);
+        __m128 r1 = _mm256_extractf128_ps(r01, 1);
+        __m128 r3 = _mm_setzero_ps();
+
+        // Rows -> columns, r3 becomes the translation
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        __m128 position = _mm_fmadd_ps(r0, _mm_broadcast_ss(positions + v * 4 + 0), r3);
+        position = _mm_fmadd_ps(r1, _mm_broadcast_ss(positions + v * 4 + 1), position);
+        position = _mm_fmadd_ps(r2, _mm_broadcast_ss(positions + v * 4 + 2), position);
+
+        __m128 normal = _mm_mul_ps(r0, _mm_broadcast_ss(normals + v * 4 + 0));
+        normal = _mm_fmadd_ps(r1, _mm_broadcast_ss(normals + v * 4 + 1), normal);
+        normal = _mm_fmadd_ps(r2, _mm_broadcast_ss(normals + v * 4 + 2), normal);
+
+        StoreSkinnedVertex(out + v * 6, position, normal);
+    }
+}
+
+// Runs a kernel over all vertices, split in chunks over the pool when there is enough work
+static void RunSkinning(SkinRangeFn kernel, const SkinningStreams& streams, const Affine3x4* palette, SkinnedVertex* out,
+    ThreadPool* pool, size_t minChunk)
+{
+    const float* bones = &palette[0].rows[0][0];
+    float* outFloats = &out[0].Position.x;
+    size_t count = streams.Size();
+
+    if (!pool || pool->GetThreadCount() < 2 || count < 2 * minChunk)
+    {
+        kernel(streams, bones, outFloats, 0, count);
+        return;
+    }
+
+    pool->ParallelFor(count, minChunk, [&](size_t first, size_t last) {
+        kernel(streams, bones, outFloats, first, last);
+    });
+}
+
+void SkinVertices(const SkinningStreams& streams, const Affine3x4* palette, SkinnedVertex* out,
+    ThreadPool* pool, size_t minChunk)
+{
+    if (streams.Size() == 0 || !palette || !out)
+        return;
+
+    RunSkinning(CpuSupportsAVX2() ? SkinRangeAVX : SkinRangeSSE, streams, palette, out, pool, minChunk);
+}
+
+// ------------------------- BENCHMARK -------------------------
+
+// Random mesh where every vertex has 1-4 influences out of numBones, and a random palette for it
+static void MakeSkinningBenchMesh(size_t numVertices, size_t numBones, std::mt19937& rng,
+    SkinningStreams& outStreams, AlignedVector<Affine3x4>& outPalette)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> bone(0, (int)numBones - 1);
+    std::uniform_int_distribution<int> influences(1, 4);
+
+    outPalette.resize(numBones);
+    for (Affine3x4& entry : outPalette)
+    {
+        glm::quat q = glm::normalize(glm::quat(unit(rng), unit(rng), unit(rng), unit(rng)));
+        entry = AffineFromTRS(glm::vec3(unit(rng), unit(rng), unit(rng)), q, glm::vec3(1.0f));
+    }
+
+    std::vector<VertexGPU> vertices(numVertices);
+    for (VertexGPU& vertex : vertices)
+    {
+        vertex.Position = glm::vec3(unit(rng), unit(rng), unit(rng));
+        vertex.Normal = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 2.0f));
+
+        int count = influences(rng);
+        float sum = 0.0f;
+        for (int k = 0; k < 4; k++)
+        {
+            vertex.BoneIDs[k] = k < count ? bone(rng) : 0;
+            vertex.Weights[k] = k < count ? unit(rng) * 0.5f + 0.6f : 0.0f;
+            sum += vertex.Weights[k];
+        }
+        vertex.Weights /= sum;
+    }
+
+    BuildSkinningStreams(vertices.data(), vertices.size(), numBones, outStreams);
+}
+
+// Largest distance between the positions/normals of two outputs
+static float MaxSkinningError(const std::vector<SkinnedVertex>& a, const std::vector<SkinnedVertex>& b)
+{
+    float maxError = 0.0f;
+    for (size_t v = 0; v < a.size(); v++)
+    {
+        maxError = std::max(maxError, glm::length(a[v].Position - b[v].Position));
+        maxError = std::max(maxError, glm::length(a[v].Normal - b[v].Normal));
+    }
+    return maxError;
+}
+
+void BenchmarkCpuSkinning(const char* meshName, const VertexGPU* vertices, size_t vertexCount,
+    const Affine3x4* palette, size_t numBones, ThreadPool& pool)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    std::mt19937 rng(2468);
+
+    struct BenchMesh
+    {
+        std::string name;
+        SkinningStreams streams;
+        AlignedVector<Affine3x4> palette;
+    };
+
+    std::vector<BenchMesh> meshes(2);
+    meshes[0].name = meshName;
+    BuildSkinningStreams(vertices, vertexCount, numBones, meshes[0].streams);
+    meshes[0].palette.assign(palette, palette + numBones);
+
+    meshes[1].name = "synthetic 1M";
+    MakeSkinningBenchMesh(1000000, 64, rng, meshes[1].streams, meshes[1].palette);
+
+    struct Kernel { const char* name; SkinRangeFn fn; };
+    std::vector<Kernel> kernels = { { "scalar", SkinRangeScalar }, { "SSE", SkinRangeSSE } };
+    if (CpuSupportsAVX2())
+        kernels.push_back({ "AVX2", SkinRangeAVX });
+
+    unsigned int threads = pool.GetThreadCount();
+
+    printf("\n**************************************************\n");
+    printf("CPU skinning: 4 influences, position + normal (Mverts/s = million vertices per second)\n\n");
+    printf("%-24s %10s %8s %14s %16s %14s %12s\n", "Mesh", "Vertices", "Kernel",
+        "1 thread", "all threads", "per core", "Max error");
+
+    for (BenchMesh& mesh : meshes)
+    {
+        size_t count = mesh.streams.Size();
+        if (count == 0 || mesh.palette.empty())
+            continue;
+
+        // Enough repeats for ~4M vertices per measurement, small meshes are too fast to time once
+        int repeats = (int)std::max<size_t>(1, 4000000 / count);
+
+        // Smaller chunks for small meshes, otherwise they would never be split over the threads
+        size_t chunk = std::min<size_t>(SKINNING_CHUNK_SIZE, std::max<size_t>(256, count / threads));
+
+        std::vector<SkinnedVertex> reference(count);
+        std::vector<SkinnedVertex> output(count);
+        SkinRangeScalar(mesh.streams, &mesh.palette[0].rows[0][0], &reference[0].Position.x, 0, count);
+
+        for (const Kernel& kernel : kernels)
+        {
+            double rates[2];
+            for (int multi = 0; multi < 2; multi++)
+            {
+                ThreadPool* runPool = multi ? &pool : nullptr;
+
+                RunSkinning(kernel.fn, mesh.streams, mesh.palette.data(), output.data(), runPool, chunk);   // Warm-up
+
+                auto t0 = Clock::now();
+                for (int r = 0; r < repeats; r++)
+                    RunSkinning(kernel.fn, mesh.streams, mesh.palette.data(), output.data(), runPool, chunk);
+                auto t1 = Clock::now();
+
+                double seconds = std::chrono::duration<double>(t1 - t0).count();
+                rates[multi] = (double)count * repeats / seconds / 1e6;
+            }
+
+            printf("%-24s %10zu %8s %9.1f Mv/s %8.1f Mv/s (%2u) %9.1f Mv/s %12.2e\n",
+                mesh.name.c_str(), count, kernel.name, rates[0], rates[1], threads,
+                rates[1] / threads, MaxSkinningError(reference, output));
+        }
+    }
+    printf("\n");
+}
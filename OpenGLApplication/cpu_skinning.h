@@ -0,0 +1,54 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "affine.h"
+#include "simd.h"
+#include "vertex.h"
+
+class ThreadPool;
+
+/*
+* Skinning on the CPU, same math as skinning.vs: the 4 weighted
+* bone-matrices of a vertex are blended into one 3x4 matrix which
+* then transforms the position (w = 1) and the normal (w = 0).
+*
+* Used when there is no GPU (headless), or when someone on the CPU
+* needs the skinned mesh (collision, exports...). The input is split into
+* one stream per attribute so every load is a single aligned 16-byte load,
+* blending uses SSE or AVX2/FMA when the CPU has it, and vertex-ranges
+* are spread over worker-threads.
+*/
+
+#define SKINNING_CHUNK_SIZE 4096    // Nr of vertices per work-item when skinning on several threads
+
+// Output of the skinning, also the vertex-layout of the streaming VBO
+struct SkinnedVertex
+{
+    glm::vec3 Position;
+    glm::vec3 Normal;
+};
+
+// Bind-pose vertices split into one stream per attribute (SoA), built once per model
+struct SkinningStreams
+{
+    AlignedVector<glm::vec4> positions;     // w = 1 so the translation is picked up
+    AlignedVector<glm::vec4> normals;       // w = 0
+    AlignedVector<glm::ivec4> boneIds;      // Always inside the palette
+    AlignedVector<glm::vec4> weights;
+
+    size_t Size() const { return positions.size(); }
+};
+
+// Splits the vertices into streams, bone-ids outside [0, numBones) are clamped (their weight is normally 0 anyway)
+void BuildSkinningStreams(const VertexGPU* vertices, size_t count, size_t numBones, SkinningStreams& out);
+
+// out[i] = vertex i skinned by palette (the final bone-matrices, see ComputePosePalette).
+// out may be write-combined memory (a mapped VBO), it is only written, in order.
+// Ranges of at least minChunk vertices are split over the pool (nullptr = single thread)
+void SkinVertices(const SkinningStreams& streams, const Affine3x4* palette, SkinnedVertex* out,
+    ThreadPool* pool = nullptr, size_t minChunk = SKINNING_CHUNK_SIZE);
+
+// Times scalar/SSE/AVX2 skinning on the given mesh and on a synthetic 1M-vertex mesh,
+// single-threaded and on all threads of the pool, and prints vertices/second (per core)
+void BenchmarkCpuSkinning(const char* meshName, const VertexGPU* vertices, size_t vertexCount,
+    const Affine3x4* palette, size_t numBones, ThreadPool& pool);
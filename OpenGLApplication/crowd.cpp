@@ -0,0 +1,177 @@
+#include "crowd.h"
+#include "shader.h"
+#include "shader_library.h"
+#include "skeleton_pose.h"
+#include "thread_pool.h"
+#include "gl_state.h"
+#include "render_queue.h"
+
+#include <glew.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+
+/*
+* Instanced crowd of one skinned mesh.
+*
+* Instances are animated on the worker-threads, each one writes its own
+* slice of the shared palette so no two threads touch the same memory.
+* Only bones that changed are rewritten (see ComputePosePalette), a crowd
+* standing still costs next to nothing on the CPU.
+*/
+
+#define CROWD_UPDATE_CHUNK 16   // Instances per work-item when animating the crowd
+
+// ------------------------- SETUP -------------------------
+
+bool Crowd::Create(const SkeletonDesc& desc, const CompressedClip* clip, size_t numInstances, float spacing,
+    unsigned int vertexBuffer, unsigned int indexBuffer, void (*setVertexAttributes)(), const std::string& vertexDefines,
+    ShaderLibrary& library)
+{
+    Destroy();
+
+    if (numInstances == 0 || desc.bones.empty())
+        return false;
+
+    numBones = desc.bones.size();
+
+    // Poses and players, each instance starts somewhere else in the clip and plays a bit faster or slower
+    poses.resize(numInstances);
+    players.resize(numInstances);
+    for (size_t i = 0; i < numInstances; i++)
+    {
+        InitSkeletonPose(poses[i], desc);
+
+        if (clip)
+        {
+            float phase = fmodf(i * 0.618034f, 1.0f);
+            players[i].Play(clip);
+            players[i].SetSpeed(0.8f + 0.4f * phase);
+            players[i].Advance(clip->duration * phase);
+        }
+    }
+
+    // All palettes in one buffer, always a texture-buffer since crowds quickly outgrow a uniform-block
+    if (!palette.Create(numInstances * numBones, CROWD_PALETTE_TEXTURE_UNIT, true))
+    {
+        Destroy();
+        return false;
+    }
+
+    // Same permutation for every crowd of this model, the library builds it once and keeps it
+    shader = library.Get("skinning.vs", "skinning.fs", palette.GetShaderDefines() + "#define INSTANCED\n" + vertexDefines);
+    palette.BindToShader(*shader);
+
+    // Square grid around the origin, turned a bit per instance
+    std::vector<CrowdInstanceGPU> instances(numInstances);
+    size_t side = (size_t)ceil(sqrt((double)numInstances));
+    for (size_t i = 0; i < numInstances; i++)
+    {
+        float x = ((float)(i % side) - 0.5f * (side - 1)) * spacing;
+        float z = ((float)(i / side) - 0.5f * (side - 1)) * spacing;
+
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+        instances[i].Model = glm::rotate(model, i * 2.4f, glm::vec3(0.0f, 1.0f, 0.0f));
+        instances[i].PaletteOffset = (int)(i * numBones);
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &instanceBuffer);
+
+    BindVertexArray(vao);
+
+    // Mesh, same attributes as the single model
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+    setVertexAttributes();
+
+    // Instances, one step per instance instead of per vertex
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(CrowdInstanceGPU), instances.data(), GL_STATIC_DRAW);
+
+    // Model-matrix, one column per location
+    for (int c = 0; c < 4; c++)
+    {
+        glVertexAttribPointer(6 + c, 4, GL_FLOAT, GL_FALSE, sizeof(CrowdInstanceGPU),
+            (void*)(offsetof(CrowdInstanceGPU, Model) + c * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(6 + c);
+        glVertexAttribDivisor(6 + c, 1);
+    }
+
+    // Palette-offset (integer attribute!)
+    glVertexAttribIPointer(10, 1, GL_INT, sizeof(CrowdInstanceGPU), (void*)offsetof(CrowdInstanceGPU, PaletteOffset));
+    glEnableVertexAttribArray(10);
+    glVertexAttribDivisor(10, 1);
+
+    BindVertexArray(0);
+
+    printf("Crowd: %zu instances x %zu bones\n", numInstances, numBones);
+    return true;
+}
+
+void Crowd::Destroy()
+{
+    palette.Destroy();
+
+    shader = nullptr;   // Owned by the library
+
+    if (instanceBuffer)
+        glDeleteBuffers(1, &instanceBuffer);
+    if (vao) {
+        ForgetVertexArray(vao);
+        glDeleteVertexArrays(1, &vao);
+    }
+    instanceBuffer = vao = 0;
+
+    poses.clear();
+    players.clear();
+    numBones = 0;
+}
+
+// ------------------------- PER FRAME -------------------------
+
+void Crowd::Update(float deltaTime, ThreadPool* pool)
+{
+    Affine3x4* out = palette.BeginFrame();
+    if (!out)
+        return;
+
+    unsigned int copies = palette.GetCopyCount();
+
+    // Each instance only touches its own pose, player and palette-slice
+    auto animate = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+        {
+            if (players[i].IsPlaying())
+                players[i].Update(deltaTime, poses[i]);
+            ComputePosePalette(poses[i], out + i * numBones, copies);
+        }
+    };
+
+    if (pool && poses.size() > CROWD_UPDATE_CHUNK)
+        pool->ParallelFor(poses.size(), CROWD_UPDATE_CHUNK, animate);
+    else
+        animate(0, poses.size());
+
+    palette.EndWrite();
+}
+
+void Crowd::Submit(RenderQueue& queue, int indexCount) const
+{
+    if (!vao)
+        return;
+
+    DrawCommand command;
+    command.shader = shader;
+    command.vao = vao;
+    command.count = indexCount;
+    command.instanceCount = (int)poses.size();
+    queue.Submit(RENDER_PASS_CROWD, command);
+}
+
+void Crowd::EndFrame()
+{
+    palette.EndFrame();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "animation.h"
+#include "bone_palette_buffer.h"
+#include "skeleton.h"
+
+class Shader;
+class ShaderLibrary;
+class ThreadPool;
+class RenderQueue;
+
+/*
+* Many copies of one skinned mesh drawn with a single instanced draw.
+*
+* Every instance has its own pose and clip-player (started at a different
+* time) and writes its palette into one shared texture-buffer, instance i
+* owns bones [i * numBones, (i + 1) * numBones). The model-matrix and that
+* palette-offset are per-instance vertex-attributes, so the whole crowd is
+* one glDrawElementsInstanced.
+*/
+
+// Per-instance vertex-attributes (divisor 1)
+struct CrowdInstanceGPU
+{
+    glm::mat4 Model;        // Locations 6-9
+    int PaletteOffset;      // Location 10
+    int Padding[3];
+};
+
+class Crowd
+{
+public:
+    Crowd() = default;
+
+    Crowd(const Crowd&) = delete;
+    Crowd& operator=(const Crowd&) = delete;
+
+    // numInstances copies of the mesh in vertexBuffer/indexBuffer on a grid with spacing units between them.
+    // setVertexAttributes sets up locations 0-3 (0-5) for vertexBuffer's layout, vertexDefines tell skinning.vs about it
+    // (NUM_INFLUENCES, PACKED_VERTICES...). clip may be nullptr (instances then stay in bind pose). Needs a current GL-context.
+    // The instanced skinning-program is taken from library, which owns it
+    bool Create(const SkeletonDesc& desc, const CompressedClip* clip, size_t numInstances, float spacing,
+        unsigned int vertexBuffer, unsigned int indexBuffer, void (*setVertexAttributes)(), const std::string& vertexDefines,
+        ShaderLibrary& library);
+
+    // Frees GL-objects and poses (not the program), must be called while the context is still alive
+    void Destroy();
+
+    // Advances every instance and writes all palettes into this frame's copy of the shared buffer, instances are split over the pool
+    void Update(float deltaTime, ThreadPool* pool);
+
+    // Adds one instanced draw of indexCount indices per instance to queue, camera from the FrameConstants block (see frame_constants.h)
+    void Submit(RenderQueue& queue, int indexCount) const;
+
+    // Call after the last draw reading this frame's palettes
+    void EndFrame();
+
+    size_t GetInstanceCount() const { return poses.size(); }
+
+private:
+    std::vector<SkeletonPose> poses;
+    std::vector<AnimationPlayer> players;
+    BonePaletteBuffer palette;
+    Shader* shader = nullptr;       // Owned by the ShaderLibrary passed to Create()
+
+    unsigned int vao = 0;
+    unsigned int instanceBuffer = 0;
+    size_t numBones = 0;
+};
@@ -2,9 +2,9 @@
 
 layout (location = 0) in vec3 aPosition;
 
-uniform mat4 MVP;
+#include "frame_constants.glsl"
 
 void main()
 {
-    gl_Position = MVP * vec4(aPosition, 1.0);
+    gl_Position = uModelViewProjection * vec4(aPosition, 1.0);
 }
\ No newline at end of file
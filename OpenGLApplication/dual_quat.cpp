@@ -0,0 +1,98 @@
+#include "dual_quat.h"
+#include "thread_pool.h"
+
+#include <cmath>
+
+/*
+* Affine bone-matrix <-> unit dual quaternion.
+*
+* The basis of the matrix is normalized column by column before the
+* rotation is extracted, so a uniformly scaled bone still gets the right
+* rotation (the scale itself is lost). Mirrored bases flip one axis first.
+*/
+
+// ------------------------- CONVERSION -------------------------
+
+// Rotation-part of the matrix (columns normalized) and its translation
+static void SplitRigid(const Affine3x4& a, glm::quat& outRotation, glm::vec3& outTranslation)
+{
+    glm::mat3 basis;
+    for (int c = 0; c < 3; c++)
+    {
+        basis[c] = glm::vec3(a.rows[0][c], a.rows[1][c], a.rows[2][c]);
+        float length = glm::length(basis[c]);
+        if (length > 0.0f)
+            basis[c] /= length;
+    }
+
+    if (glm::determinant(basis) < 0.0f)
+        basis[0] = -basis[0];
+
+    outRotation = glm::normalize(glm::quat_cast(basis));
+    outTranslation = a.GetTranslation();
+}
+
+DualQuat DualQuatFromAffine(const Affine3x4& a)
+{
+    glm::quat q;
+    glm::vec3 t;
+    SplitRigid(a, q, t);
+
+    // dual = 0.5 * (t, 0) * q
+    glm::vec3 v(q.x, q.y, q.z);
+    glm::vec3 dualVector = 0.5f * (q.w * t + glm::cross(t, v));
+
+    DualQuat dq;
+    dq.real = glm::vec4(q.x, q.y, q.z, q.w);
+    dq.dual = glm::vec4(dualVector, -0.5f * glm::dot(t, v));
+    return dq;
+}
+
+Affine3x4 DualQuatToAffine(const DualQuat& dq)
+{
+    glm::vec3 r(dq.real), d(dq.dual);
+
+    // translation = 2 * dual * conjugate(real)
+    glm::vec3 t = 2.0f * (dq.real.w * d - dq.dual.w * r + glm::cross(r, d));
+
+    return AffineFromTRS(t, glm::quat(dq.real.w, dq.real.x, dq.real.y, dq.real.z), glm::vec3(1.0f));
+}
+
+void ConvertPaletteToDualQuat(const Affine3x4* palette, DualQuat* outPalette, size_t count, ThreadPool* pool)
+{
+    auto convertRange = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+            outPalette[i] = DualQuatFromAffine(palette[i]);
+    };
+
+    if (!pool || pool->GetThreadCount() < 2 || count < 2 * DUAL_QUAT_CHUNK_SIZE)
+        convertRange(0, count);
+    else
+        pool->ParallelFor(count, DUAL_QUAT_CHUNK_SIZE, convertRange);
+}
+
+// ------------------------- CHECKS -------------------------
+
+size_t CountNonRigidBones(const Affine3x4* palette, size_t count)
+{
+    size_t nonRigid = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat3 basis;
+        for (int c = 0; c < 3; c++)
+            basis[c] = glm::vec3(palette[i].rows[0][c], palette[i].rows[1][c], palette[i].rows[2][c]);
+
+        // Rigid = orthonormal columns and no mirroring
+        bool rigid = glm::determinant(basis) > 0.0f;
+        for (int c = 0; c < 3 && rigid; c++)
+        {
+            rigid = fabsf(glm::length(basis[c]) - 1.0f) <= DUAL_QUAT_SCALE_TOLERANCE;
+            for (int o = c + 1; o < 3 && rigid; o++)
+                rigid = fabsf(glm::dot(basis[c], basis[o])) <= DUAL_QUAT_SCALE_TOLERANCE;
+        }
+
+        if (!rigid)
+            nonRigid++;
+    }
+    return nonRigid;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "affine.h"
+
+class ThreadPool;
+
+/*
+* Dual-quaternion palette for dual-quaternion skinning (DUAL_QUAT_SKINNING in skinning.vs).
+*
+* Every final bone-matrix (see ComputePosePalette) is turned into a unit
+* dual quaternion: rotation + translation in 8 floats, 32 instead of 48
+* bytes per bone. The vertex-shader blends the dual quaternions instead of
+* the matrices, which keeps the volume at twisting joints (no "candy-wrapper").
+*
+* Dual quaternions are rigid, scale/shear of a bone-matrix is dropped.
+*/
+
+#define DUAL_QUAT_CHUNK_SIZE 256            // Nr of bones per work-item when converting on several threads
+#define DUAL_QUAT_SCALE_TOLERANCE 0.01f     // Scale-deviation from 1 before a bone counts as non-rigid
+
+// Unit dual quaternion, real = rotation (x, y, z, w), dual = 0.5 * (translation, 0) * real.
+// Read as a mat2x4 (column 0 = real, column 1 = dual) by the shaders
+struct alignas(16) DualQuat
+{
+    glm::vec4 real = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec4 dual = glm::vec4(0.0f);
+};
+
+// Rigid part of an affine bone-matrix
+DualQuat DualQuatFromAffine(const Affine3x4& a);
+
+// Back to a matrix (rotation + translation only)
+Affine3x4 DualQuatToAffine(const DualQuat& dq);
+
+// outPalette[i] = DualQuatFromAffine(palette[i]), large palettes are split over the pool (nullptr = single thread).
+// outPalette may be write-combined memory (a mapped buffer), it is only written, in order
+void ConvertPaletteToDualQuat(const Affine3x4* palette, DualQuat* outPalette, size_t count, ThreadPool* pool = nullptr);
+
+// Nr of bone-matrices with scale, shear or mirroring (more than DUAL_QUAT_SCALE_TOLERANCE), these are only approximated by DQS
+size_t CountNonRigidBones(const Affine3x4* palette, size_t count);
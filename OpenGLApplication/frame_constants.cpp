@@ -0,0 +1,185 @@
+#include "frame_constants.h"
+#include <glew.h>
+#include <cstring>
+#include <iostream>
+
+/*
+* Per-frame/per-draw constant-buffer.
+*
+* Every copy is [FrameConstants][DrawConstants x maxDraws], each
+* part starting on GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so it can be bound as
+* a range. Buffer-calls go through GL_COPY_WRITE_BUFFER like BonePaletteBuffer.
+*/
+
+static size_t AlignUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// ------------------------- SETUP -------------------------
+
+bool FrameConstantBuffer::Create()
+{
+    Destroy();
+    return Allocate();
+}
+
+bool FrameConstantBuffer::Allocate()
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+    frameSize = AlignUp(sizeof(FrameConstants), alignment);
+    drawSize = AlignUp(sizeof(DrawConstants), alignment);
+    copySize = frameSize + drawSize * maxDraws;
+
+    size_t totalSize = copySize * NUM_COPIES;
+    persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, nullptr, flags);
+        persistentPtr = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+
+        if (!persistentPtr) {
+            std::cerr << "Could not persistently map frame-constant buffer\n";
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            Destroy();
+            return false;
+        }
+    }
+    else
+        glBufferData(GL_COPY_WRITE_BUFFER, totalSize, nullptr, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+}
+
+void FrameConstantBuffer::Destroy()
+{
+    for (void*& fence : fences)
+    {
+        if (fence)
+            glDeleteSync((GLsync)fence);
+        fence = nullptr;
+    }
+
+    if (buffer)
+    {
+        if (persistentPtr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    buffer = 0;
+    persistentPtr = nullptr;
+    frameSize = drawSize = copySize = 0;
+    current = 0;
+    drawCount = 0;
+    inFrame = false;
+    persistent = false;
+}
+
+// ------------------------- PER FRAME -------------------------
+
+void FrameConstantBuffer::Write(size_t offset, const void* data, size_t size)
+{
+    if (persistent)
+        memcpy((char*)persistentPtr + offset, data, size);
+    else
+    {
+        // The fence already guarantees the GPU is done with this copy
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+void FrameConstantBuffer::BeginFrame(const FrameConstants& constants)
+{
+    if (!buffer)
+        return;
+
+    current = (current + 1) % NUM_COPIES;
+    drawCount = 0;
+
+    // Wait for the frame that last read this copy, normally already done since it was NUM_COPIES - 1 frames ago
+    if (fences[current])
+    {
+        GLsync fence = (GLsync)fences[current];
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);   // 1 ms
+
+        glDeleteSync(fence);
+        fences[current] = nullptr;
+    }
+
+    frame = constants;
+    inFrame = true;
+
+    size_t offset = current * copySize;
+    Write(offset, &constants, sizeof(FrameConstants));
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, buffer, offset, sizeof(FrameConstants));
+}
+
+void FrameConstantBuffer::ReserveDraws(size_t count)
+{
+    if (!buffer || drawCount + count <= maxDraws)
+        return;
+
+    size_t needed = drawCount + count;
+    while (maxDraws < needed)
+        maxDraws *= 2;
+
+    // Draws already issued keep reading the old buffer, GL frees it once they are done
+    bool wasInFrame = inFrame;
+    Destroy();
+    if (!Allocate()) {
+        std::cerr << "Could not grow frame-constant buffer to " << maxDraws << " draws\n";
+        return;
+    }
+
+    // Fresh buffer, the frame continues in copy 0 with its constants written again
+    if (wasInFrame)
+    {
+        inFrame = true;
+        Write(0, &frame, sizeof(FrameConstants));
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, buffer, 0, sizeof(FrameConstants));
+    }
+}
+
+void FrameConstantBuffer::SetDraw(const glm::mat4& model, int instanceOffset)
+{
+    // Not reserved, grows here (the next frames start large enough)
+    ReserveDraws(1);
+    if (!buffer)
+        return;
+
+    DrawConstants constants;
+    constants.model = model;
+    constants.modelViewProjection = frame.viewProjection * model;
+    constants.instanceOffset = instanceOffset;
+
+    size_t offset = current * copySize + frameSize + drawCount * drawSize;
+    Write(offset, &constants, sizeof(DrawConstants));
+    glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_CONSTANTS_BINDING, buffer, offset, sizeof(DrawConstants));
+
+    drawCount++;
+}
+
+void FrameConstantBuffer::EndFrame()
+{
+    if (!buffer)
+        return;
+
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    inFrame = false;
+}
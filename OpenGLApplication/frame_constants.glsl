@@ -0,0 +1,19 @@
+// Constants shared by every drawing shader, see frame_constants.h (the std140 layouts must match)
+
+// Written once per frame
+layout (std140) uniform FrameConstants
+{
+    mat4 uViewProjection;
+    vec4 uLightDir;         // xyz = world-space direction the light shines in
+    vec4 uViewPos;          // xyz = camera position
+    int uSelectedBone;      // Bone highlighted by the weight-visualization
+    float uTime;            // Seconds since start
+};
+
+// Written once per draw
+layout (std140) uniform DrawConstants
+{
+    mat4 uModel;
+    mat4 uModelViewProjection;
+    int uInstanceOffset;    // First instance of the draw in shared instance-data
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <glm/glm.hpp>
+
+/*
+* Per-frame and per-draw constants shared by every drawing shader
+* (frame_constants.glsl, pulled in with #include, see Shader).
+*
+* FrameConstants (camera, light, selected bone...) is written once per frame,
+* DrawConstants (model-matrix, MVP, instance-offset) once per draw into its own
+* slot, instead of uploading the same uniforms into every program. Both live in
+* one buffer with NUM_COPIES copies used round-robin, a fence per copy makes
+* sure a copy is never overwritten while the GPU still reads it. The draw-slots
+* grow with the frames, RenderQueue reserves one per queued draw up front.
+*
+* With ARB_buffer_storage the buffer is mapped once (persistent + coherent),
+* otherwise every write is a glBufferSubData into the free copy.
+*
+* Shader binds the blocks of every program to FRAME_CONSTANTS_BINDING and
+* DRAW_CONSTANTS_BINDING when it is linked, nothing to do per program.
+*/
+
+#define FRAME_CONSTANTS_BINDING 1       // Uniform-block binding point of FrameConstants (BONE_PALETTE_BINDING is 0)
+#define DRAW_CONSTANTS_BINDING 2        // Uniform-block binding point of DrawConstants
+#define DEFAULT_DRAWS_PER_FRAME 64      // DrawConstants-slots per copy at first, doubled whenever a frame needs more
+
+// std140 layout of the FrameConstants block
+struct FrameConstants
+{
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::vec4 lightDir = glm::vec4(0.0f, -1.0f, 0.0f, 0.0f);    // xyz = world-space direction the light shines in
+    glm::vec4 viewPos = glm::vec4(0.0f);                        // xyz = camera position
+    int selectedBone = 0;                                       // Bone highlighted by the weight-visualization
+    float time = 0.0f;                                          // Seconds since start
+    int padding[2] = {};
+};
+
+// std140 layout of the DrawConstants block
+struct DrawConstants
+{
+    glm::mat4 model = glm::mat4(1.0f);
+    glm::mat4 modelViewProjection = glm::mat4(1.0f);
+    int instanceOffset = 0;                                     // First instance of the draw in shared instance-data
+    int padding[3] = {};
+};
+
+class FrameConstantBuffer
+{
+public:
+    static const unsigned int NUM_COPIES = 3;
+
+    FrameConstantBuffer() = default;
+
+    FrameConstantBuffer(const FrameConstantBuffer&) = delete;
+    FrameConstantBuffer& operator=(const FrameConstantBuffer&) = delete;
+
+    // Creates the buffer, needs a current GL-context
+    bool Create();
+
+    // Frees the buffer and fences, must be called while the context is still alive
+    void Destroy();
+
+    // Waits until the GPU is done with the next copy, writes the frame's constants and binds them to FRAME_CONSTANTS_BINDING
+    void BeginFrame(const FrameConstants& constants);
+
+    // Makes room for count more draws this frame. Growing recreates the buffer, so reserve before the draws when possible
+    void ReserveDraws(size_t count);
+
+    // Writes the constants of the next draw (MVP from this frame's viewProjection) and binds them to DRAW_CONSTANTS_BINDING
+    void SetDraw(const glm::mat4& model, int instanceOffset = 0);
+
+    // Call after the last draw of the frame
+    void EndFrame();
+
+    bool IsPersistent() const { return persistent; }
+    size_t GetMaxDraws() const { return maxDraws; }
+
+private:
+    bool Allocate();
+    void Write(size_t offset, const void* data, size_t size);
+
+    unsigned int buffer = 0;
+    void* fences[NUM_COPIES] = {};      // GLsync of the last frame that used each copy
+    void* persistentPtr = nullptr;      // Start of the whole buffer when persistently mapped
+
+    size_t frameSize = 0;               // sizeof(FrameConstants) rounded up to the offset-alignment
+    size_t drawSize = 0;                // sizeof(DrawConstants) rounded up to the offset-alignment
+    size_t copySize = 0;                // frameSize + maxDraws draw-slots
+    size_t maxDraws = DEFAULT_DRAWS_PER_FRAME;
+
+    FrameConstants frame;               // This frame's constants, written again when the buffer grows mid-frame
+    unsigned int current = 0;           // Copy used this frame
+    size_t drawCount = 0;               // Draw-slots used this frame
+    bool inFrame = false;               // Between BeginFrame() and EndFrame()
+    bool persistent = false;
+};
@@ -0,0 +1,111 @@
+#include "gl_state.h"
+#include <glew.h>
+#include <cstdio>
+
+/*
+* Redundant-state elimination for program- and vertex-array-bindings.
+*
+* GL-calls may only come from the thread owning the context, so the
+* tracked state is plain file-scope data.
+*/
+
+#define UNKNOWN_BINDING 0xFFFFFFFFu     // Not a valid GL-name, the next bind always goes through
+
+static unsigned int gBoundProgram = UNKNOWN_BINDING;
+static unsigned int gBoundVertexArray = UNKNOWN_BINDING;
+
+static GLCallCounts gFrameCounts;       // Current frame
+static GLCallCounts gWindowCounts;      // Frames since the last report
+static unsigned int gWindowFrames = 0;
+static float gWindowStart = 0.0f;
+
+// ------------------------- BINDINGS -------------------------
+
+void UseProgram(unsigned int program)
+{
+    if (program == gBoundProgram) {
+        gFrameCounts.programBindsSkipped++;
+        return;
+    }
+
+    glUseProgram(program);
+    gBoundProgram = program;
+    gFrameCounts.programBinds++;
+}
+
+void BindVertexArray(unsigned int vao)
+{
+    if (vao == gBoundVertexArray) {
+        gFrameCounts.vertexArrayBindsSkipped++;
+        return;
+    }
+
+    glBindVertexArray(vao);
+    gBoundVertexArray = vao;
+    gFrameCounts.vertexArrayBinds++;
+}
+
+void ForgetVertexArray(unsigned int vao)
+{
+    if (vao == gBoundVertexArray)
+        gBoundVertexArray = 0;
+}
+
+void InvalidateGLState()
+{
+    gBoundProgram = UNKNOWN_BINDING;
+    gBoundVertexArray = UNKNOWN_BINDING;
+}
+
+// ------------------------- UPDATES -------------------------
+
+void UpdateBuffer(unsigned int buffer, size_t offset, size_t size, const void* data)
+{
+    if (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access) {
+        glNamedBufferSubData(buffer, (GLintptr)offset, (GLsizeiptr)size, data);
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)offset, (GLsizeiptr)size, data);
+}
+
+// ------------------------- COUNTERS -------------------------
+
+GLCallCounts& GetGLCallCounts()
+{
+    return gFrameCounts;
+}
+
+void EndGLCallFrame()
+{
+    gWindowCounts.programBinds += gFrameCounts.programBinds;
+    gWindowCounts.programBindsSkipped += gFrameCounts.programBindsSkipped;
+    gWindowCounts.vertexArrayBinds += gFrameCounts.vertexArrayBinds;
+    gWindowCounts.vertexArrayBindsSkipped += gFrameCounts.vertexArrayBindsSkipped;
+    gWindowCounts.uniformUploads += gFrameCounts.uniformUploads;
+    gWindowCounts.uniformUploadsSkipped += gFrameCounts.uniformUploadsSkipped;
+    gWindowCounts.uniformLookups += gFrameCounts.uniformLookups;
+    gWindowFrames++;
+
+    gFrameCounts = GLCallCounts();
+}
+
+void ReportGLCalls(float currentTime)
+{
+    if (currentTime - gWindowStart < 1.0f || gWindowFrames == 0)
+        return;
+
+    double frames = gWindowFrames;
+    const GLCallCounts& c = gWindowCounts;
+    printf("GL-calls per frame: %.1f issued, %.1f skipped | programs %.1f (%.1f skipped) | vertex-arrays %.1f (%.1f skipped) | uniforms %.1f (%.1f skipped) | lookups %.1f\n",
+        c.Issued() / frames, c.Skipped() / frames,
+        c.programBinds / frames, c.programBindsSkipped / frames,
+        c.vertexArrayBinds / frames, c.vertexArrayBindsSkipped / frames,
+        c.uniformUploads / frames, c.uniformUploadsSkipped / frames,
+        c.uniformLookups / frames);
+
+    gWindowCounts = GLCallCounts();
+    gWindowFrames = 0;
+    gWindowStart = currentTime;
+}
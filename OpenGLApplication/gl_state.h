@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+
+/*
+* Tracks the GL-bindings that change many times per frame (program and
+* vertex-array) so a call that would bind what is already bound is skipped,
+* and counts the GL-calls made and skipped per frame (uniforms are counted
+* by Shader, see shader.h).
+*
+* Every glUseProgram/glBindVertexArray in the project goes through here,
+* a raw call leaves the tracked state stale (call InvalidateGLState() after one).
+* Draw-paths leave their vertex-array bound, so code that binds an
+* element-buffer must bind its own vertex-array (or 0) first.
+*/
+
+// GL-calls of one frame, "Skipped" = redundant calls that never reached the driver
+struct GLCallCounts
+{
+    size_t programBinds = 0;
+    size_t programBindsSkipped = 0;
+    size_t vertexArrayBinds = 0;
+    size_t vertexArrayBindsSkipped = 0;
+    size_t uniformUploads = 0;
+    size_t uniformUploadsSkipped = 0;
+    size_t uniformLookups = 0;          // glGetUniformLocation/glGetUniformBlockIndex
+
+    size_t Issued() const { return programBinds + vertexArrayBinds + uniformUploads + uniformLookups; }
+    size_t Skipped() const { return programBindsSkipped + vertexArrayBindsSkipped + uniformUploadsSkipped; }
+};
+
+// glUseProgram/glBindVertexArray, only when it isn't bound already
+void UseProgram(unsigned int program);
+void BindVertexArray(unsigned int vao);
+
+// Call before glDeleteVertexArrays, GL unbinds a deleted vertex-array and the name may come back from glGenVertexArrays
+void ForgetVertexArray(unsigned int vao);
+
+// Forgets all tracked bindings, the next calls always reach GL
+void InvalidateGLState();
+
+// glBufferSubData of buffer, straight through its name with direct state access (GL 4.5 / ARB_direct_state_access),
+// otherwise bound to GL_ARRAY_BUFFER (that binding isn't tracked, draws never depend on it)
+void UpdateBuffer(unsigned int buffer, size_t offset, size_t size, const void* data);
+
+// Counters of the current frame, Shader adds its uniform-calls here
+GLCallCounts& GetGLCallCounts();
+
+// Call once per frame, adds the frame to the report-window and starts counting the next one
+void EndGLCallFrame();
+
+// Prints the average GL-calls per frame (issued and skipped), once per second
+void ReportGLCalls(float currentTime);
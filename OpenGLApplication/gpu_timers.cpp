@@ -0,0 +1,118 @@
+#include "gpu_timers.h"
+#include <glew.h>
+#include <cstdio>
+#include <cstring>
+
+/*
+* GPU time per render-pass through timer queries.
+*/
+
+// ------------------------- SETUP -------------------------
+
+bool GpuPassTimers::Create()
+{
+    Destroy();
+
+    glGenQueries(NUM_FRAMES * MAX_PASSES, &queries[0][0]);
+    created = true;
+    return true;
+}
+
+void GpuPassTimers::Destroy()
+{
+    if (created)
+        glDeleteQueries(NUM_FRAMES * MAX_PASSES, &queries[0][0]);
+
+    for (unsigned int f = 0; f < NUM_FRAMES; f++)
+    {
+        for (unsigned int p = 0; p < MAX_PASSES; p++)
+        {
+            queries[f][p] = 0;
+            pending[f][p] = false;
+        }
+    }
+
+    numPasses = 0;
+    current = 0;
+    activePass = -1;
+    created = false;
+}
+
+// ------------------------- PER FRAME -------------------------
+
+int GpuPassTimers::FindPass(const char* pass)
+{
+    for (unsigned int p = 0; p < numPasses; p++)
+        if (strcmp(names[p], pass) == 0)
+            return (int)p;
+
+    if (numPasses == MAX_PASSES)
+        return -1;
+
+    names[numPasses] = pass;
+    return (int)numPasses++;
+}
+
+void GpuPassTimers::Begin(const char* pass)
+{
+    if (!created || activePass >= 0)
+        return;
+
+    int p = FindPass(pass);
+    if (p < 0 || pending[current][p])
+        return;
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[current][p]);
+    activePass = p;
+}
+
+void GpuPassTimers::End()
+{
+    if (activePass < 0)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[current][activePass] = true;
+    activePass = -1;
+}
+
+void GpuPassTimers::EndFrame()
+{
+    if (!created)
+        return;
+
+    // Oldest slot, issued NUM_FRAMES - 1 frames ago so the results are normally available
+    current = (current + 1) % NUM_FRAMES;
+
+    for (unsigned int p = 0; p < numPasses; p++)
+    {
+        if (!pending[current][p])
+            continue;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[current][p], GL_QUERY_RESULT, &nanoseconds);
+        pending[current][p] = false;
+
+        sumMs[p] += nanoseconds / 1e6;
+        samples[p]++;
+    }
+}
+
+void GpuPassTimers::Report(float currentTime)
+{
+    if (!created || currentTime - windowStart < 1.0f)
+        return;
+
+    printf("GPU time per frame:");
+    for (unsigned int p = 0; p < numPasses; p++)
+    {
+        printf(" %s %.3f ms%s", names[p], samples[p] ? sumMs[p] / samples[p] : 0.0,
+            p + 1 < numPasses ? " |" : "\n");
+        sumMs[p] = 0.0;
+        samples[p] = 0;
+    }
+    if (numPasses == 0)
+        printf(" no passes\n");
+
+    windowStart = currentTime;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+* GPU time per render-pass through timer queries (GL_TIME_ELAPSED).
+*
+* Every pass gets one query per frame, results are read NUM_FRAMES - 1
+* frames later so the CPU never waits on the GPU. Passes are identified by
+* name and can't be nested (GL allows one GL_TIME_ELAPSED query at a time).
+*/
+
+class GpuPassTimers
+{
+public:
+    static const unsigned int MAX_PASSES = 8;
+    static const unsigned int NUM_FRAMES = 3;
+
+    GpuPassTimers() = default;
+
+    GpuPassTimers(const GpuPassTimers&) = delete;
+    GpuPassTimers& operator=(const GpuPassTimers&) = delete;
+
+    // Creates the queries, needs a current GL-context. Begin/End do nothing until then
+    bool Create();
+
+    // Frees the queries, must be called while the context is still alive
+    void Destroy();
+
+    // Starts/stops timing pass (a string-literal), a pass is only timed the first time per frame
+    void Begin(const char* pass);
+    void End();
+
+    // Call once per frame after the last pass, collects the results of an older frame
+    void EndFrame();
+
+    // Prints the average GPU time of every pass, once per second
+    void Report(float currentTime);
+
+private:
+    int FindPass(const char* pass);
+
+    unsigned int queries[NUM_FRAMES][MAX_PASSES] = {};
+    bool pending[NUM_FRAMES][MAX_PASSES] = {};  // Query was issued and its result not read yet
+    const char* names[MAX_PASSES] = {};
+    unsigned int numPasses = 0;
+
+    double sumMs[MAX_PASSES] = {};              // Results since the last report
+    unsigned int samples[MAX_PASSES] = {};
+    float windowStart = 0.0f;
+
+    unsigned int current = 0;                   // Frame-slot of the queries issued this frame
+    int activePass = -1;
+    bool created = false;
+};
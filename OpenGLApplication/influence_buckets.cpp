@@ -0,0 +1,145 @@
+#include "influence_buckets.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+/*
+* Influence-buckets of skinned meshes.
+*
+* Most vertices of a typical rig follow one or two bones, blending all four
+* anyway costs 4 bone-fetches (3 vec4 each) and 48 multiply-adds per vertex
+* plus 32 bytes of ids/weights. The cost model of the report counts exactly
+* that: per influence 3 texel/uniform-fetches, 12 MADs and 8 bytes.
+*/
+
+#define PACKED_BASE_SIZE (2 * sizeof(glm::vec3))    // Position + normal, same in every bucket
+
+int CountInfluences(const VertexGPU& vertex)
+{
+    int count = 0;
+    for (int k = 0; k < 4; k++)
+        if (vertex.Weights[k] > 0.0f)
+            count++;
+    return count;
+}
+
+size_t InfluenceVertexStride(int influences)
+{
+    return PACKED_BASE_SIZE + influences * (sizeof(int) + sizeof(float));
+}
+
+size_t InfluenceBoneIdsOffset()
+{
+    return PACKED_BASE_SIZE;
+}
+
+size_t InfluenceWeightsOffset(int influences)
+{
+    return PACKED_BASE_SIZE + influences * sizeof(int);
+}
+
+// Appends vertex to the bucket with its non-zero influences first, the rest padded with bone 0 / weight 0
+static void AppendPackedVertex(InfluenceBucket& bucket, const VertexGPU& vertex)
+{
+    int ids[4] = {};
+    float weights[4] = {};
+    int used = 0;
+    for (int k = 0; k < 4 && used < bucket.influences; k++)
+    {
+        if (vertex.Weights[k] <= 0.0f)
+            continue;
+        ids[used] = vertex.BoneIDs[k];
+        weights[used] = vertex.Weights[k];
+        used++;
+    }
+
+    size_t offset = bucket.vertices.size();
+    bucket.vertices.resize(offset + InfluenceVertexStride(bucket.influences));
+    unsigned char* out = bucket.vertices.data() + offset;
+
+    memcpy(out, &vertex.Position, sizeof(glm::vec3));
+    memcpy(out + sizeof(glm::vec3), &vertex.Normal, sizeof(glm::vec3));
+    memcpy(out + InfluenceBoneIdsOffset(), ids, bucket.influences * sizeof(int));
+    memcpy(out + InfluenceWeightsOffset(bucket.influences), weights, bucket.influences * sizeof(float));
+
+    bucket.vertexCount++;
+}
+
+void BucketByInfluences(const VertexGPU* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+    InfluenceBucketedMesh& out)
+{
+    out = InfluenceBucketedMesh();
+    out.sourceVertexCount = vertexCount;
+
+    for (int b = 0; b < NUM_INFLUENCE_BUCKETS; b++)
+        out.buckets[b].influences = b + 1;
+
+    std::vector<int> influences(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        influences[v] = CountInfluences(vertices[v]);
+
+    // Local index of every source-vertex per bucket, -1 = not in it yet
+    std::vector<int> localVertex[NUM_INFLUENCE_BUCKETS];
+    for (int b = 0; b < NUM_INFLUENCE_BUCKETS; b++)
+        localVertex[b].assign(vertexCount, -1);
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        // Vertices without bones go with the 1-bone triangles (weight 0 gives the same result as in skinning.vs)
+        int triangleInfluences = 1;
+        for (int c = 0; c < 3; c++)
+            triangleInfluences = std::max(triangleInfluences, influences[indices[i + c]]);
+
+        int b = triangleInfluences - 1;
+        InfluenceBucket& bucket = out.buckets[b];
+
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int source = indices[i + c];
+            if (localVertex[b][source] < 0)
+            {
+                localVertex[b][source] = (int)bucket.vertexCount;
+                AppendPackedVertex(bucket, vertices[source]);
+            }
+            bucket.indices.push_back((unsigned int)localVertex[b][source]);
+        }
+    }
+}
+
+void ReportInfluenceBuckets(const InfluenceBucketedMesh& mesh)
+{
+    const size_t fullStride = sizeof(VertexGPU);
+    const int fullMads = 4 * 12;
+
+    size_t totalVertices = 0, totalBytes = 0, totalMads = 0, totalFetches = 0;
+
+    printf("\nInfluence-buckets (vs blending 4 bones from %zu-byte VertexGPU)\n", fullStride);
+    printf("%8s %10s %10s %13s %13s %15s\n", "Bones", "Vertices", "Triangles", "Bytes/vert", "Fetches/vert", "Blend MADs/vert");
+    for (const InfluenceBucket& bucket : mesh.buckets)
+    {
+        printf("%8d %10zu %10zu %8zu (%2zu) %8d (12) %10d (%d)\n",
+            bucket.influences, bucket.vertexCount, bucket.indices.size() / 3,
+            InfluenceVertexStride(bucket.influences), fullStride,
+            bucket.influences * 3, bucket.influences * 12, fullMads);
+
+        totalVertices += bucket.vertexCount;
+        totalBytes += bucket.vertexCount * InfluenceVertexStride(bucket.influences);
+        totalMads += bucket.vertexCount * bucket.influences * 12;
+        totalFetches += bucket.vertexCount * bucket.influences * 3;
+    }
+
+    // Against the original mesh (no duplicated vertices)
+    size_t fullBytes = mesh.sourceVertexCount * fullStride;
+    size_t fullTotalMads = mesh.sourceVertexCount * fullMads;
+    size_t fullTotalFetches = mesh.sourceVertexCount * 4 * 3;
+
+    printf("Vertices:      %zu -> %zu (+%.1f%% duplicated on bucket-borders)\n", mesh.sourceVertexCount, totalVertices,
+        mesh.sourceVertexCount ? 100.0 * (totalVertices - mesh.sourceVertexCount) / mesh.sourceVertexCount : 0.0);
+    printf("Vertex-bytes:  %zu -> %zu (%.1f%% saved)\n", fullBytes, totalBytes,
+        fullBytes ? 100.0 * ((double)fullBytes - totalBytes) / fullBytes : 0.0);
+    printf("Bone-fetches:  %zu -> %zu (%.1f%% saved)\n", fullTotalFetches, totalFetches,
+        fullTotalFetches ? 100.0 * ((double)fullTotalFetches - totalFetches) / fullTotalFetches : 0.0);
+    printf("Blend-MADs:    %zu -> %zu (%.1f%% saved)\n\n", fullTotalMads, totalMads,
+        fullTotalMads ? 100.0 * ((double)fullTotalMads - totalMads) / fullTotalMads : 0.0);
+}
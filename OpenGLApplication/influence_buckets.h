@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "vertex.h"
+
+/*
+* Splits a skinned mesh by how many bones drive each triangle, so every
+* part can be drawn with a shader that only fetches and blends that many
+* bone-matrices (skinning.vs with NUM_INFLUENCES = 1..4).
+*
+* A triangle goes to the bucket of its vertex with the most influences.
+* Each bucket gets its own copy of the vertices it uses in a packed layout
+* with only that many bone-ids and weights:
+*
+*   vec3 Position, vec3 Normal, int BoneIDs[K], float Weights[K]
+*
+* Vertices used by triangles of two buckets are stored in both, unused
+* slots are padded with bone 0 and weight 0. Indices are local to each bucket.
+*/
+
+#define NUM_INFLUENCE_BUCKETS 4     // Buckets for 1, 2, 3 and 4 influences (VertexGPU holds 4)
+
+struct InfluenceBucket
+{
+    int influences = 0;                     // Bone-ids and weights per vertex (K)
+    std::vector<unsigned char> vertices;    // Packed, InfluenceVertexStride(influences) bytes per vertex
+    std::vector<unsigned int> indices;      // Local to the bucket
+    size_t vertexCount = 0;
+};
+
+struct InfluenceBucketedMesh
+{
+    InfluenceBucket buckets[NUM_INFLUENCE_BUCKETS];    // Bucket i holds the triangles with i + 1 influences
+    size_t sourceVertexCount = 0;
+};
+
+// Nr of non-zero weights of a vertex (0 for vertices without bones)
+int CountInfluences(const VertexGPU& vertex);
+
+// Bytes per vertex of a bucket with this many influences
+size_t InfluenceVertexStride(int influences);
+
+// Byte-offsets of the bone-ids and weights within a packed vertex (position at 0, normal at 12)
+size_t InfluenceBoneIdsOffset();
+size_t InfluenceWeightsOffset(int influences);
+
+// Sorts the triangles of a (global) index-buffer into the 4 buckets, the order of the triangles within a bucket is kept
+void BucketByInfluences(const VertexGPU* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+    InfluenceBucketedMesh& out);
+
+// Prints vertices/triangles per bucket and the vertex-fetch bandwidth and blend-ALU saved vs always blending 4 bones
+void ReportInfluenceBuckets(const InfluenceBucketedMesh& mesh);
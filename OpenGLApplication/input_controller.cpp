@@ -8,6 +8,7 @@
 *   * W A S D - keys for x- y-axis camera movement
 *   * Q E - key for z-axis camera movement
 *   * Up Down Arrows - increase/decrease current bone-index (weight-viz)
+*   * 1 2 3 - toggle the weight-viz / bone-lines / skinning pipeline
 *   * Dragging - Rotate model
 */
 
@@ -80,6 +81,18 @@ void InputController::Update(float deltaTime)
     prevUpPressed = upPressed;
     prevDownPressed = downPressed;
 
+    // Pipeline toggles (1/2/3) ----------------
+
+    // Same as the bone index, only on press transition
+    pipelineToggles = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        bool pressed = IsKeyPressed(GLFW_KEY_1 + i);
+        if (pressed && !prevPipelinePressed[i])
+            pipelineToggles |= 1u << i;
+        prevPipelinePressed[i] = pressed;
+    }
+
     // Vertical camera movement (Q/E) ----------------
 
     // Move camera up in world space
@@ -161,3 +174,8 @@ glm::mat4 InputController::GetModelRotationMatrix() const
     return rot;
 }
 
+
+unsigned int InputController::GetPipelineToggles() const
+{
+    return pipelineToggles;
+}
@@ -7,6 +7,7 @@
 *   * W A S D - keys for x- y-axis camera movement
 *   * Q E - key for z-axis camera movement
 *   * Up Down Arrows - increase/decrease current bone-index (weight-viz)
+*   * 1 2 3 - toggle the weight-viz / bone-lines / skinning pipeline
 *   * Dragging - Rotate model
 */
 
@@ -28,11 +29,15 @@ public:
     
     glm::mat4 GetModelRotationMatrix() const;
 
+    // Pipelines whose key was pressed this frame, bit i = key i + 1
+    unsigned int GetPipelineToggles() const;
+
     // Button presses ----------------
     
     // Tracks previous key states to detect single key presses
     bool prevUpPressed = false;
     bool prevDownPressed = false;
+    bool prevPipelinePressed[3] = {};
     
     // Mouse drag rotation ----------------
 
@@ -54,6 +59,7 @@ private:
 
     Camera camera;
     int currentBoneIndex;
+    unsigned int pipelineToggles = 0;
     
     // Maximum valid bone index(set in Main)
     int maxBoneIndex = 0;
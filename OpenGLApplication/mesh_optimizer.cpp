@@ -0,0 +1,352 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*
+* Mesh-optimisation passes.
+*
+* The vertex-cache pass follows Tom Forsyth's "Linear-Speed Vertex Cache
+* Optimisation": every vertex gets a score from its position in a simulated
+* LRU-cache and from how many triangles still use it, the triangle with the
+* highest score among those touching the cache is emitted next.
+*
+* The overdraw pass follows Sander et al. "Fast Triangle Reordering for
+* Vertex Locality and Reduced Overdraw" (the clustering part of Tipsify).
+*/
+
+// ------------------------- VERTEX-CACHE -------------------------
+
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRI_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+// Simulated FIFO post-transform cache, Reset() is O(1) (entries of older generations count as misses)
+struct FifoCache
+{
+    std::vector<size_t> addedAt;        // Miss-count when the vertex was added
+    std::vector<unsigned int> generation;
+    unsigned int current = 1;
+    size_t misses = 0;
+
+    explicit FifoCache(size_t vertexCount) : addedAt(vertexCount, 0), generation(vertexCount, 0) {}
+
+    void Reset()
+    {
+        current++;
+        misses = 0;
+    }
+
+    // True on a hit, a miss adds the vertex
+    bool Access(unsigned int v)
+    {
+        if (generation[v] == current && misses - addedAt[v] < VERTEX_CACHE_SIZE)
+            return true;
+
+        generation[v] = current;
+        misses++;
+        addedAt[v] = misses;
+        return false;
+    }
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+    VertexCacheStats stats;
+    if (indexCount < 3)
+        return stats;
+
+    FifoCache cache(vertexCount);
+    std::vector<bool> referenced(vertexCount, false);
+    size_t referencedCount = 0;
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        if (!referenced[indices[i]]) {
+            referenced[indices[i]] = true;
+            referencedCount++;
+        }
+        cache.Access(indices[i]);
+    }
+
+    stats.acmr = (float)cache.misses / (indexCount / 3);
+    stats.atvr = referencedCount ? (float)cache.misses / referencedCount : 0.0f;
+    return stats;
+}
+
+static float ForsythVertexScore(int cachePosition, int remainingTriangles)
+{
+    // No triangles left, never pick it again
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // The 3 vertices of the last triangle get a fixed score so it isn't immediately reused (strips)
+        if (cachePosition < 3)
+            score = FORSYTH_LAST_TRI_SCORE;
+        else
+        {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+
+    // Bonus for vertices with few triangles left, gets rid of lone triangles early
+    score += FORSYTH_VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles of every vertex (CSR), the first remaining[v] entries are the ones not emitted yet
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    std::vector<int> remaining(vertexCount, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int v = indices[t * 3 + c];
+            vertexTriangles[offsets[v] + remaining[v]++] = (unsigned int)t;
+        }
+
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+
+    // LRU-cache, front = most recent. 3 extra slots for the vertices pushed out by the last triangle
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t scanCursor = 0;  // Triangles before it are all emitted
+    long long best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        // Nothing in the cache has triangles left, take the next triangle in the original order
+        if (best < 0)
+        {
+            while (emitted[scanCursor])
+                scanCursor++;
+            best = (long long)scanCursor;
+        }
+
+        size_t t = (size_t)best;
+        const unsigned int* tri = &indices[t * 3];
+        emitted[t] = true;
+        output.insert(output.end(), tri, tri + 3);
+
+        // Vertices of the triangle to the front of the cache and take the triangle out of their lists
+        newCache.clear();
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int v = tri[c];
+            newCache.push_back(v);
+
+            unsigned int* list = &vertexTriangles[offsets[v]];
+            for (int k = 0; k < remaining[v]; k++)
+                if (list[k] == t) {
+                    std::swap(list[k], list[remaining[v] - 1]);
+                    break;
+                }
+            remaining[v]--;
+        }
+        for (unsigned int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache.push_back(v);
+
+        // Vertices that fall out of the cache lose their cache-score
+        for (size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); i++)
+        {
+            unsigned int v = newCache[i];
+            vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+        }
+        if (newCache.size() > FORSYTH_CACHE_SIZE)
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(newCache);
+
+        // Rescore the cached vertices and their triangles, the best of those goes next
+        for (size_t i = 0; i < cache.size(); i++)
+            vertexScore[cache[i]] = ForsythVertexScore((int)i, remaining[cache[i]]);
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache)
+        {
+            const unsigned int* list = &vertexTriangles[offsets[v]];
+            for (int k = 0; k < remaining[v]; k++)
+            {
+                unsigned int other = list[k];
+                const unsigned int* otherTri = &indices[other * 3];
+                float score = vertexScore[otherTri[0]] + vertexScore[otherTri[1]] + vertexScore[otherTri[2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = other;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+// ------------------------- OVERDRAW -------------------------
+
+// Ends of clusters [start, end) in triangles: where all 3 vertices of a triangle miss the cache (the optimizer jumped).
+// clusterMisses = cache-misses inside every cluster
+static void FindHardBoundaries(const unsigned int* indices, size_t triangleCount, FifoCache& cache,
+    std::vector<size_t>& clusters, std::vector<size_t>& clusterMisses)
+{
+    cache.Reset();
+    size_t clusterStartMisses = 0;
+
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        size_t missesBefore = cache.misses;
+        for (int c = 0; c < 3; c++)
+            cache.Access(indices[t * 3 + c]);
+
+        if (cache.misses - missesBefore == 3 && t > 0)
+        {
+            clusters.push_back(t);
+            clusterMisses.push_back(missesBefore - clusterStartMisses);
+            clusterStartMisses = missesBefore;
+        }
+    }
+    clusters.push_back(triangleCount);
+    clusterMisses.push_back(cache.misses - clusterStartMisses);
+}
+
+// Splits every hard cluster further where the running miss-rate from its start is back at the cluster's own ACMR
+static void SplitSoftBoundaries(const unsigned int* indices, FifoCache& cache, const std::vector<size_t>& hard,
+    const std::vector<size_t>& hardMisses, std::vector<size_t>& clusters)
+{
+    size_t start = 0;
+    for (size_t k = 0; k < hard.size(); k++)
+    {
+        size_t end = hard[k];
+        float clusterAcmr = (float)hardMisses[k] / (end - start);
+
+        cache.Reset();
+        size_t softStart = start;
+
+        for (size_t t = start; t < end; t++)
+        {
+            for (int c = 0; c < 3; c++)
+                cache.Access(indices[t * 3 + c]);
+
+            // Cutting here costs at most OVERDRAW_THRESHOLD of the cache-efficiency
+            size_t triangles = t + 1 - softStart;
+            if (t + 1 < end && (float)cache.misses / triangles <= clusterAcmr * OVERDRAW_THRESHOLD)
+            {
+                clusters.push_back(t + 1);
+                softStart = t + 1;
+                cache.Reset();
+            }
+        }
+
+        clusters.push_back(end);
+        start = end;
+    }
+}
+
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const glm::vec3* positions, size_t vertexCount, size_t stride)
+{
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    auto position = [&](unsigned int v) -> const glm::vec3& {
+        return *(const glm::vec3*)((const char*)positions + v * stride);
+    };
+
+    FifoCache cache(vertexCount);
+    std::vector<size_t> hard, hardMisses, clusters;
+    FindHardBoundaries(indices, triangleCount, cache, hard, hardMisses);
+    SplitSoftBoundaries(indices, cache, hard, hardMisses, clusters);
+
+    // Area-weighted centroid and normal of every cluster and of the mesh
+    struct Cluster { size_t start, end; glm::vec3 centroid, normal; float area; float sortKey; };
+    std::vector<Cluster> list;
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    size_t start = 0;
+    for (size_t end : clusters)
+    {
+        Cluster cluster = { start, end, glm::vec3(0.0f), glm::vec3(0.0f), 0.0f, 0.0f };
+        for (size_t t = start; t < end; t++)
+        {
+            const glm::vec3& a = position(indices[t * 3]);
+            const glm::vec3& b = position(indices[t * 3 + 1]);
+            const glm::vec3& c = position(indices[t * 3 + 2]);
+
+            glm::vec3 cross = glm::cross(b - a, c - a);     // Length = 2 * area
+            float area = glm::length(cross);
+
+            cluster.centroid += (a + b + c) * (area / 3.0f);
+            cluster.normal += cross;
+            cluster.area += area;
+        }
+        meshCentroid += cluster.centroid;
+        meshArea += cluster.area;
+
+        if (cluster.area > 0.0f)
+            cluster.centroid /= cluster.area;
+        list.push_back(cluster);
+        start = end;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Facing away from the center = outer surface, drawn first
+    for (Cluster& cluster : list)
+    {
+        float length = glm::length(cluster.normal);
+        cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+    }
+    std::stable_sort(list.begin(), list.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indexCount);
+    for (const Cluster& cluster : list)
+        sorted.insert(sorted.end(), indices + cluster.start * 3, indices + cluster.end * 3);
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+// ------------------------- VERTEX-FETCH -------------------------
+
+size_t BuildVertexFetchRemap(const unsigned int* indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int>& remap)
+{
+    const unsigned int unused = ~0u;
+    remap.assign(vertexCount, unused);
+
+    unsigned int next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+        if (remap[indices[i]] == unused)
+            remap[indices[i]] = next++;
+
+    size_t usedCount = next;
+    for (size_t v = 0; v < vertexCount; v++)
+        if (remap[v] == unused)
+            remap[v] = next++;
+
+    return usedCount;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+* Load-time optimisation of a mesh's index- and vertex-order, run once
+* per mesh when a model is imported (the result is baked into the
+* model-cache).
+*
+*   1. Vertex-cache order: triangles are reordered (Forsyth's algorithm) so
+*      the post-transform cache is hit as often as possible, every miss is a
+*      full skinning of that vertex.
+*   2. Overdraw order: the cache-optimized sequence is cut into clusters
+*      (where the cache restarts, and where the cluster's own miss-rate is
+*      reached) and the clusters facing away from the mesh-center are drawn
+*      first, so the inner/back surfaces are more often depth-rejected.
+*   3. Vertex-fetch order: vertices are renumbered by first use so the
+*      vertex-fetch reads the buffer front to back.
+*
+* All functions work on mesh-local indices (0 = first vertex of the mesh).
+*/
+
+#define VERTEX_CACHE_SIZE 16            // FIFO-size of the simulated post-transform cache (ACMR/ATVR)
+#define OVERDRAW_THRESHOLD 1.05f        // Allowed ACMR-increase when splitting clusters for the overdraw order
+
+// Post-transform cache efficiency of an index-buffer (FIFO of VERTEX_CACHE_SIZE)
+struct VertexCacheStats
+{
+    float acmr = 0.0f;  // Average cache miss ratio, misses per triangle (0.5 - 3, lower is better)
+    float atvr = 0.0f;  // Average transformed vertex ratio, misses per referenced vertex (1 is optimal)
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// Reorders the triangles of indices for the post-transform cache (Forsyth), in place
+void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// Reorders clusters of an already cache-optimized index-buffer for less overdraw, in place.
+// positions = the mesh's vertex-positions, stride bytes apart
+void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const glm::vec3* positions, size_t vertexCount, size_t stride);
+
+// remap[old vertex] = new vertex, in order of first use by indices (unused vertices go last).
+// Returns the nr of vertices indices uses
+size_t BuildVertexFetchRemap(const unsigned int* indices, size_t indexCount, size_t vertexCount, std::vector<unsigned int>& remap);
+
+// Applies a remap of BuildVertexFetchRemap to an array of count elements
+template<class T>
+void RemapVertices(T* vertices, size_t count, const std::vector<unsigned int>& remap)
+{
+    std::vector<T> copy(vertices, vertices + count);
+    for (size_t v = 0; v < count; v++)
+        vertices[remap[v]] = copy[v];
+}
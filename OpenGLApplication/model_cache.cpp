@@ -0,0 +1,603 @@
+#include "model_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+#include <type_traits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+* Baked binary cache of an imported skinned model.
+*
+* Going through Assimp (ReadFile + parsing + weight-normalization +
+* building GPU-buffers) takes seconds on the larger models. The result
+* of that work is written next to the model as "<model>.skcache" the
+* first time it is imported, later loads memory-map the file and upload
+* the vertex- and index-data straight from the mapping.
+*
+* File layout: header | vertices | indices | mesh base-vertices | bones | names | clips,
+* every section (and every key-array inside the clip-section) starts on a 16-byte boundary.
+*/
+
+// ------------------------- UTIL -------------------------
+
+// Every section starts at a multiple of this
+static const uint64_t SECTION_ALIGNMENT = 16;
+
+static uint64_t AlignUp(uint64_t value)
+{
+    return (value + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+// Size, modification-time and content-hash of the source model
+struct SourceFingerprint
+{
+    uint64_t size = 0;
+    int64_t time = 0;
+    uint64_t hash = 0;
+};
+
+// Size and modification-time, cheap since the file isn't read
+static bool StatSource(const std::string& path, SourceFingerprint& out)
+{
+    std::error_code ec;
+    uintmax_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+
+    auto writeTime = std::filesystem::last_write_time(path, ec);
+    if (ec) return false;
+
+    out.size = (uint64_t)fileSize;
+    out.time = (int64_t)writeTime.time_since_epoch().count();
+    return true;
+}
+
+// 64-bit FNV-1a over the whole source file
+static bool HashSource(const std::string& path, uint64_t& outHash)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    uint64_t hash = 14695981039346656037ull;
+    char buffer[64 * 1024];
+
+    // Read in chunks so large models don't have to fit in memory twice
+    while (file)
+    {
+        file.read(buffer, sizeof(buffer));
+        std::streamsize n = file.gcount();
+        for (std::streamsize i = 0; i < n; i++)
+        {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    outHash = hash;
+    return true;
+}
+
+// ------------------------- WRITING -------------------------
+
+ModelCache::ModelCache()
+{
+}
+
+ModelCache::~ModelCache()
+{
+    Close();
+}
+
+std::string ModelCache::CachePathFor(const std::string& sourcePath)
+{
+    return sourcePath + ".skcache";
+}
+
+bool ModelCache::Write(const std::string& sourcePath, uint32_t importFlags,
+    const std::vector<VertexGPU>& vertices,
+    const std::vector<unsigned int>& indices,
+    const std::vector<int>& meshBaseVertex,
+    const SkeletonDesc& skeleton,
+    const std::vector<CompressedClip>& clips)
+{
+    // Fingerprint source so stale caches can be found later
+    SourceFingerprint source;
+    if (!StatSource(sourcePath, source) || !HashSource(sourcePath, source.hash)) {
+        std::cerr << "Model cache: can't read source '" << sourcePath << "'\n";
+        return false;
+    }
+
+    // Pack bones and their names
+    std::vector<ModelCacheBone> bones(skeleton.bones.size());
+    std::string names;
+    for (size_t i = 0; i < skeleton.bones.size(); i++)
+    {
+        const Bone& bone = skeleton.bones[i];
+        ModelCacheBone& out = bones[i];
+        memset(&out, 0, sizeof(out));
+
+        out.parentIndex = bone.parentIndex;
+        out.nameOffset = (uint32_t)names.size();
+        out.nameLength = (uint32_t)bone.name.size();
+        memcpy(out.offsetMatrix, &bone.offsetMatrix[0][0], sizeof(out.offsetMatrix));
+        memcpy(out.localBindPose, &bone.localBindPose[0][0], sizeof(out.localBindPose));
+
+        names += bone.name;
+    }
+
+    // Lay out the clips, their key-arrays follow the clip-table
+    std::vector<ModelCacheClip> packedClips(clips.size());
+    uint64_t clipBytes = AlignUp(clips.size() * sizeof(ModelCacheClip));
+    for (size_t i = 0; i < clips.size(); i++)
+    {
+        const CompressedClip& clip = clips[i];
+        ModelCacheClip& out = packedClips[i];
+        memset(&out, 0, sizeof(out));
+
+        out.nameOffset = (uint32_t)names.size();
+        out.nameLength = (uint32_t)clip.name.size();
+        out.duration = clip.duration;
+        out.channelCount = (uint32_t)clip.channels.size();
+        out.posKeyCount = (uint32_t)clip.posTimes.size();
+        out.rotKeyCount = (uint32_t)clip.rotTimes.size();
+        out.scaleKeyCount = (uint32_t)clip.scaleTimes.size();
+
+        out.channelOffset = clipBytes;
+        out.posTimeOffset = AlignUp(out.channelOffset + clip.channels.size() * sizeof(CompressedChannel));
+        out.posValueOffset = AlignUp(out.posTimeOffset + clip.posTimes.size() * sizeof(float));
+        out.rotTimeOffset = AlignUp(out.posValueOffset + clip.posValues.size() * sizeof(uint16_t));
+        out.rotValueOffset = AlignUp(out.rotTimeOffset + clip.rotTimes.size() * sizeof(float));
+        out.scaleTimeOffset = AlignUp(out.rotValueOffset + clip.rotValues.size() * sizeof(uint16_t));
+        out.scaleValueOffset = AlignUp(out.scaleTimeOffset + clip.scaleTimes.size() * sizeof(float));
+        clipBytes = AlignUp(out.scaleValueOffset + clip.scaleValues.size() * sizeof(uint16_t));
+
+        names += clip.name;
+    }
+
+    // Lay out the sections
+    ModelCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "SKMC", 4);
+    header.version = MODEL_CACHE_VERSION;
+    header.vertexStride = sizeof(VertexGPU);
+    header.importFlags = importFlags;
+    header.sourceSize = source.size;
+    header.sourceTime = source.time;
+    header.sourceHash = source.hash;
+    header.vertexCount = (uint32_t)vertices.size();
+    header.indexCount = (uint32_t)indices.size();
+    header.meshCount = (uint32_t)meshBaseVertex.size();
+    header.boneCount = (uint32_t)bones.size();
+    header.clipCount = (uint32_t)clips.size();
+
+    header.vertexOffset = AlignUp(sizeof(ModelCacheHeader));
+    header.indexOffset = AlignUp(header.vertexOffset + vertices.size() * sizeof(VertexGPU));
+    header.meshOffset = AlignUp(header.indexOffset + indices.size() * sizeof(uint32_t));
+    header.boneOffset = AlignUp(header.meshOffset + meshBaseVertex.size() * sizeof(int32_t));
+    header.nameOffset = AlignUp(header.boneOffset + bones.size() * sizeof(ModelCacheBone));
+    header.clipOffset = AlignUp(header.nameOffset + names.size());
+    header.fileSize = header.clipOffset + (clips.empty() ? 0 : clipBytes);
+
+    // Build the whole file in memory, then write it in one go
+    std::vector<unsigned char> blob((size_t)header.fileSize, 0);
+    memcpy(blob.data(), &header, sizeof(header));
+    if (!vertices.empty())
+        memcpy(blob.data() + header.vertexOffset, vertices.data(), vertices.size() * sizeof(VertexGPU));
+    if (!indices.empty())
+        memcpy(blob.data() + header.indexOffset, indices.data(), indices.size() * sizeof(uint32_t));
+    if (!meshBaseVertex.empty())
+        memcpy(blob.data() + header.meshOffset, meshBaseVertex.data(), meshBaseVertex.size() * sizeof(int32_t));
+    if (!bones.empty())
+        memcpy(blob.data() + header.boneOffset, bones.data(), bones.size() * sizeof(ModelCacheBone));
+    if (!names.empty())
+        memcpy(blob.data() + header.nameOffset, names.data(), names.size());
+
+    unsigned char* clipBase = blob.data() + header.clipOffset;
+    if (!packedClips.empty())
+        memcpy(clipBase, packedClips.data(), packedClips.size() * sizeof(ModelCacheClip));
+    for (size_t i = 0; i < clips.size(); i++)
+    {
+        const CompressedClip& clip = clips[i];
+        const ModelCacheClip& out = packedClips[i];
+
+        auto copyArray = [&](uint64_t offset, const auto& values) {
+            if (!values.empty())
+                memcpy(clipBase + offset, values.data(), values.size() * sizeof(values[0]));
+        };
+        copyArray(out.channelOffset, clip.channels);
+        copyArray(out.posTimeOffset, clip.posTimes);
+        copyArray(out.posValueOffset, clip.posValues);
+        copyArray(out.rotTimeOffset, clip.rotTimes);
+        copyArray(out.rotValueOffset, clip.rotValues);
+        copyArray(out.scaleTimeOffset, clip.scaleTimes);
+        copyArray(out.scaleValueOffset, clip.scaleValues);
+    }
+
+    // Write to a temporary file first so a crash never leaves a half-written cache
+    std::string cachePath = CachePathFor(sourcePath);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Model cache: can't write '" << tempPath << "'\n";
+            return false;
+        }
+        file.write((const char*)blob.data(), (std::streamsize)blob.size());
+        if (!file) {
+            std::cerr << "Model cache: failed writing '" << tempPath << "'\n";
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(cachePath, ec);
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec) {
+        std::cerr << "Model cache: can't rename '" << tempPath << "': " << ec.message() << "\n";
+        return false;
+    }
+
+    printf("Model cache: wrote '%s' (%zu bytes)\n", cachePath.c_str(), blob.size());
+    return true;
+}
+
+// ------------------------- READING -------------------------
+
+// Stores a new source modification-time in the header of a cache-file, the rest of the file stays as it is
+static bool WriteSourceTime(const std::string& cachePath, int64_t time)
+{
+    std::fstream file(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file.is_open())
+        return false;
+
+    file.seekp(offsetof(ModelCacheHeader, sourceTime));
+    file.write((const char*)&time, sizeof(time));
+    return (bool)file;
+}
+
+bool ModelCache::Map(const std::string& cachePath)
+{
+    // Map the whole cache-file read-only
+#ifdef _WIN32
+    HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(ModelCacheHeader)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = (const unsigned char*)view;
+    size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ModelCacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    fileHandle = (void*)(intptr_t)fd;
+    data = (const unsigned char*)view;
+    size = (size_t)st.st_size;
+#endif
+
+    // Test header
+    const ModelCacheHeader* header = Header();
+    if (memcmp(header->magic, "SKMC", 4) != 0 ||
+        header->version != MODEL_CACHE_VERSION ||
+        header->vertexStride != sizeof(VertexGPU) ||
+        header->fileSize != size)
+    {
+        printf("Model cache: '%s' has an old or broken layout, re-importing\n", cachePath.c_str());
+        Close();
+        return false;
+    }
+
+    // Test that every offset and count stays inside the file before anything is read through them
+    if (!ValidateSections()) {
+        printf("Model cache: '%s' is corrupt, re-importing\n", cachePath.c_str());
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool ModelCache::Open(const std::string& sourcePath, uint32_t importFlags)
+{
+    Close();
+
+    std::string cachePath = CachePathFor(sourcePath);
+    if (!Map(cachePath))
+        return false;
+
+    // Baked with other import-settings (e.g. mesh-optimizer toggled), the data would have the wrong order
+    const ModelCacheHeader* header = Header();
+    if (header->importFlags != importFlags) {
+        printf("Model cache: '%s' was made with other import-settings, re-importing\n", cachePath.c_str());
+        Close();
+        return false;
+    }
+
+    // Test that the source hasn't changed since the cache was written
+    SourceFingerprint source;
+    if (!StatSource(sourcePath, source) || source.size != header->sourceSize) {
+        printf("Model cache: '%s' is stale, re-importing\n", cachePath.c_str());
+        Close();
+        return false;
+    }
+
+    // Same modification-time is trusted, otherwise fall back to comparing content (e.g. after a fresh checkout)
+    if (source.time != header->sourceTime)
+    {
+        if (!HashSource(sourcePath, source.hash) || source.hash != header->sourceHash) {
+            printf("Model cache: '%s' is stale, re-importing\n", cachePath.c_str());
+            Close();
+            return false;
+        }
+
+        // Same content (touched, fresh checkout): store the new time so the next loads skip hashing the source.
+        // The mapping keeps the file read-only (shared for reading only on Windows), so it is mapped again after the write
+        Close();
+        if (!WriteSourceTime(cachePath, source.time))
+            printf("Model cache: couldn't update the source-time of '%s'\n", cachePath.c_str());
+        return Map(cachePath);
+    }
+
+    return true;
+}
+
+void ModelCache::Close()
+{
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle) CloseHandle((HANDLE)fileHandle);
+#else
+    if (data) munmap((void*)data, size);
+    if (fileHandle) close((int)(intptr_t)fileHandle);
+#endif
+
+    data = nullptr;
+    size = 0;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
+
+const ModelCacheHeader* ModelCache::Header() const
+{
+    return (const ModelCacheHeader*)data;
+}
+
+// count elements of elementSize bytes at offset fit in the first size bytes and start on a section-boundary, without overflowing
+static bool SectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size)
+{
+    if (offset > size || offset % SECTION_ALIGNMENT != 0)
+        return false;
+    return count <= (size - offset) / elementSize;
+}
+
+// A name of length bytes at offset inside a name-section of size bytes
+static bool NameFits(uint64_t offset, uint64_t length, uint64_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+// Key-range of a channel inside the key-arrays of its clip
+static bool KeysFit(uint64_t first, uint64_t count, uint64_t numKeys)
+{
+    return first <= numKeys && count <= numKeys - first;
+}
+
+bool ModelCache::ValidateSections() const
+{
+    const ModelCacheHeader* header = Header();
+
+    // Fixed-size sections
+    if (!SectionFits(header->vertexOffset, header->vertexCount, sizeof(VertexGPU), size) ||
+        !SectionFits(header->indexOffset, header->indexCount, sizeof(uint32_t), size) ||
+        !SectionFits(header->meshOffset, header->meshCount, sizeof(int32_t), size) ||
+        !SectionFits(header->boneOffset, header->boneCount, sizeof(ModelCacheBone), size) ||
+        !SectionFits(header->clipOffset, header->clipCount, sizeof(ModelCacheClip), size) ||
+        header->nameOffset > size)
+        return false;
+
+    uint64_t nameSize = size - header->nameOffset;
+
+    // Bones: names and parents, baked in depth-order so a parent always comes before its children
+    // (the hierarchy-kernels and compute_skeleton_levels rely on that)
+    const ModelCacheBone* bones = (const ModelCacheBone*)(data + header->boneOffset);
+    for (uint32_t i = 0; i < header->boneCount; i++)
+    {
+        if (!NameFits(bones[i].nameOffset, bones[i].nameLength, nameSize) ||
+            bones[i].parentIndex < -1 || bones[i].parentIndex >= (int64_t)i)
+            return false;
+    }
+
+    // Indices inside the vertices, the draws read gVBO through them
+    const uint32_t* indices = (const uint32_t*)(data + header->indexOffset);
+    uint32_t maxIndex = 0;
+    for (uint32_t i = 0; i < header->indexCount; i++)
+        maxIndex = std::max(maxIndex, indices[i]);
+    if (header->indexCount > 0 && maxIndex >= header->vertexCount)
+        return false;
+
+    // Mesh base-vertices inside the vertices
+    const int32_t* baseVertex = (const int32_t*)(data + header->meshOffset);
+    for (uint32_t i = 0; i < header->meshCount; i++)
+    {
+        if (baseVertex[i] < 0 || (uint32_t)baseVertex[i] > header->vertexCount)
+            return false;
+    }
+
+    // Bone-ids inside the skeleton, also of unused slots (id 0, weight 0) since the shaders fetch every slot.
+    // Unrigged models have no bones but still id 0
+    uint32_t numBoneIds = std::max(header->boneCount, 1u);
+    const VertexGPU* vertices = (const VertexGPU*)(data + header->vertexOffset);
+    for (uint32_t v = 0; v < header->vertexCount; v++)
+    {
+        for (int k = 0; k < VertexGPU::NumInfluences; k++)
+        {
+            // Unsigned, so negative ids fail as well
+            if ((uint32_t)vertices[v].BoneIDs[k] >= numBoneIds)
+                return false;
+        }
+    }
+
+    // Clips: names, key-arrays (relative to the clip-section) and the key-ranges of every channel
+    const unsigned char* clipBase = data + header->clipOffset;
+    const ModelCacheClip* clips = (const ModelCacheClip*)clipBase;
+    uint64_t clipSize = size - header->clipOffset;
+    for (uint32_t i = 0; i < header->clipCount; i++)
+    {
+        const ModelCacheClip& clip = clips[i];
+        if (!NameFits(clip.nameOffset, clip.nameLength, nameSize) ||
+            !SectionFits(clip.channelOffset, clip.channelCount, sizeof(CompressedChannel), clipSize) ||
+            !SectionFits(clip.posTimeOffset, clip.posKeyCount, sizeof(float), clipSize) ||
+            !SectionFits(clip.posValueOffset, (uint64_t)clip.posKeyCount * 3, sizeof(uint16_t), clipSize) ||
+            !SectionFits(clip.rotTimeOffset, clip.rotKeyCount, sizeof(float), clipSize) ||
+            !SectionFits(clip.rotValueOffset, (uint64_t)clip.rotKeyCount * 3, sizeof(uint16_t), clipSize) ||
+            !SectionFits(clip.scaleTimeOffset, clip.scaleKeyCount, sizeof(float), clipSize) ||
+            !SectionFits(clip.scaleValueOffset, (uint64_t)clip.scaleKeyCount * 3, sizeof(uint16_t), clipSize))
+            return false;
+
+        const CompressedChannel* channels = (const CompressedChannel*)(clipBase + clip.channelOffset);
+        for (uint32_t c = 0; c < clip.channelCount; c++)
+        {
+            if (!KeysFit(channels[c].firstPosKey, channels[c].numPosKeys, clip.posKeyCount) ||
+                !KeysFit(channels[c].firstRotKey, channels[c].numRotKeys, clip.rotKeyCount) ||
+                !KeysFit(channels[c].firstScaleKey, channels[c].numScaleKeys, clip.scaleKeyCount))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// ------------------------- GET-FUNCTIONS -------------------------
+
+const VertexGPU* ModelCache::GetVertices() const
+{
+    return (const VertexGPU*)(data + Header()->vertexOffset);
+}
+
+size_t ModelCache::GetVertexCount() const
+{
+    return Header()->vertexCount;
+}
+
+const unsigned int* ModelCache::GetIndices() const
+{
+    return (const unsigned int*)(data + Header()->indexOffset);
+}
+
+size_t ModelCache::GetIndexCount() const
+{
+    return Header()->indexCount;
+}
+
+void ModelCache::ReadSkeleton(SkeletonDesc& outSkeleton) const
+{
+    const ModelCacheHeader* header = Header();
+    const ModelCacheBone* bones = (const ModelCacheBone*)(data + header->boneOffset);
+    const char* names = (const char*)(data + header->nameOffset);
+
+    outSkeleton.bones.clear();
+    outSkeleton.boneNameToIndex.clear();
+    outSkeleton.bones.resize(header->boneCount);
+
+    // Rebuild bones and name-lookup
+    for (uint32_t i = 0; i < header->boneCount; i++)
+    {
+        Bone& bone = outSkeleton.bones[i];
+        bone.name.assign(names + bones[i].nameOffset, bones[i].nameLength);
+        bone.parentIndex = bones[i].parentIndex;
+        memcpy(&bone.offsetMatrix[0][0], bones[i].offsetMatrix, sizeof(bones[i].offsetMatrix));
+        memcpy(&bone.localBindPose[0][0], bones[i].localBindPose, sizeof(bones[i].localBindPose));
+
+        outSkeleton.boneNameToIndex[bone.name] = (int)i;
+    }
+}
+
+void ModelCache::ReadMeshBaseVertices(std::vector<int>& outBaseVertex) const
+{
+    const ModelCacheHeader* header = Header();
+    const int32_t* base = (const int32_t*)(data + header->meshOffset);
+    outBaseVertex.assign(base, base + header->meshCount);
+}
+
+void ModelCache::ReadAnimations(std::vector<CompressedClip>& outClips) const
+{
+    const ModelCacheHeader* header = Header();
+    const unsigned char* clipBase = data + header->clipOffset;
+    const ModelCacheClip* clips = (const ModelCacheClip*)clipBase;
+    const char* names = (const char*)(data + header->nameOffset);
+
+    outClips.clear();
+    outClips.resize(header->clipCount);
+
+    for (uint32_t i = 0; i < header->clipCount; i++)
+    {
+        const ModelCacheClip& in = clips[i];
+        CompressedClip& clip = outClips[i];
+
+        clip.name.assign(names + in.nameOffset, in.nameLength);
+        clip.duration = in.duration;
+
+        auto readArray = [&](uint64_t offset, uint32_t count, auto& outValues) {
+            using T = typename std::remove_reference_t<decltype(outValues)>::value_type;
+            const T* first = (const T*)(clipBase + offset);
+            outValues.assign(first, first + count);
+        };
+        readArray(in.channelOffset, in.channelCount, clip.channels);
+        readArray(in.posTimeOffset, in.posKeyCount, clip.posTimes);
+        readArray(in.posValueOffset, in.posKeyCount * 3, clip.posValues);
+        readArray(in.rotTimeOffset, in.rotKeyCount, clip.rotTimes);
+        readArray(in.rotValueOffset, in.rotKeyCount * 3, clip.rotValues);
+        readArray(in.scaleTimeOffset, in.scaleKeyCount, clip.scaleTimes);
+        readArray(in.scaleValueOffset, in.scaleKeyCount * 3, clip.scaleValues);
+    }
+}
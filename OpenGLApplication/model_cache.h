@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vertex.h"
+#include "skeleton.h"
+#include "animation.h"
+
+/*
+* Baked binary cache of an imported skinned model.
+*
+* Going through Assimp (ReadFile + parsing + weight-normalization +
+* building GPU-buffers) takes seconds on the larger models. The result
+* of that work is written next to the model as "<model>.skcache" the
+* first time it is imported, later loads memory-map the file and upload
+* the vertex- and index-data straight from the mapping.
+*
+* The cache remembers size, modification-time and a hash of the source
+* file, if the source has changed the cache is treated as stale and the
+* model is imported through Assimp again (which rewrites the cache). The
+* same goes for import-settings that change the baked data (importFlags).
+*/
+
+// Bump whenever the layout of the file, VertexGPU, the Bone-data or the animation-data changes
+#define MODEL_CACHE_VERSION 6
+
+// Import-settings baked into the data (ModelCacheHeader::importFlags)
+#define MODEL_CACHE_OPTIMIZED_MESHES 0x1u  // Vertex-/index-order from OptimizeMesh
+
+// First bytes of every cache-file
+struct ModelCacheHeader
+{
+    char magic[4];              // "SKMC"
+    uint32_t version;           // MODEL_CACHE_VERSION when written
+    uint32_t vertexStride;      // sizeof(VertexGPU) when written, catches layout changes
+
+    uint32_t importFlags;       // MODEL_CACHE_* import-settings the data was made with
+
+    // Fingerprint of the source model
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+
+    // Element counts
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t meshCount;
+    uint32_t boneCount;
+    uint32_t clipCount;
+    uint32_t reserved2;
+
+    // Byte offsets (from start of file) of each section
+    uint64_t vertexOffset;      // VertexGPU[vertexCount]
+    uint64_t indexOffset;       // uint32_t[indexCount]
+    uint64_t meshOffset;        // int32_t[meshCount], mesh_base_vertex
+    uint64_t boneOffset;        // ModelCacheBone[boneCount]
+    uint64_t nameOffset;        // All bone names packed after each other, then all clip names
+    uint64_t clipOffset;        // ModelCacheClip[clipCount] followed by the key-arrays of every clip
+    uint64_t fileSize;
+};
+
+// A bone as stored in the cache, the name lives in the name-section
+struct ModelCacheBone
+{
+    int32_t parentIndex;
+    uint32_t nameOffset;        // Relative to ModelCacheHeader::nameOffset
+    uint32_t nameLength;
+    uint32_t reserved;
+    float offsetMatrix[16];
+    float localBindPose[16];
+};
+
+// A (compressed) animation-clip as stored in the cache, array-offsets are relative to ModelCacheHeader::clipOffset
+struct ModelCacheClip
+{
+    uint32_t nameOffset;        // Relative to ModelCacheHeader::nameOffset
+    uint32_t nameLength;
+    float duration;
+    uint32_t channelCount;
+    uint32_t posKeyCount;
+    uint32_t rotKeyCount;
+    uint32_t scaleKeyCount;
+    uint32_t reserved;
+
+    uint64_t channelOffset;     // CompressedChannel[channelCount]
+    uint64_t posTimeOffset;     // float[posKeyCount]
+    uint64_t posValueOffset;    // uint16_t[posKeyCount * 3]
+    uint64_t rotTimeOffset;     // float[rotKeyCount]
+    uint64_t rotValueOffset;    // uint16_t[rotKeyCount * 3]
+    uint64_t scaleTimeOffset;   // float[scaleKeyCount]
+    uint64_t scaleValueOffset;  // uint16_t[scaleKeyCount * 3]
+    uint64_t reserved2;
+};
+
+class ModelCache
+{
+public:
+    ModelCache();
+    ~ModelCache();
+
+    ModelCache(const ModelCache&) = delete;
+    ModelCache& operator=(const ModelCache&) = delete;
+
+    // Where the cache of a model is located: "<sourcePath>.skcache"
+    static std::string CachePathFor(const std::string& sourcePath);
+
+    // Bakes imported data (made with importFlags) into a cache-file next to the source, returns false if it couldn't be written
+    static bool Write(const std::string& sourcePath, uint32_t importFlags,
+        const std::vector<VertexGPU>& vertices,
+        const std::vector<unsigned int>& indices,
+        const std::vector<int>& meshBaseVertex,
+        const SkeletonDesc& skeleton,
+        const std::vector<CompressedClip>& clips);
+
+    // Memory-maps the cache of a model, fails if there is none, if it is stale or if it was made with other importFlags
+    bool Open(const std::string& sourcePath, uint32_t importFlags);
+
+    // Releases the mapping (also done by the destructor and by Open)
+    void Close();
+
+    bool IsOpen() const { return data != nullptr; }
+
+    // Get-functions, all point straight into the mapping and are valid until Close()
+    const VertexGPU* GetVertices() const;
+    size_t GetVertexCount() const;
+    const unsigned int* GetIndices() const;
+    size_t GetIndexCount() const;
+
+    // Copies the small parts of the cache (skeleton + mesh base-vertices) out of the mapping
+    void ReadSkeleton(SkeletonDesc& outSkeleton) const;
+    void ReadMeshBaseVertices(std::vector<int>& outBaseVertex) const;
+    void ReadAnimations(std::vector<CompressedClip>& outClips) const;
+
+private:
+    const ModelCacheHeader* Header() const;
+
+    // Maps a cache-file and tests its header and sections, the source is not looked at
+    bool Map(const std::string& cachePath);
+
+    // Every section, name and key-array lies inside the mapping (a truncated or corrupt file is rejected by Open)
+    bool ValidateSections() const;
+
+    // The mapping
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    // Platform handles of the mapping
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+};
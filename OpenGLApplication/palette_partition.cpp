@@ -0,0 +1,137 @@
+#include "palette_partition.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+/*
+* Palette-partitioning of skinned meshes.
+*
+* Greedy in triangle-order, which keeps the batches spatially coherent
+* (the loader emits meshes and their faces in order) and the vertex-
+* duplication low, only vertices on a batch-border are copied.
+*/
+
+#define MAX_TRIANGLE_BONES 12   // 3 vertices x MAX_NUM_BONES_PER_VERTEX
+
+size_t MaxBonesForUniformComponents(int components)
+{
+    // A mat3x4 takes 3 vec4 = 12 components
+    int available = components - PALETTE_RESERVED_UNIFORM_COMPONENTS;
+    return available > 0 ? (size_t)available / 12 : 0;
+}
+
+// Index of the mesh vertex belongs to
+static size_t MeshOfVertex(const std::vector<int>& meshBaseVertex, unsigned int vertex)
+{
+    auto it = std::upper_bound(meshBaseVertex.begin(), meshBaseVertex.end(), (int)vertex);
+    return it == meshBaseVertex.begin() ? 0 : (size_t)(it - meshBaseVertex.begin() - 1);
+}
+
+bool PartitionByBones(const VertexGPU* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+    const std::vector<int>& meshBaseVertex, size_t maxBones, PartitionedMesh& out)
+{
+    out = PartitionedMesh();
+    out.maxBones = maxBones;
+
+    if (maxBones < MAX_TRIANGLE_BONES) {
+        std::cerr << "Palette-partitioning needs at least " << MAX_TRIANGLE_BONES << " bones per batch, got " << maxBones << "\n";
+        return false;
+    }
+
+    // Largest bone-id decides the size of the lookup-table
+    int numBones = 1;
+    for (size_t v = 0; v < vertexCount; v++)
+        for (int k = 0; k < 4; k++)
+            numBones = std::max(numBones, vertices[v].BoneIDs[k] + 1);
+
+    // Local ids of the current batch, -1 = not in it. Only the entries of the batch are reset when it closes
+    std::vector<int> localBone(numBones, -1);
+    std::vector<int> localVertex(vertexCount, -1);
+    std::vector<unsigned int> batchVertices;    // Source-vertices of the current batch, in local order
+
+    PaletteBatch batch;
+    size_t batchMesh = 0;
+
+    // Appends the current batch (its vertices with remapped bone-ids) and starts an empty one
+    auto closeBatch = [&]() {
+        if (batch.indexCount == 0)
+            return;
+
+        batch.baseVertex = (int)out.vertices.size();
+        batch.vertexCount = (unsigned int)batchVertices.size();
+
+        for (unsigned int source : batchVertices)
+        {
+            VertexGPU vertex = vertices[source];
+            for (int k = 0; k < 4; k++)
+                vertex.BoneIDs[k] = vertex.Weights[k] > 0.0f ? localBone[vertex.BoneIDs[k]] : 0;
+            out.vertices.push_back(vertex);
+            localVertex[source] = -1;
+        }
+        for (int bone : batch.bones)
+            localBone[bone] = -1;
+
+        out.batches.push_back(std::move(batch));
+        batch = PaletteBatch();
+        batch.firstIndex = (unsigned int)out.indices.size();
+        batchVertices.clear();
+    };
+
+    // Bones triangle i would add to the current batch
+    int newBones[MAX_TRIANGLE_BONES];
+    auto collectNewBones = [&](size_t i) {
+        int numNew = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            const VertexGPU& vertex = vertices[indices[i + c]];
+            for (int k = 0; k < 4; k++)
+            {
+                int bone = vertex.BoneIDs[k];
+                if (vertex.Weights[k] <= 0.0f || localBone[bone] >= 0)
+                    continue;
+                if (std::find(newBones, newBones + numNew, bone) == newBones + numNew)
+                    newBones[numNew++] = bone;
+            }
+        }
+        return numNew;
+    };
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        int numNew = collectNewBones(i);
+
+        // Full, or the triangle belongs to the next mesh. Always fits an empty batch
+        size_t mesh = MeshOfVertex(meshBaseVertex, indices[i]);
+        if (batch.bones.size() + numNew > maxBones || (batch.indexCount > 0 && mesh != batchMesh))
+        {
+            closeBatch();
+            numNew = collectNewBones(i);
+        }
+        batchMesh = mesh;
+
+        for (int n = 0; n < numNew; n++)
+        {
+            localBone[newBones[n]] = (int)batch.bones.size();
+            batch.bones.push_back(newBones[n]);
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int source = indices[i + c];
+            if (localVertex[source] < 0)
+            {
+                localVertex[source] = (int)batchVertices.size();
+                batchVertices.push_back(source);
+            }
+            out.indices.push_back((unsigned int)localVertex[source]);
+        }
+        batch.indexCount += 3;
+    }
+    closeBatch();
+
+    printf("Palette-partitioning: %zu batches of at most %zu bones, %zu -> %zu vertices (+%.1f%%)\n",
+        out.batches.size(), maxBones, vertexCount, out.vertices.size(),
+        vertexCount ? 100.0 * (out.vertices.size() - vertexCount) / vertexCount : 0.0);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "vertex.h"
+
+/*
+* Splits a skinned mesh into draw-batches that each use at most maxBones
+* bones, so every batch fits in a plain uniform-array palette no matter how
+* large the skeleton is.
+*
+* Triangles are taken in order and a batch is closed when the next triangle
+* would bring in too many new bones (or belongs to the next mesh). Each batch
+* gets its own copy of the vertices it uses with BoneIDs remapped to local
+* indices into the batch's palette-slice, indices are local to the batch
+* (drawn with glDrawElementsBaseVertex).
+*/
+
+#define PALETTE_RESERVED_UNIFORM_COMPONENTS 80  // Left for the other uniforms of the skinning-shader (MVP...)
+
+struct PaletteBatch
+{
+    unsigned int firstIndex = 0;    // Into PartitionedMesh::indices
+    unsigned int indexCount = 0;
+    int baseVertex = 0;             // First vertex of the batch in PartitionedMesh::vertices
+    unsigned int vertexCount = 0;
+    std::vector<int> bones;         // Palette-slice: local bone-id -> skeleton bone-id
+};
+
+struct PartitionedMesh
+{
+    std::vector<VertexGPU> vertices;        // Per batch, BoneIDs are local
+    std::vector<unsigned int> indices;      // Local to each batch (0 = the batch's base-vertex)
+    std::vector<PaletteBatch> batches;
+    size_t maxBones = 0;                    // Limit the mesh was split with
+};
+
+// Nr of 3x4 bone-matrices a uniform-array can hold with this many vertex uniform-components (GL_MAX_VERTEX_UNIFORM_COMPONENTS)
+size_t MaxBonesForUniformComponents(int components);
+
+// Splits the triangles of a (global) index-buffer into batches of at most maxBones bones (at least 12, one triangle's worth).
+// meshBaseVertex = first vertex of every mesh, batches never span two meshes. Returns false if maxBones is too small
+bool PartitionByBones(const VertexGPU* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+    const std::vector<int>& meshBaseVertex, size_t maxBones, PartitionedMesh& out);
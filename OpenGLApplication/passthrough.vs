@@ -0,0 +1,16 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+
+#include "frame_constants.glsl"
+
+// Vertices that are already skinned (on the CPU, see cpu_skinning.h), no bone-palette needed
+
+out vec3 vNormal;
+
+void main()
+{
+    gl_Position = uModelViewProjection * vec4(aPosition, 1.0);
+    vNormal = aNormal;
+}
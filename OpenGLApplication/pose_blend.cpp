@@ -0,0 +1,318 @@
+#include "pose_blend.h"
+#include "skeleton_pose.h"
+#include "animation_compression.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <immintrin.h>
+
+/*
+* Layered blending of sampled clips.
+*
+* The blend-kernels run over the contiguous arrays of two LocalPose
+* buffers: translations/scales as plain float-arrays, rotations one
+* quaternion per SSE-register (dot, sign-flip, lerp, normalize).
+*/
+
+// ------------------------- BUFFERS -------------------------
+
+void LocalPose::Resize(size_t numBones)
+{
+    translations.resize(numBones);
+    rotations.resize(numBones);
+    scales.resize(numBones);
+}
+
+BoneMask MakeSubtreeMask(const SkeletonDesc& desc, int rootBone, float weight)
+{
+    BoneMask mask;
+    mask.weights.assign(desc.bones.size(), 0.0f);
+    if (rootBone < 0 || (size_t)rootBone >= desc.bones.size())
+        return mask;
+
+    // Parents come before children (sorted by depth), so one pass finds the whole subtree
+    mask.weights[rootBone] = weight;
+    for (size_t i = rootBone + 1; i < desc.bones.size(); i++)
+    {
+        int parent = desc.bones[i].parentIndex;
+        if (parent >= 0 && mask.weights[parent] > 0.0f)
+            mask.weights[i] = weight;
+    }
+    return mask;
+}
+
+void PosePool::Init(size_t numBones, size_t numBuffers)
+{
+    buffers.resize(numBuffers);
+    for (LocalPose& buffer : buffers)
+        buffer.Resize(numBones);
+    used = 0;
+}
+
+LocalPose* PosePool::Acquire()
+{
+    if (used >= buffers.size())
+        return nullptr;
+    return &buffers[used++];
+}
+
+// ------------------------- KERNELS -------------------------
+
+// dst = dst + (src - dst) * w[bone] for arrays of vec3
+static void BlendVec3(glm::vec3* dst, const glm::vec3* src, const float* weights, size_t count)
+{
+    float* d = &dst[0].x;
+    const float* s = &src[0].x;
+    for (size_t b = 0; b < count; b++)
+    {
+        float w = weights[b];
+        if (w <= 0.0f)
+            continue;
+        d[b * 3 + 0] += (s[b * 3 + 0] - d[b * 3 + 0]) * w;
+        d[b * 3 + 1] += (s[b * 3 + 1] - d[b * 3 + 1]) * w;
+        d[b * 3 + 2] += (s[b * 3 + 2] - d[b * 3 + 2]) * w;
+    }
+}
+
+// Horizontal sum of all 4 lanes, in every lane
+static inline __m128 HorizontalSum(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_add_ps(sums, shuf);
+}
+
+// dst = nlerp(dst, src, w[bone]) the shortest way, one quaternion per register
+static void BlendRotationsNlerp(glm::quat* dst, const glm::quat* src, const float* weights, size_t count)
+{
+    float* d = &dst[0][0];
+    const float* s = &src[0][0];
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    for (size_t b = 0; b < count; b++)
+    {
+        float w = weights[b];
+        if (w <= 0.0f)
+            continue;
+
+        __m128 q0 = _mm_loadu_ps(d + b * 4);
+        __m128 q1 = _mm_loadu_ps(s + b * 4);
+
+        // Flip q1 if it is on the other side of the sphere
+        __m128 dot = HorizontalSum(_mm_mul_ps(q0, q1));
+        q1 = _mm_xor_ps(q1, _mm_and_ps(dot, signMask));
+
+        __m128 r = _mm_add_ps(q0, _mm_mul_ps(_mm_sub_ps(q1, q0), _mm_set1_ps(w)));
+
+        // Normalize
+        __m128 len = _mm_sqrt_ps(HorizontalSum(_mm_mul_ps(r, r)));
+        _mm_storeu_ps(d + b * 4, _mm_div_ps(r, len));
+    }
+}
+
+// dst = slerp(dst, src, w[bone])
+static void BlendRotationsSlerp(glm::quat* dst, const glm::quat* src, const float* weights, size_t count)
+{
+    for (size_t b = 0; b < count; b++)
+    {
+        float w = weights[b];
+        if (w > 0.0f)
+            dst[b] = glm::slerp(dst[b], src[b], w);
+    }
+}
+
+// ------------------------- BLENDER -------------------------
+
+void PoseBlender::Init(size_t numBones, size_t maxLayers)
+{
+    // One buffer for the result + one per layer
+    pool.Init(numBones, maxLayers + 1);
+    boneWeights.assign(numBones, 0.0f);
+}
+
+void PoseBlender::Evaluate(const BlendLayer* layers, size_t numLayers, SkeletonPose& pose)
+{
+    size_t numBones = pose.Size();
+    pool.Reset();
+
+    LocalPose* result = pool.Acquire();
+    if (!result || result->Size() != numBones)
+        return;
+
+    // Start from the current local pose
+    memcpy(result->translations.data(), pose.localTranslations.data(), numBones * sizeof(glm::vec3));
+    memcpy(result->rotations.data(), pose.localRotations.data(), numBones * sizeof(glm::quat));
+    memcpy(result->scales.data(), pose.localScales.data(), numBones * sizeof(glm::vec3));
+
+    for (size_t l = 0; l < numLayers; l++)
+    {
+        const BlendLayer& layer = layers[l];
+        if (!layer.player || !layer.player->IsPlaying() || layer.weight <= 0.0f)
+            continue;
+
+        LocalPose* sampled = pool.Acquire();
+        if (!sampled)
+            break;  // More layers than Init() was told about
+
+        // Effective weight of every bone, also used as the sampling-mask
+        const float* mask = (layer.mask && layer.mask->weights.size() == numBones) ? layer.mask->weights.data() : nullptr;
+        float weight = std::min(layer.weight, 1.0f);
+        for (size_t b = 0; b < numBones; b++)
+            boneWeights[b] = mask ? weight * mask[b] : weight;
+
+        // Bones without a channel in this clip must blend towards what is there already
+        memcpy(sampled->translations.data(), result->translations.data(), numBones * sizeof(glm::vec3));
+        memcpy(sampled->rotations.data(), result->rotations.data(), numBones * sizeof(glm::quat));
+        memcpy(sampled->scales.data(), result->scales.data(), numBones * sizeof(glm::vec3));
+
+        LocalPoseTarget target;
+        target.translations = sampled->translations.data();
+        target.rotations = sampled->rotations.data();
+        target.scales = sampled->scales.data();
+        target.mask = boneWeights.data();
+        target.count = numBones;
+        layer.player->Sample(layer.player->GetTime(), target);
+
+        BlendVec3(result->translations.data(), sampled->translations.data(), boneWeights.data(), numBones);
+        BlendVec3(result->scales.data(), sampled->scales.data(), boneWeights.data(), numBones);
+        if (useSlerp)
+            BlendRotationsSlerp(result->rotations.data(), sampled->rotations.data(), boneWeights.data(), numBones);
+        else
+            BlendRotationsNlerp(result->rotations.data(), sampled->rotations.data(), boneWeights.data(), numBones);
+    }
+
+    // Write back only what changed so static bones stay clean
+    for (size_t b = 0; b < numBones; b++)
+    {
+        if (result->translations[b] != pose.localTranslations[b] ||
+            result->rotations[b] != pose.localRotations[b] ||
+            result->scales[b] != pose.localScales[b])
+        {
+            pose.SetLocalPose(b, result->translations[b], result->rotations[b], result->scales[b]);
+        }
+    }
+}
+
+// ------------------------- BENCHMARK -------------------------
+
+// Chain-like skeleton where every bone has a random earlier parent
+static void MakeBlendBenchSkeleton(size_t numBones, SkeletonDesc& outDesc, std::mt19937& rng)
+{
+    outDesc.bones.resize(numBones);
+    for (size_t i = 0; i < numBones; i++)
+    {
+        outDesc.bones[i].name = "bone_" + std::to_string(i);
+        outDesc.bones[i].parentIndex = (i == 0) ? -1 : (int)(rng() % i);
+    }
+
+    // One bone per level keeps it valid without sorting, the blender doesn't care about levels
+    outDesc.levelOffsets.clear();
+    for (size_t i = 0; i <= numBones; i++)
+        outDesc.levelOffsets.push_back((int)i);
+}
+
+// Smooth random clip with a key every 1/30 s on every bone, compressed like an imported clip
+static void MakeBlendBenchClip(size_t numBones, std::mt19937& rng, CompressedClip& outClip)
+{
+    std::uniform_real_distribution<float> random(-1.0f, 1.0f);
+
+    AnimationClip clip;
+    clip.name = "bench";
+    clip.duration = 2.0f;
+    const uint32_t numKeys = 61;
+
+    for (size_t b = 0; b < numBones; b++)
+    {
+        AnimationChannel channel = {};
+        channel.boneIndex = (int32_t)b;
+        channel.firstPosKey = (uint32_t)clip.posTimes.size();
+        channel.firstRotKey = (uint32_t)clip.rotTimes.size();
+        channel.numPosKeys = channel.numRotKeys = numKeys;
+
+        glm::vec3 axis = glm::normalize(glm::vec3(random(rng), random(rng), random(rng)) + glm::vec3(0.0f, 0.0f, 2.0f));
+        float phase = random(rng) * 3.0f, amount = random(rng);
+        for (uint32_t k = 0; k < numKeys; k++)
+        {
+            float t = clip.duration * k / (numKeys - 1);
+            clip.posTimes.push_back(t);
+            clip.posValues.push_back(glm::vec3(0.0f, 1.0f + 0.1f * std::sin(t * 3.0f + phase), 0.0f));
+            clip.rotTimes.push_back(t);
+            clip.rotValues.push_back(glm::angleAxis(amount * std::sin(t * 2.0f + phase), axis));
+        }
+        clip.channels.push_back(channel);
+    }
+
+    CompressAnimationClip(clip, AnimationCompressionSettings(), outClip);
+}
+
+void BenchmarkPoseBlending()
+{
+    using Clock = std::chrono::high_resolution_clock;
+    std::mt19937 rng(4321);
+
+    const size_t numBones = 256;
+    const size_t maxLayers = 8;
+
+    SkeletonDesc desc;
+    MakeBlendBenchSkeleton(numBones, desc, rng);
+    SkeletonPose pose;
+    InitSkeletonPose(pose, desc);
+
+    std::vector<CompressedClip> clips(maxLayers);
+    std::vector<AnimationPlayer> players(maxLayers);
+    for (size_t l = 0; l < maxLayers; l++)
+    {
+        MakeBlendBenchClip(numBones, rng, clips[l]);
+        players[l].Play(&clips[l]);
+        players[l].SetSpeed(0.8f + 0.05f * l);
+    }
+
+    // Every other layer only drives half the skeleton, like an upper-body overlay
+    BoneMask halfMask;
+    for (size_t b = 0; b < numBones; b++)
+        halfMask.weights.push_back((b % 2) ? 1.0f : 0.0f);
+
+    printf("\n**************************************************\n");
+    printf("Pose blending: %zu bones, sample + blend per frame\n\n", numBones);
+    printf("%8s %16s %20s %16s\n", "Layers", "Nlerp (us)", "ns/bone/layer", "Slerp (us)");
+
+    const size_t layerCounts[] = { 2, 4, 8 };
+    for (size_t numLayers : layerCounts)
+    {
+        std::vector<BlendLayer> layers(numLayers);
+        for (size_t l = 0; l < numLayers; l++)
+        {
+            layers[l].player = &players[l];
+            layers[l].weight = (l == 0) ? 1.0f : 0.5f;
+            layers[l].mask = (l % 2) ? &halfMask : nullptr;
+        }
+
+        double timings[2];
+        for (int slerp = 0; slerp < 2; slerp++)
+        {
+            PoseBlender blender;
+            blender.Init(numBones, numLayers);
+            blender.SetUseSlerp(slerp == 1);
+
+            const int frames = 2000;
+            auto t0 = Clock::now();
+            for (int f = 0; f < frames; f++)
+            {
+                for (size_t l = 0; l < numLayers; l++)
+                    players[l].Advance(1.0f / 60.0f);
+                blender.Evaluate(layers.data(), numLayers, pose);
+            }
+            auto t1 = Clock::now();
+            timings[slerp] = std::chrono::duration<double, std::micro>(t1 - t0).count() / frames;
+        }
+
+        printf("%8zu %16.2f %20.2f %16.2f\n", numLayers, timings[0],
+            timings[0] * 1000.0 / (double)(numBones * numLayers), timings[1]);
+    }
+    printf("\n");
+}
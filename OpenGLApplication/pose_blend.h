@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+
+#include "skeleton.h"
+#include "animation.h"
+
+/*
+* Layered blending of sampled clips (locomotion + upper-body overlay,
+* crossfades...) before the hierarchy-pass runs.
+*
+* Every layer is sampled into its own local-pose buffer from a pool that
+* is allocated once, so a frame doesn't allocate anything. Layers are then
+* blended in order on top of the current local pose:
+*
+*     result = lerp(result, layer, layer.weight * mask[bone])
+*
+* with nlerp (or slerp) for rotations. Bones a layer's mask leaves out
+* aren't sampled for that layer at all. Only bones whose local pose
+* actually changed are written back (and marked dirty) in the SkeletonPose.
+*/
+
+// Local pose of every bone as contiguous arrays, same layout as in SkeletonPose
+struct LocalPose
+{
+    AlignedVector<glm::vec3> translations;
+    AlignedVector<glm::quat> rotations;
+    AlignedVector<glm::vec3> scales;
+
+    void Resize(size_t numBones);
+    size_t Size() const { return rotations.size(); }
+};
+
+// Per-bone weight of a layer in [0, 1]
+struct BoneMask
+{
+    std::vector<float> weights;
+};
+
+// weight for rootBone and everything below it, 0 for the rest (e.g. the upper body from the spine)
+BoneMask MakeSubtreeMask(const SkeletonDesc& desc, int rootBone, float weight = 1.0f);
+
+// Local-pose buffers allocated once and handed out again every frame
+class PosePool
+{
+public:
+    void Init(size_t numBones, size_t numBuffers);
+
+    // nullptr when every buffer is in use
+    LocalPose* Acquire();
+
+    // Gives every buffer back, call once per frame
+    void Reset() { used = 0; }
+
+    size_t Capacity() const { return buffers.size(); }
+
+private:
+    std::vector<LocalPose> buffers;
+    size_t used = 0;
+};
+
+// One input of the blender
+struct BlendLayer
+{
+    AnimationPlayer* player = nullptr;  // Sampled at its own time (advance it before Evaluate)
+    float weight = 1.0f;
+    const BoneMask* mask = nullptr;     // nullptr = every bone
+};
+
+class PoseBlender
+{
+public:
+    // Allocates everything needed for up to maxLayers layers on a skeleton with numBones bones
+    void Init(size_t numBones, size_t maxLayers);
+
+    // Samples the layers and blends them (in order) over the current local pose of pose
+    void Evaluate(const BlendLayer* layers, size_t numLayers, SkeletonPose& pose);
+
+    // Slerp is exact for large angles between layers, nlerp (default) is a lot cheaper
+    void SetUseSlerp(bool enabled) { useSlerp = enabled; }
+
+private:
+    PosePool pool;
+    std::vector<float> boneWeights;     // weight * mask of the layer being blended
+    bool useSlerp = false;
+};
+
+// Times PoseBlender on a synthetic skeleton with 2/4/8 layers and prints the result
+void BenchmarkPoseBlending();
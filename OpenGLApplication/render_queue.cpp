@@ -0,0 +1,209 @@
+#include "render_queue.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "gpu_timers.h"
+#include "frame_constants.h"
+
+#include <glew.h>
+#include <algorithm>
+
+/*
+* Key-layout (most significant first):
+*   63-60 pass, 59-44 program, 43-28 vertex-array, 27-12 depth, 11-0 unused
+*
+* GL-names are small integers, only their low 16 bits are used. Two names
+* sharing them only end up next to each other in the order, the draws are
+* still issued with their own program and vertex-array.
+*/
+
+#define PASS_SHIFT 60
+#define PROGRAM_SHIFT 44
+#define VAO_SHIFT 28
+#define DEPTH_SHIFT 12
+
+static const RenderPassDesc gPassDescs[NUM_RENDER_PASSES] =
+{
+    { "bones", false },
+    { "weights", true },
+    { "shaded", true },
+    { "crowd", true },
+};
+
+uint64_t MakeRenderSortKey(RenderPass pass, unsigned int program, unsigned int vao, float depth)
+{
+    // Quantize front to back, behind the camera counts as nearest
+    float t = std::min(std::max(depth / RENDER_QUEUE_MAX_DEPTH, 0.0f), 1.0f);
+    uint64_t depthKey = (uint64_t)(t * 65535.0f);
+
+    return ((uint64_t)pass << PASS_SHIFT)
+        | ((uint64_t)(program & 0xFFFFu) << PROGRAM_SHIFT)
+        | ((uint64_t)(vao & 0xFFFFu) << VAO_SHIFT)
+        | (depthKey << DEPTH_SHIFT);
+}
+
+const RenderPassDesc& RenderQueue::GetPassDesc(RenderPass pass)
+{
+    return gPassDescs[pass];
+}
+
+// ------------------------- SUBMITTING -------------------------
+
+void RenderQueue::Submit(RenderPass pass, const DrawCommand& command, float depth)
+{
+    // Nothing to draw (mode without its shader, failed build, empty mesh)
+    if (!command.shader || !command.shader->IsLinked() || command.count <= 0)
+        return;
+
+    order.push_back({ MakeRenderSortKey(pass, command.shader->GetProgram(), command.vao, depth), (uint32_t)commands.size() });
+    commands.push_back(command);
+    sorted = false;
+}
+
+void RenderQueue::Clear()
+{
+    commands.clear();
+    order.clear();
+    sorted = true;
+}
+
+// ------------------------- SORTING -------------------------
+
+// LSD radix-sort, one pass per key-byte. Stable, so equal keys stay in submission order
+void RenderQueue::Sort()
+{
+    if (sorted)
+        return;
+    sorted = true;
+
+    // Bytes that are the same in every key don't change the order, typically only a few differ
+    uint64_t anyBits = 0, allBits = ~0ull;
+    for (const SortEntry& entry : order)
+    {
+        anyBits |= entry.key;
+        allBits &= entry.key;
+    }
+    uint64_t varying = anyBits ^ allBits;
+
+    scratch.resize(order.size());
+    for (int byte = 0; byte < 8; byte++)
+    {
+        int shift = byte * 8;
+        if (((varying >> shift) & 0xFF) == 0)
+            continue;
+
+        // Histogram, then start of every bucket
+        size_t offsets[256] = {};
+        for (const SortEntry& entry : order)
+            offsets[(entry.key >> shift) & 0xFF]++;
+
+        size_t sum = 0;
+        for (size_t& offset : offsets)
+        {
+            size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+
+        for (const SortEntry& entry : order)
+            scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+
+        order.swap(scratch);
+    }
+}
+
+// ------------------------- EXECUTING -------------------------
+
+void RenderQueue::Execute(FrameConstantBuffer& constants, GpuPassTimers* timers)
+{
+    Sort();
+
+    stats = RenderQueueStats();
+
+    // Room for every draw before the first one, growing later would recreate the buffer mid-frame
+    constants.ReserveDraws(order.size());
+
+    int pass = -1;
+    unsigned int program = 0xFFFFFFFFu;
+    unsigned int vao = 0xFFFFFFFFu;
+    const DrawCommand* lastConstants = nullptr;     // Draw whose constants are bound
+
+    for (const SortEntry& entry : order)
+    {
+        const DrawCommand& command = commands[entry.command];
+
+        // Pass-state only when the pass changes
+        int commandPass = (int)(entry.key >> PASS_SHIFT);
+        if (commandPass != pass)
+        {
+            if (timers && pass != -1)
+                timers->End();
+
+            const RenderPassDesc& desc = gPassDescs[commandPass];
+            if (desc.depthTest)
+                glEnable(GL_DEPTH_TEST);
+            else
+                glDisable(GL_DEPTH_TEST);
+
+            if (timers)
+                timers->Begin(desc.name);
+
+            pass = commandPass;
+            stats.passChanges++;
+        }
+
+        // Sorted, so each of these happens once per run of draws sharing them
+        if (command.shader->GetProgram() != program)
+        {
+            command.shader->Use();
+            program = command.shader->GetProgram();
+            stats.programChanges++;
+        }
+        if (command.vao != vao)
+        {
+            BindVertexArray(command.vao);
+            vao = command.vao;
+            stats.vertexArrayChanges++;
+        }
+
+        // Consecutive draws of the same object (batches, buckets) share their slot
+        if (!lastConstants || command.model != lastConstants->model || command.instanceOffset != lastConstants->instanceOffset)
+        {
+            constants.SetDraw(command.model, command.instanceOffset);
+            lastConstants = &command;
+            stats.constantChanges++;
+        }
+
+        if (command.setup)
+            command.setup(command.setupArg);
+
+        if (command.indexed)
+        {
+            void* offset = (void*)(command.firstIndex * sizeof(unsigned int));
+            if (command.instanceCount > 0)
+                glDrawElementsInstancedBaseVertex(command.primitive, command.count, GL_UNSIGNED_INT, offset, command.instanceCount, command.baseVertex);
+            else if (command.baseVertex != 0)
+                glDrawElementsBaseVertex(command.primitive, command.count, GL_UNSIGNED_INT, offset, command.baseVertex);
+            else
+                glDrawElements(command.primitive, command.count, GL_UNSIGNED_INT, offset);
+        }
+        else
+        {
+            if (command.instanceCount > 0)
+                glDrawArraysInstanced(command.primitive, (GLint)command.firstIndex, command.count, command.instanceCount);
+            else
+                glDrawArrays(command.primitive, (GLint)command.firstIndex, command.count);
+        }
+        stats.draws++;
+    }
+
+    // Leave the default state (depth-test on) for whatever draws after the queue
+    if (pass != -1)
+    {
+        if (timers)
+            timers->End();
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // VAO stays bound, see gl_state.h
+    Clear();
+}
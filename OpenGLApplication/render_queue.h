@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+class Shader;
+class GpuPassTimers;
+class FrameConstantBuffer;
+
+/*
+* Draws of one frame as a list of commands, sorted before they are issued.
+*
+* Passes submit DrawCommands in any order, each gets a 64-bit sort-key
+* (MakeRenderSortKey): pass, program, vertex-array, depth from the most to
+* the least significant bits. Execute() sorts the keys with a radix-sort
+* (linear in the nr of draws, bytes all keys share are skipped) and issues
+* the commands in that order, so every program and vertex-array is bound
+* once per run of draws using it (the binds go through gl_state.h, repeats
+* never reach GL). Equal keys keep the order they were submitted in.
+*
+* Per-pass GL-state (depth-test) and GPU-timers are set when the pass
+* changes, see RenderPassDesc. Each command carries its own DrawConstants
+* (model-matrix, instance-offset), written into its own slot of the
+* FrameConstantBuffer right before the draw, so the order of the draws
+* never mixes up whose constants are bound.
+*/
+
+#define RENDER_QUEUE_MAX_DEPTH 10000.0f     // View-depth mapped to the largest depth-key, farther draws share it
+
+// In the order they are drawn
+enum RenderPass : uint8_t
+{
+    RENDER_PASS_SKELETON,   // Bone-lines, no depth-test
+    RENDER_PASS_WEIGHTS,    // Weight-visualization
+    RENDER_PASS_SHADED,     // Skinned model, normal shading
+    RENDER_PASS_CROWD,      // Instanced crowd
+    NUM_RENDER_PASSES
+};
+
+// GL-state of a pass
+struct RenderPassDesc
+{
+    const char* name;       // GPU-timer name
+    bool depthTest;
+};
+
+// One glDraw*-call
+struct DrawCommand
+{
+    const Shader* shader = nullptr;
+    unsigned int vao = 0;
+    unsigned int primitive = 0x0004;    // GL_TRIANGLES
+    int count = 0;                      // Indices (or vertices when not indexed)
+    bool indexed = true;                // GL_UNSIGNED_INT indices from the VAO's element-buffer
+    size_t firstIndex = 0;              // First index (or vertex when not indexed)
+    int baseVertex = 0;
+    int instanceCount = 0;              // 0 = not instanced
+
+    // DrawConstants of this draw, see frame_constants.h
+    glm::mat4 model = glm::mat4(1.0f);
+    int instanceOffset = 0;
+
+    // Called right before the draw with the program bound (per-draw uniforms like a batch's palette-slice), may be nullptr
+    void (*setup)(size_t arg) = nullptr;
+    size_t setupArg = 0;
+};
+
+// Counts of the last Execute()
+struct RenderQueueStats
+{
+    size_t draws = 0;
+    size_t programChanges = 0;
+    size_t vertexArrayChanges = 0;
+    size_t passChanges = 0;
+    size_t constantChanges = 0;         // DrawConstants-slots written
+};
+
+// Sort-key of a draw, depth is the view-space distance (near draws first inside the same program and vertex-array)
+uint64_t MakeRenderSortKey(RenderPass pass, unsigned int program, unsigned int vao, float depth);
+
+class RenderQueue
+{
+public:
+    RenderQueue() = default;
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Adds a draw to this frame's list, nothing reaches GL until Execute()
+    void Submit(RenderPass pass, const DrawCommand& command, float depth = 0.0f);
+
+    // Orders the submitted draws by their keys, Execute() does this itself
+    void Sort();
+
+    // Sorts and issues every draw with its DrawConstants written into constants (a slot per draw, reserved up front),
+    // then empties the queue. timers may be nullptr
+    void Execute(FrameConstantBuffer& constants, GpuPassTimers* timers = nullptr);
+
+    // Drops the submitted draws without drawing them
+    void Clear();
+
+    size_t Size() const { return commands.size(); }
+    const RenderQueueStats& GetStats() const { return stats; }
+
+    static const RenderPassDesc& GetPassDesc(RenderPass pass);
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t command;   // Index into commands
+    };
+
+    std::vector<DrawCommand> commands;
+    std::vector<SortEntry> order;       // Keys in submission order, sorted by Sort()
+    std::vector<SortEntry> scratch;     // Other half of the radix-sort, kept to not reallocate every frame
+    bool sorted = true;
+
+    RenderQueueStats stats;
+};
@@ -1,7 +1,10 @@
 #include "shader.h"
+#include "gl_state.h"
+#include "frame_constants.h"
+#include "shader_library.h"
 #include <glew.h>
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 /*
@@ -14,123 +17,151 @@
 * while rendering the mesh "normally" to see the movement.
 */
 
-// Basic file-reader
-static std::string LoadFile(const std::string& path)
+// Constructor - loads the shader from disk (located within the same src-folder), through the program-cache
+Shader::Shader(const std::string& vsPath, const std::string& fsPath, const std::string& defines)
 {
-    std::ifstream file(path);
-    if (!file.is_open())
-    {
-        std::cerr << "FAILED TO OPEN SHADER FILE: " << path << std::endl;
-        return "";
-    }
+    ShaderLibrary library;
+    library.Add(this, vsPath, fsPath, defines);
+    library.Build();
+}
 
-    std::stringstream ss;
-    ss << file.rdbuf();
-    return ss.str();
+// Constructor - vertex-shader only, used with GL_RASTERIZER_DISCARD to write the outputs into a buffer
+Shader::Shader(const std::string& vsPath, const std::vector<const char*>& feedbackVaryings, const std::string& defines)
+{
+    ShaderLibrary library;
+    library.AddFeedback(this, vsPath, feedbackVaryings, defines);
+    library.Build();
 }
 
-// Constructor - loads the shader from disk (located within the same src-folder)
-Shader::Shader(const std::string& vsPath, const std::string& fsPath)
+// Location of every active uniform, looked up once instead of per set-call
+void Shader::Reflect()
 {
-    // Load vertex- and fragment.shader by name
-    std::string vsSrc = LoadFile(vsPath);
-    std::string fsSrc = LoadFile(fsPath);
-
-    // Test file
-    if (vsSrc.empty() || fsSrc.empty()) {
-        std::cerr << "Shader source empty\n";
-        return;
-    }
+    uniforms.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
 
-    const char* vsrc = vsSrc.c_str();
-    const char* fsrc = fsSrc.c_str();
-
-    // Create and compile vertex-shader
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vsrc, nullptr);
-    glCompileShader(vs);
-
-    // Test if vertex-shader compiled
-    GLint success;
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char log[1024];
-        glGetShaderInfoLog(vs, 1024, nullptr, log);
-        std::cerr << "VERTEX SHADER ERROR:\n" << log << std::endl;
-        return;
+    std::vector<char> name(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; i++)
+    {
+        GLint size = 0;
+        GLenum type = 0;
+        GLsizei length = 0;
+        glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+        // Members of uniform-blocks have no location
+        GLint location = glGetUniformLocation(program, name.data());
+        if (location == -1)
+            continue;
+
+        // Arrays are reported as "name[0]" but set by their plain name
+        char* bracket = strchr(name.data(), '[');
+        if (bracket)
+            *bracket = '\0';
+
+        Uniform uniform;
+        uniform.hash = HashUniformName(name.data());
+        uniform.location = location;
+        uniforms.push_back(uniform);
     }
 
+    std::sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b) { return a.hash < b.hash; });
 
-    // Create and compile fragment-shader
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fsrc, nullptr);
-    glCompileShader(fs);
+    for (size_t i = 1; i < uniforms.size(); i++)
+        if (uniforms[i].hash == uniforms[i - 1].hash)
+            std::cerr << "SHADER WARNING: two uniforms with the same name-hash, one of them can't be set\n";
 
-    // Test if fragment-shader compiled
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char log[1024];
-        glGetShaderInfoLog(fs, 1024, nullptr, log);
-        std::cerr << "FRAGMENT SHADER ERROR:\n" << log << std::endl;
-        return;
-    }
+    // Shared constants (frame_constants.glsl) always sit on the same binding points
+    BindUniformBlock("FrameConstants", FRAME_CONSTANTS_BINDING);
+    BindUniformBlock("DrawConstants", DRAW_CONSTANTS_BINDING);
+}
+
+Shader::Uniform* Shader::FindUniform(const char* name) const
+{
+    uint32_t hash = HashUniformName(name);
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), hash,
+        [](const Uniform& u, uint32_t h) { return u.hash < h; });
 
-    // Create and link program
-    program = glCreateProgram();
-    glAttachShader(program, vs);
-    glAttachShader(program, fs);
-    glLinkProgram(program);
+    return (it != uniforms.end() && it->hash == hash) ? &*it : nullptr;
+}
 
+Shader::Uniform* Shader::ChangedUniform(const char* name, const void* value, size_t bytes) const
+{
+    Uniform* uniform = FindUniform(name);
+    if (!uniform)
+        return nullptr; // Not found (or optimized away)
 
-    // Test if program compiled
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char log[1024];
-        glGetProgramInfoLog(program, 1024, nullptr, log);
-        std::cerr << "SHADER LINK ERROR:\n" << log << std::endl;
-        return;
+    if (uniform->hasValue && memcmp(uniform->value, value, bytes) == 0) {
+        GetGLCallCounts().uniformUploadsSkipped++;
+        return nullptr;
     }
 
-    // Delete shaders after succesful compilation so the they can be refilled
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    memcpy(uniform->value, value, bytes);
+    uniform->hasValue = true;
+    GetGLCallCounts().uniformUploads++;
+    return uniform;
 }
 
 // Makes program us this program (shader).
 void Shader::Use() const
 {
     //printf("\n Used!\n");
-    glUseProgram(program);
+    UseProgram(program);
 }
 
 // ------------------------- UNIFORM ATTRIBUTES -------------------------
 
-// Upload array of matrices such as bone-matrices
-void Shader::SetMat4Array(const std::string& name, const glm::mat4* data, int count)
+// Connects uniform-block name to a buffer binding point
+void Shader::BindUniformBlock(const char* name, unsigned int binding) const
 {
-    // Make sure this shader is active
-    glUseProgram(program);
+    GLuint index = glGetUniformBlockIndex(program, name);
+    GetGLCallCounts().uniformLookups++;
+    if (index == GL_INVALID_INDEX) return; // return if block not found (or optimized away)
 
-    GLint loc = glGetUniformLocation(program, name.c_str());
-    if (loc == -1) return; // return if uniform not found
+    glUniformBlockBinding(program, index, binding);
+}
 
-    glUniformMatrix4fv(loc, count, GL_FALSE, &data[0][0][0]);
+// Connects sampler name to a texture-unit
+void Shader::BindSampler(const char* name, int unit) const
+{
+    UseProgram(program);
+    SetInt(name, unit);
 }
 
 // Upload a single matrix such projection-matrix
 void Shader::SetMat4(const char* name, const glm::mat4& m) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(program, name), 1, GL_FALSE, &m[0][0]);
+    if (const Uniform* uniform = ChangedUniform(name, &m[0][0], sizeof(glm::mat4)))
+        glUniformMatrix4fv(uniform->location, 1, GL_FALSE, &m[0][0]);
 }
 
 // Upload a single vector such as veiw-position
 void Shader::SetVec3(const char* name, const glm::vec3& v) const
 {
-    glUniform3fv(glGetUniformLocation(program, name), 1, &v[0]);
+    if (const Uniform* uniform = ChangedUniform(name, &v[0], sizeof(glm::vec3)))
+        glUniform3fv(uniform->location, 1, &v[0]);
 }
 
 // Upload a single int value such as the currently selected bone in weight-viz
 void Shader::SetInt(const char* name, int v) const
 {
-    glUniform1i(glGetUniformLocation(program, name), v);
+    if (const Uniform* uniform = ChangedUniform(name, &v, sizeof(int)))
+        glUniform1i(uniform->location, v);
+}
+
+// Location of a uniform, -1 if not found (or optimized away)
+int Shader::GetUniformLocation(const char* name) const
+{
+    const Uniform* uniform = FindUniform(name);
+    return uniform ? uniform->location : -1;
+}
+
+// Upload an array of 3x4 affine matrices, rows are already laid out as GLSL mat3x4 columns so no transpose
+void Shader::SetMat3x4Array(int location, const Affine3x4* data, int count) const
+{
+    if (location == -1 || count == 0) return;
+
+    glUniformMatrix3x4fv(location, count, GL_FALSE, &data[0].rows[0][0]);
+    GetGLCallCounts().uniformUploads++;
 }
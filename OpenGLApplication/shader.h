@@ -1,7 +1,11 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
+#include "affine.h"
+
 /*
 * Class whose purpose is to simplify using/switching
 * between multible shaders. 
@@ -10,25 +14,83 @@
 * for debugging such as weight-visualization and bone-lines. Also enables
 * the use of multible shader at the same time, you can visualize the bone as lines
 * while rendering the mesh "normally" to see the movement.
+*
+* All active uniforms are looked up once after linking, the setters find
+* them by a hash of the name (no glGetUniformLocation per frame) and skip
+* uploading a value the uniform already has. Use() goes through the
+* state-tracker in gl_state.h.
+*
+* Sources may pull in other files with '#include "file"', the blocks of
+* frame_constants.glsl are bound to their binding points at link-time.
+* Programs are built by ShaderLibrary (many at once, cached on disk), the
+* constructors build a single one the same way.
 */
 
 class Shader
 {
 public:
 
-    // Contructor
-    Shader(const std::string& vs, const std::string& fs);
+    // Contructor, defines (lines of "#define ...") are inserted right after #version in both stages
+    Shader(const std::string& vs, const std::string& fs, const std::string& defines = "");
+
+    // Vertex-shader only program whose outputs are captured with transform feedback (interleaved, in the given order)
+    Shader(const std::string& vs, const std::vector<const char*>& feedbackVaryings, const std::string& defines = "");
+
+    // False until the program is built, and when building failed
+    bool IsLinked() const { return program != 0; }
+    unsigned int GetProgram() const { return program; }
     
-    // Makes the program use this program (shader).
+    // Makes the program use this program (shader), skipped when it is already in use.
     void Use() const;
 
-    // Load up uniform attributes
+    // Load up uniform attributes, the program must be in use. Skipped when the value didn't change
     void SetMat4(const char* name, const glm::mat4& m) const;
     void SetVec3(const char* name, const glm::vec3& v) const;
     void SetInt(const char* name, int v) const;
-    void SetMat4Array(const std::string& name, const glm::mat4* data, int count);
 
+    // Location-based upload for per-draw arrays, no glUseProgram (the program must be in use).
+    // The location comes from the table built at link-time
+    int GetUniformLocation(const char* name) const;
+    void SetMat3x4Array(int location, const Affine3x4* data, int count) const;  // GLSL mat3x4, e.g. bone-palettes, no transpose needed
+
+    // Connects a uniform-block to a binding point (GLSL 3.30 has no layout(binding = ...)), ignored if the block isn't used
+    void BindUniformBlock(const char* name, unsigned int binding) const;
+
+    // Points a sampler at a texture-unit, set once since the value is stored in the program. Ignored if the sampler isn't used
+    void BindSampler(const char* name, int unit) const;
+
+    // FNV-1a, the key of the uniform-table (constexpr so literal names can be hashed at compile-time)
+    static constexpr uint32_t HashUniformName(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *name; name++)
+            hash = (hash ^ (uint8_t)*name) * 16777619u;
+        return hash;
+    }
 
 private:
-    unsigned int program;
+    friend class ShaderLibrary;
+
+    // Empty, the program comes from ShaderLibrary::Build()
+    Shader() = default;
+
+    // Active uniform of the program, with the last value uploaded through a setter
+    struct Uniform
+    {
+        uint32_t hash = 0;          // HashUniformName of the name, arrays without "[0]"
+        int location = -1;
+        bool hasValue = false;      // value holds what the program has
+        float value[16] = {};       // Bytes of the last SetMat4/SetVec3/SetInt
+    };
+
+    // Fills uniforms after a successful link (or after loading a program-binary)
+    void Reflect();
+
+    // Slot of name if value differs from what was uploaded last (and stores it), nullptr if unchanged or not found
+    Uniform* ChangedUniform(const char* name, const void* value, size_t bytes) const;
+
+    Uniform* FindUniform(const char* name) const;
+
+    unsigned int program = 0;
+    mutable std::vector<Uniform> uniforms;  // Sorted by hash
 };
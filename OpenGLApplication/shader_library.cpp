@@ -0,0 +1,504 @@
+#include "shader_library.h"
+#include "shader.h"
+#include "gl_state.h"
+#include <glew.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+/*
+* Batched shader-building with a program-binary cache.
+*
+* A cache-file is a ShaderCacheHeader followed by the driver's binary, named
+* after the key. The key is repeated in the header so a file that doesn't
+* belong to the program (hash-collision, copied files) is never loaded.
+*/
+
+#define MAX_INCLUDE_DEPTH 8             // Nested #include-levels before giving up (include-cycles)
+#define SHADER_CACHE_MAGIC 0x4E425348u  // "SHBN"
+
+struct ShaderCacheHeader
+{
+    uint32_t magic;         // SHADER_CACHE_MAGIC
+    uint32_t version;       // SHADER_CACHE_VERSION
+    uint64_t key;           // Hash of sources + defines + varyings + driver
+    uint32_t binaryFormat;  // From glGetProgramBinary
+    uint32_t binarySize;
+};
+
+// ------------------------- SOURCES -------------------------
+
+// Basic file-reader, lines '#include "file"' are replaced by that file (GLSL 3.30 has no includes).
+// Line-numbers in compile-errors count the included lines as well
+static std::string LoadFile(const std::string& path, int depth = 0)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "FAILED TO OPEN SHADER FILE: " << path << std::endl;
+        return "";
+    }
+
+    if (depth > MAX_INCLUDE_DEPTH)
+    {
+        std::cerr << "SHADER INCLUDES NESTED TOO DEEP: " << path << std::endl;
+        return "";
+    }
+
+    std::string src, line;
+    while (std::getline(file, line))
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+        {
+            size_t open = line.find('"', start);
+            size_t close = (open == std::string::npos) ? std::string::npos : line.find('"', open + 1);
+            if (close != std::string::npos) {
+                src += LoadFile(line.substr(open + 1, close - open - 1), depth + 1) + "\n";
+                continue;
+            }
+        }
+        src += line + "\n";
+    }
+    return src;
+}
+
+// Puts defines on the line after #version (which must stay first)
+static std::string InsertDefines(const std::string& src, const std::string& defines)
+{
+    if (defines.empty())
+        return src;
+
+    size_t version = src.find("#version");
+    size_t lineEnd = (version == std::string::npos) ? std::string::npos : src.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return defines + src;
+
+    return src.substr(0, lineEnd + 1) + defines + src.substr(lineEnd + 1);
+}
+
+// FNV-1a over str plus a terminator, so ("ab", "c") and ("a", "bc") hash differently
+static uint64_t HashString(uint64_t hash, const std::string& str)
+{
+    for (unsigned char c : str)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    hash ^= 0xFFu;
+    hash *= 1099511628211ull;
+    return hash;
+}
+
+// Binaries only work on the exact same driver
+static std::string DriverString()
+{
+    const char* vendor = (const char*)glGetString(GL_VENDOR);
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    return std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+}
+
+static std::string CachePathFor(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return std::string(SHADER_CACHE_DIR) + "/" + name;
+}
+
+bool ShaderLibrary::LoadSources(Entry& entry)
+{
+    entry.vsSrc = InsertDefines(LoadFile(entry.vsPath), entry.defines);
+    if (!entry.fsPath.empty())
+        entry.fsSrc = InsertDefines(LoadFile(entry.fsPath), entry.defines);
+
+    // Test files
+    if (entry.vsSrc.empty() || (!entry.fsPath.empty() && entry.fsSrc.empty())) {
+        std::cerr << "Shader source empty: " << entry.vsPath << " " << entry.fsPath << "\n";
+        return false;
+    }
+
+    uint64_t key = 14695981039346656037ull;
+    key = HashString(key, std::to_string(SHADER_CACHE_VERSION));
+    key = HashString(key, entry.vsSrc);
+    key = HashString(key, entry.fsSrc);
+    for (const std::string& varying : entry.varyings)
+        key = HashString(key, varying);
+    entry.key = HashString(key, DriverString());
+    return true;
+}
+
+// ------------------------- DEFINES -------------------------
+
+ShaderDefines& ShaderDefines::Set(const std::string& name, const std::string& value)
+{
+    values[name] = value;
+    return *this;
+}
+
+ShaderDefines& ShaderDefines::Add(const std::string& lines)
+{
+    size_t start = 0;
+    while (start < lines.size())
+    {
+        size_t end = lines.find('\n', start);
+        if (end == std::string::npos)
+            end = lines.size();
+        std::string line = lines.substr(start, end - start);
+        start = end + 1;
+
+        // "#define NAME [VALUE]", anything else is passed through
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos)
+            continue;
+        if (line.compare(first, 7, "#define") != 0) {
+            other += line + "\n";
+            continue;
+        }
+
+        size_t nameStart = line.find_first_not_of(" \t", first + 7);
+        if (nameStart == std::string::npos)
+            continue;
+        size_t nameEnd = line.find_first_of(" \t", nameStart);
+        size_t valueStart = (nameEnd == std::string::npos) ? std::string::npos : line.find_first_not_of(" \t", nameEnd);
+
+        Set(line.substr(nameStart, nameEnd - nameStart),
+            valueStart == std::string::npos ? "" : line.substr(valueStart));
+    }
+    return *this;
+}
+
+std::string ShaderDefines::ToString() const
+{
+    std::string text = other;
+    for (const auto& value : values)
+        text += "#define " + value.first + (value.second.empty() ? "" : " " + value.second) + "\n";
+    return text;
+}
+
+// ------------------------- REQUESTS -------------------------
+
+ShaderLibrary::~ShaderLibrary() = default;
+
+Shader* ShaderLibrary::Request(const std::string& vs, const std::string& fs, const ShaderDefines& defines)
+{
+    std::string text = defines.ToString();
+
+    // Same permutation asked for before
+    Shader*& shader = permutations[vs + '\0' + fs + '\0' + text];
+    if (shader)
+        return shader;
+
+    owned.emplace_back(new Shader());
+    shader = owned.back().get();
+    Add(shader, vs, fs, text);
+    return shader;
+}
+
+Shader* ShaderLibrary::Get(const std::string& vs, const std::string& fs, const ShaderDefines& defines)
+{
+    Shader* shader = Request(vs, fs, defines);
+
+    // First use of this permutation
+    if (!shader->IsLinked())
+        Build();
+    return shader;
+}
+
+Shader* ShaderLibrary::RequestFeedback(const std::string& vs, const std::vector<const char*>& feedbackVaryings, const ShaderDefines& defines)
+{
+    std::string text = defines.ToString();
+
+    std::string key = std::string("feedback", 9) + vs + '\0' + text;
+    for (const char* varying : feedbackVaryings)
+        key += std::string("\0", 1) + varying;
+
+    Shader*& shader = permutations[key];
+    if (shader)
+        return shader;
+
+    owned.emplace_back(new Shader());
+    shader = owned.back().get();
+    AddFeedback(shader, vs, feedbackVaryings, text);
+    return shader;
+}
+
+void ShaderLibrary::Add(Shader* target, const std::string& vs, const std::string& fs, const std::string& defines)
+{
+    Entry entry;
+    entry.shader = target;
+    entry.vsPath = vs;
+    entry.fsPath = fs;
+    entry.defines = defines;
+    entries.push_back(entry);
+}
+
+void ShaderLibrary::AddFeedback(Shader* target, const std::string& vs, const std::vector<const char*>& feedbackVaryings, const std::string& defines)
+{
+    Entry entry;
+    entry.shader = target;
+    entry.vsPath = vs;
+    entry.defines = defines;
+    entry.varyings.assign(feedbackVaryings.begin(), feedbackVaryings.end());
+    entries.push_back(entry);
+}
+
+// ------------------------- BUILDING -------------------------
+
+bool ShaderLibrary::SupportsBinaries()
+{
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+ShaderBuildStats ShaderLibrary::Build(bool useCache)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    Clock::time_point t0 = Clock::now();
+
+    ShaderBuildStats stats;
+
+    // The driver may use as many compiler-threads as it likes, stages are submitted below without waiting on them
+    static bool threadsRequested = false;
+    if (!threadsRequested)
+    {
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+        threadsRequested = true;
+    }
+
+    bool binaries = SupportsBinaries();
+    std::vector<Entry*> compiling;
+
+    // Cached programs right away, everything else is handed to the compiler
+    for (Entry& entry : entries)
+    {
+        if (entry.built)
+            continue;
+        entry.built = true;
+        stats.programs++;
+
+        if (!LoadSources(entry)) {
+            stats.failed++;
+            continue;
+        }
+
+        entry.program = glCreateProgram();
+        if (useCache && binaries)
+        {
+            if (LoadBinary(entry, entry.program)) {
+                Adopt(entry);
+                stats.fromCache++;
+                continue;
+            }
+
+            // Refused binary leaves the program unusable, start over with a fresh one
+            glDeleteProgram(entry.program);
+            entry.program = glCreateProgram();
+        }
+
+        SubmitCompile(entry, entry.program, binaries);
+        compiling.push_back(&entry);
+    }
+
+    // First status-query, the programs after this one keep compiling meanwhile
+    for (Entry* entry : compiling)
+    {
+        if (!FinishCompile(*entry, entry->program)) {
+            glDeleteProgram(entry->program);
+            entry->program = 0;
+            stats.failed++;
+            continue;
+        }
+
+        if (binaries)
+            SaveBinary(*entry, entry->program);
+
+        Adopt(*entry);
+        stats.compiled++;
+    }
+
+    // Sources are only needed while building
+    for (Entry& entry : entries)
+    {
+        entry.vsSrc.clear();
+        entry.fsSrc.clear();
+    }
+
+    stats.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    return stats;
+}
+
+void ShaderLibrary::Unload()
+{
+    for (Entry& entry : entries)
+    {
+        if (entry.shader->program)
+            glDeleteProgram(entry.shader->program);
+
+        entry.shader->program = 0;
+        entry.shader->uniforms.clear();
+        entry.program = 0;
+        entry.built = false;
+    }
+
+    // A deleted name may come back from glCreateProgram while the tracker still thinks it's in use
+    InvalidateGLState();
+}
+
+void ShaderLibrary::Adopt(Entry& entry)
+{
+    entry.shader->program = entry.program;
+    entry.shader->Reflect();
+}
+
+void ShaderLibrary::SubmitCompile(Entry& entry, unsigned int program, bool retrievable)
+{
+    const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    const std::string* sources[2] = { &entry.vsSrc, &entry.fsSrc };
+    int numStages = entry.fsPath.empty() ? 1 : 2;
+
+    for (int s = 0; s < numStages; s++)
+    {
+        const char* src = sources[s]->c_str();
+
+        entry.stages[s] = glCreateShader(types[s]);
+        glShaderSource(entry.stages[s], 1, &src, nullptr);
+        glCompileShader(entry.stages[s]);
+        glAttachShader(program, entry.stages[s]);
+    }
+
+    // Captured outputs must be known before linking
+    if (!entry.varyings.empty())
+    {
+        std::vector<const char*> varyings;
+        for (const std::string& varying : entry.varyings)
+            varyings.push_back(varying.c_str());
+        glTransformFeedbackVaryings(program, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
+
+    if (retrievable)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(program);
+}
+
+bool ShaderLibrary::FinishCompile(Entry& entry, unsigned int program)
+{
+    // Test if program linked, waits for this program only
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    if (!success)
+    {
+        // Stage-errors first, they say more than the link-error they cause
+        const char* labels[2] = { "VERTEX", "FRAGMENT" };
+        const std::string* paths[2] = { &entry.vsPath, &entry.fsPath };
+        for (int s = 0; s < 2; s++)
+        {
+            if (!entry.stages[s])
+                continue;
+
+            GLint compiled;
+            glGetShaderiv(entry.stages[s], GL_COMPILE_STATUS, &compiled);
+            if (!compiled) {
+                char log[1024];
+                glGetShaderInfoLog(entry.stages[s], 1024, nullptr, log);
+                std::cerr << labels[s] << " SHADER ERROR (" << *paths[s] << "):\n" << log << std::endl;
+            }
+        }
+
+        char log[1024];
+        glGetProgramInfoLog(program, 1024, nullptr, log);
+        std::cerr << "SHADER LINK ERROR:\n" << log << std::endl;
+    }
+
+    // Delete shaders after linking so the they can be refilled
+    for (unsigned int& stage : entry.stages)
+    {
+        if (!stage)
+            continue;
+        glDetachShader(program, stage);
+        glDeleteShader(stage);
+        stage = 0;
+    }
+
+    return success == GL_TRUE;
+}
+
+// ------------------------- CACHE -------------------------
+
+bool ShaderLibrary::LoadBinary(Entry& entry, unsigned int program)
+{
+    std::ifstream file(CachePathFor(entry.key), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    ShaderCacheHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || header.magic != SHADER_CACHE_MAGIC
+        || header.version != SHADER_CACHE_VERSION || header.key != entry.key)
+        return false;
+
+    std::vector<char> binary(header.binarySize);
+    if (!file.read(binary.data(), (std::streamsize)binary.size()))
+        return false;
+
+    glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+
+    // Drivers refuse binaries of other versions, that counts as a cache-miss
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success == GL_TRUE;
+}
+
+void ShaderLibrary::SaveBinary(const Entry& entry, unsigned int program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    ShaderCacheHeader header;
+    header.magic = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.key = entry.key;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.binaryFormat = format;
+    header.binarySize = (uint32_t)length;
+
+    std::error_code ec;
+    std::filesystem::create_directories(SHADER_CACHE_DIR, ec);
+
+    // Write to a temporary file first so a crash never leaves a half-written binary
+    std::string cachePath = CachePathFor(entry.key);
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Shader cache: can't write '" << tempPath << "'\n";
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            std::cerr << "Shader cache: failed writing '" << tempPath << "'\n";
+            return;
+        }
+    }
+
+    std::filesystem::remove(cachePath, ec);
+    std::filesystem::rename(tempPath, cachePath, ec);
+    if (ec)
+        std::cerr << "Shader cache: can't rename '" << tempPath << "': " << ec.message() << "\n";
+}
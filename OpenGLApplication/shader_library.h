@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Shader;
+
+/*
+* Builds many shader-programs at once and keeps the linked programs on disk.
+*
+*   1. The sources of every requested program are loaded (#includes resolved)
+*      and hashed together with the defines, the feedback-varyings and the
+*      driver (GL_VENDOR/GL_RENDERER/GL_VERSION).
+*   2. Programs whose hash is in SHADER_CACHE_DIR are created straight from the
+*      stored binary (glProgramBinary), nothing is compiled. A binary the driver
+*      refuses (e.g. after a driver update) is compiled again and replaced.
+*   3. All other stages are compiled and linked without waiting for any of
+*      them, the status is only read once everything is submitted, so the
+*      driver can work on them in parallel (KHR/ARB_parallel_shader_compile
+*      gets as many compiler-threads as it wants).
+*   4. Freshly linked programs are written to the cache (glGetProgramBinary).
+*
+* A program is one permutation of its sources: the same files with the same
+* set of host-injected defines (ShaderDefines) are built once and shared,
+* whoever asks for them. Get() builds a permutation the first time it is
+* used, so variants nobody draws with are never compiled.
+*
+* The plain Shader-constructors build through a library of one program, so
+* they use the cache as well.
+*/
+
+#define SHADER_CACHE_DIR "ShaderCache"      // Relative to the working-directory, like the shader-sources
+#define SHADER_CACHE_VERSION 1              // Bump when the cache-file layout changes
+
+// What one Build() did
+struct ShaderBuildStats
+{
+    size_t programs = 0;    // Built by this call
+    size_t fromCache = 0;   // Created from a stored binary
+    size_t compiled = 0;    // Compiled + linked from source
+    size_t failed = 0;      // Left without a program (errors are printed)
+    double ms = 0.0;        // Wall-time of the whole call
+};
+
+// Host-injected defines of a shader-permutation (bone limit, influences, skinning-method, instancing...).
+// Always written out sorted by name, so the same set gives the same text and permutation-key whatever order it was built in
+class ShaderDefines
+{
+public:
+    ShaderDefines() = default;
+
+    // Lines of "#define NAME [VALUE]" as returned by GetShaderDefines() & co, other lines are kept as they are
+    ShaderDefines(const std::string& lines) { Add(lines); }
+    ShaderDefines(const char* lines) { Add(lines); }
+
+    ShaderDefines& Set(const std::string& name, const std::string& value = "");
+    ShaderDefines& Set(const std::string& name, int value) { return Set(name, std::to_string(value)); }
+    ShaderDefines& Add(const std::string& lines);
+
+    // Inserted after #version
+    std::string ToString() const;
+
+private:
+    std::map<std::string, std::string> values;  // Name -> value, sorted
+    std::string other;                          // Non-define lines (#extension...), in the order they were added
+};
+
+class ShaderLibrary
+{
+public:
+    ShaderLibrary() = default;
+    ~ShaderLibrary();
+
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+    // Permutation of a vertex- and fragment-shader, the defines go right after #version in both.
+    // The Shader is owned by the library and has no program until the next Build(), asking again returns the same one
+    Shader* Request(const std::string& vs, const std::string& fs, const ShaderDefines& defines = ShaderDefines());
+
+    // Same as Request() but built right away (with everything else requested so far) if it isn't already
+    Shader* Get(const std::string& vs, const std::string& fs, const ShaderDefines& defines = ShaderDefines());
+
+    // Vertex-shader only program whose outputs are captured with transform feedback (interleaved, in the given order)
+    Shader* RequestFeedback(const std::string& vs, const std::vector<const char*>& feedbackVaryings, const ShaderDefines& defines = ShaderDefines());
+
+    // Same as above for a Shader owned by the caller (used by the Shader-constructors)
+    void Add(Shader* target, const std::string& vs, const std::string& fs, const std::string& defines);
+    void AddFeedback(Shader* target, const std::string& vs, const std::vector<const char*>& feedbackVaryings, const std::string& defines);
+
+    // Builds every program requested since the last Build(), needs a current GL-context.
+    // useCache = false compiles everything (the cache is still rewritten)
+    ShaderBuildStats Build(bool useCache = true);
+
+    // Deletes the programs of all requests so the next Build() makes them again (the Shader-objects stay valid)
+    void Unload();
+
+    // Driver can hand out program-binaries at all (GL 4.1 / ARB_get_program_binary with at least one format)
+    static bool SupportsBinaries();
+
+private:
+    struct Entry
+    {
+        Shader* shader = nullptr;
+        std::string vsPath, fsPath;         // fsPath empty for feedback-programs
+        std::string defines;
+        std::vector<std::string> varyings;  // Transform feedback-outputs
+        bool built = false;
+
+        // Only used while building
+        std::string vsSrc, fsSrc;
+        uint64_t key = 0;
+        unsigned int program = 0;
+        unsigned int stages[2] = {};
+    };
+
+    bool LoadSources(Entry& entry);
+    bool LoadBinary(Entry& entry, unsigned int program);
+    void SaveBinary(const Entry& entry, unsigned int program);
+    void SubmitCompile(Entry& entry, unsigned int program, bool retrievable);
+    bool FinishCompile(Entry& entry, unsigned int program);
+    void Adopt(Entry& entry);
+
+    std::vector<Entry> entries;
+    std::vector<std::unique_ptr<Shader>> owned;     // Shaders handed out by Request()/RequestFeedback()
+    std::map<std::string, Shader*> permutations;    // Files + sorted defines (+ varyings) -> owned Shader
+};
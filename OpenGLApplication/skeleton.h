@@ -1,9 +1,15 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+#include "simd.h"
+#include "affine.h"
+
 /*
 * Class that represents a skeleton while the program is running.
 * 
@@ -11,6 +17,11 @@
 * 
 * Needed since Assimp doesn't provide a skeleton, only the nodes
 * where some of which are bones.
+* 
+* Split in a "cold" description (names, bind-pose, only used when loading
+* and for debugging) and a "hot" pose that is updated every frame. The pose
+* is stored as separate contiguous arrays so per-frame passes only pull
+* the data they need through the cache. Both use the same bone-indices.
 */
 
 
@@ -24,15 +35,53 @@ struct Bone
     // Assimp data
     glm::mat4 offsetMatrix{ 1.0f };      // Vertex-to-bone-space
     glm::mat4 localBindPose{ 1.0f };     // Node transform in bind pose, refrence pose
+};
 
-    // Runtime transforms - needed for animation
-    glm::mat4 localPose{ 1.0f };         // Current local pose (anim & physics), will be overwritten every frame
-    glm::mat4 globalPose{ 1.0f };        // Final world-space transform, computed outcome of the chain of offset-matrices, needed for skinning and constraints
+// Represents a full skeleton hierarchy (cold data)
+struct SkeletonDesc
+{
+    std::vector<Bone> bones;                                // Sorted by depth, a parent always has a lower index than its children
+    std::unordered_map<std::string, int> boneNameToIndex;   // Has same index/placement as in Main::vertex_to_bones
+    std::vector<int> levelOffsets;                          // Bones [levelOffsets[d], levelOffsets[d + 1]) are at depth d, they only depend on earlier levels
 };
 
-// Represents a full skeleton hierarchy
+// Runtime transforms - needed for animation (hot data)
+struct SkeletonPose
+{
+    // Current local pose (anim & physics) as translation/rotation/scale, will be overwritten every frame
+    AlignedVector<glm::vec3> localTranslations;
+    AlignedVector<glm::quat> localRotations;
+    AlignedVector<glm::vec3> localScales;
+
+    AlignedVector<Affine3x4> globalPoses;       // Final model-space transform, computed outcome of the chain of local poses, needed for skinning and constraints
+    AlignedVector<Affine3x4> offsetMatrices;    // Copy of Bone::offsetMatrix
+    AlignedVector<int> parentIndices;           // Copy of Bone::parentIndex
+    std::vector<int> levelOffsets;              // Copy of SkeletonDesc::levelOffsets
+
+    // 1 = local pose changed since the last palette-pass, spreads to the children in the hierarchy-pass.
+    // Only dirty bones get a new global pose and palette-entry, the palette-pass clears the flags
+    AlignedVector<uint8_t> dirty;
+    AlignedVector<uint8_t> paletteStale;        // Nr of palette-copies (ring-buffered) that still hold an old entry for the bone
+
+    size_t Size() const { return parentIndices.size(); }
+
+    // Overwrites the whole local pose of a bone
+    void SetLocalPose(size_t bone, const glm::vec3& t, const glm::quat& r, const glm::vec3& s = glm::vec3(1.0f))
+    {
+        localTranslations[bone] = t;
+        localRotations[bone] = r;
+        localScales[bone] = s;
+        dirty[bone] = 1;
+    }
+
+    // Must be called after writing the local arrays directly
+    void MarkDirty(size_t bone) { dirty[bone] = 1; }
+    void MarkAllDirty() { std::fill(dirty.begin(), dirty.end(), (uint8_t)1); }
+};
+
+// Description + pose
 struct Skeleton
 {
-    std::vector<Bone> bones;
-    std::unordered_map<std::string, int> boneNameToIndex;   // Has same index/placement as in Main::vertex_to_bones
-};
\ No newline at end of file
+    SkeletonDesc desc;
+    SkeletonPose pose;
+};
@@ -0,0 +1,592 @@
+#include "skeleton_pose.h"
+#include "thread_pool.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+
+/*
+* Per-frame passes over a SkeletonPose: the hierarchy-pass
+* (local -> global) and the palette-pass (global * offset).
+*
+* Both work straight on the contiguous pose-arrays and use SSE, or AVX2
+* when the CPU has it. Bones of the same depth don't depend on each
+* other so they are done 4 at a time, and large levels are split over
+* worker-threads.
+*
+* Local poses are translation/rotation/scale, they are turned into a 3x4
+* affine right before being composed with the parent. Everything after that
+* (global poses, offsets, palette) is 3x4: out.row[r] = sum_k a[r][k] * b.row[k],
+* plus a[r][3] in the translation, 9 multiply-adds per row instead of 16 for a mat4.
+*
+* The fused pass (ComputePosePalette) does both in one go per bone and writes the
+* palette-entry straight to its destination, normally a mapped GPU-buffer.
+*/
+
+// ------------------------- KERNELS -------------------------
+
+// out = a * b for one pair of 3x4 affine transforms (12 floats each, rows), out may not alias a or b
+static inline void MulAffineSSE(const float* a, const float* b, float* out)
+{
+    __m128 b0 = _mm_loadu_ps(b + 0);
+    __m128 b1 = _mm_loadu_ps(b + 4);
+    __m128 b2 = _mm_loadu_ps(b + 8);
+    __m128 e3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);   // Implicit last row (0, 0, 0, 1)
+
+    for (int r = 0; r < 3; r++)
+    {
+        __m128 row = _mm_mul_ps(b0, _mm_set1_ps(a[r * 4 + 0]));
+        row = _mm_add_ps(row, _mm_mul_ps(b1, _mm_set1_ps(a[r * 4 + 1])));
+        row = _mm_add_ps(row, _mm_mul_ps(b2, _mm_set1_ps(a[r * 4 + 2])));
+        row = _mm_add_ps(row, _mm_mul_ps(e3, _mm_set1_ps(a[r * 4 + 3])));
+        _mm_storeu_ps(out + r * 4, row);
+    }
+}
+
+// Same as MulAffineSSE but rows 0 and 1 share one 256-bit register
+SIMD_TARGET_AVX2 static inline void MulAffineAVX(const float* a, const float* b, float* out)
+{
+    // Every row of b in both 128-bit lanes
+    __m256 b0 = _mm256_broadcast_ps((const __m128*)(b + 0));
+    __m256 b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+    __m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8));
+    __m256 e3 = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+
+    // Row 0 of a in the low lane, row 1 in the high lane
+    __m256 a01 = _mm256_loadu_ps(a);
+    __m256 r01 = _mm256_mul_ps(b0, _mm256_permute_ps(a01, 0x00));
+    r01 = _mm256_fmadd_ps(b1, _mm256_permute_ps(a01, 0x55), r01);
+    r01 = _mm256_fmadd_ps(b2, _mm256_permute_ps(a01, 0xAA), r01);
+    r01 = _mm256_fmadd_ps(e3, _mm256_permute_ps(a01, 0xFF), r01);
+    _mm256_storeu_ps(out, r01);
+
+    // Row 2
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 r2 = _mm_mul_ps(_mm256_castps256_ps128(b0), _mm_permute_ps(a2, 0x00));
+    r2 = _mm_fmadd_ps(_mm256_castps256_ps128(b1), _mm_permute_ps(a2, 0x55), r2);
+    r2 = _mm_fmadd_ps(_mm256_castps256_ps128(b2), _mm_permute_ps(a2, 0xAA), r2);
+    r2 = _mm_fmadd_ps(_mm256_castps256_ps128(e3), _mm_permute_ps(a2, 0xFF), r2);
+    _mm_storeu_ps(out + 8, r2);
+}
+
+// Local TRS of 4 bones to affine, written to out[0..3]
+static inline void LocalAffine4(const SkeletonPose& pose, size_t i, Affine3x4* out)
+{
+    for (size_t k = 0; k < 4; k++)
+        out[k] = AffineFromTRS(pose.localTranslations[i + k], pose.localRotations[i + k], pose.localScales[i + k]);
+}
+
+// Flat view of an Affine3x4-array (12 floats per bone), from .data() so an empty pose never touches element 0
+static float* AffineFloats(Affine3x4* affines)
+{
+    return reinterpret_cast<float*>(affines);
+}
+
+static const float* AffineFloats(const Affine3x4* affines)
+{
+    return reinterpret_cast<const float*>(affines);
+}
+
+// global[i] = global[parent[i]] * local[i] for bones [first, last), parents must be done already
+static void HierarchyRangeSSE(SkeletonPose& pose, size_t first, size_t last)
+{
+    const int* parents = pose.parentIndices.data();
+    float* global = AffineFloats(pose.globalPoses.data());
+    Affine3x4 local[4];
+
+    size_t i = first;
+
+    // 4 bones per iteration, they are independent within a level
+    for (; i + 4 <= last; i += 4)
+    {
+        LocalAffine4(pose, i, local);
+        MulAffineSSE(global + parents[i + 0] * 12, &local[0].rows[0][0], global + (i + 0) * 12);
+        MulAffineSSE(global + parents[i + 1] * 12, &local[1].rows[0][0], global + (i + 1) * 12);
+        MulAffineSSE(global + parents[i + 2] * 12, &local[2].rows[0][0], global + (i + 2) * 12);
+        MulAffineSSE(global + parents[i + 3] * 12, &local[3].rows[0][0], global + (i + 3) * 12);
+    }
+
+    // Rest
+    for (; i < last; i++)
+    {
+        local[0] = AffineFromTRS(pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+        MulAffineSSE(global + parents[i] * 12, &local[0].rows[0][0], global + i * 12);
+    }
+}
+
+SIMD_TARGET_AVX2 static void HierarchyRangeAVX(SkeletonPose& pose, size_t first, size_t last)
+{
+    const int* parents = pose.parentIndices.data();
+    float* global = AffineFloats(pose.globalPoses.data());
+    Affine3x4 local[4];
+
+    size_t i = first;
+
+    // 4 bones per iteration, they are independent within a level
+    for (; i + 4 <= last; i += 4)
+    {
+        LocalAffine4(pose, i, local);
+        MulAffineAVX(global + parents[i + 0] * 12, &local[0].rows[0][0], global + (i + 0) * 12);
+        MulAffineAVX(global + parents[i + 1] * 12, &local[1].rows[0][0], global + (i + 1) * 12);
+        MulAffineAVX(global + parents[i + 2] * 12, &local[2].rows[0][0], global + (i + 2) * 12);
+        MulAffineAVX(global + parents[i + 3] * 12, &local[3].rows[0][0], global + (i + 3) * 12);
+    }
+
+    // Rest
+    for (; i < last; i++)
+    {
+        local[0] = AffineFromTRS(pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+        MulAffineAVX(global + parents[i] * 12, &local[0].rows[0][0], global + i * 12);
+    }
+
+    _mm256_zeroupper();
+}
+
+// palette[i] = global[i] * offset[i] for bones [first, last)
+static void PaletteRangeSSE(const SkeletonPose& pose, float* palette, size_t first, size_t last)
+{
+    const float* global = AffineFloats(pose.globalPoses.data());
+    const float* offset = AffineFloats(pose.offsetMatrices.data());
+
+    size_t i = first;
+    for (; i + 4 <= last; i += 4)
+    {
+        MulAffineSSE(global + (i + 0) * 12, offset + (i + 0) * 12, palette + (i + 0) * 12);
+        MulAffineSSE(global + (i + 1) * 12, offset + (i + 1) * 12, palette + (i + 1) * 12);
+        MulAffineSSE(global + (i + 2) * 12, offset + (i + 2) * 12, palette + (i + 2) * 12);
+        MulAffineSSE(global + (i + 3) * 12, offset + (i + 3) * 12, palette + (i + 3) * 12);
+    }
+    for (; i < last; i++)
+        MulAffineSSE(global + i * 12, offset + i * 12, palette + i * 12);
+}
+
+SIMD_TARGET_AVX2 static void PaletteRangeAVX(const SkeletonPose& pose, float* palette, size_t first, size_t last)
+{
+    const float* global = AffineFloats(pose.globalPoses.data());
+    const float* offset = AffineFloats(pose.offsetMatrices.data());
+
+    size_t i = first;
+    for (; i + 4 <= last; i += 4)
+    {
+        MulAffineAVX(global + (i + 0) * 12, offset + (i + 0) * 12, palette + (i + 0) * 12);
+        MulAffineAVX(global + (i + 1) * 12, offset + (i + 1) * 12, palette + (i + 1) * 12);
+        MulAffineAVX(global + (i + 2) * 12, offset + (i + 2) * 12, palette + (i + 2) * 12);
+        MulAffineAVX(global + (i + 3) * 12, offset + (i + 3) * 12, palette + (i + 3) * 12);
+    }
+    for (; i < last; i++)
+        MulAffineAVX(global + i * 12, offset + i * 12, palette + i * 12);
+
+    _mm256_zeroupper();
+}
+
+// Hierarchy- and palette-pass in one, global[i] = global[parent[i]] * local[i] and palette[i] = global[i] * offset[i]
+// while the global pose is still in registers/L1. palette is only written to, it can be write-combined GPU-memory
+static void FusedRangeSSE(SkeletonPose& pose, float* palette, size_t first, size_t last)
+{
+    const int* parents = pose.parentIndices.data();
+    float* global = AffineFloats(pose.globalPoses.data());
+    const float* offset = AffineFloats(pose.offsetMatrices.data());
+    Affine3x4 local[4];
+
+    size_t i = first;
+    for (; i + 4 <= last; i += 4)
+    {
+        LocalAffine4(pose, i, local);
+        for (size_t k = 0; k < 4; k++)
+        {
+            MulAffineSSE(global + parents[i + k] * 12, &local[k].rows[0][0], global + (i + k) * 12);
+            MulAffineSSE(global + (i + k) * 12, offset + (i + k) * 12, palette + (i + k) * 12);
+        }
+    }
+
+    // Rest
+    for (; i < last; i++)
+    {
+        local[0] = AffineFromTRS(pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+        MulAffineSSE(global + parents[i] * 12, &local[0].rows[0][0], global + i * 12);
+        MulAffineSSE(global + i * 12, offset + i * 12, palette + i * 12);
+    }
+}
+
+SIMD_TARGET_AVX2 static void FusedRangeAVX(SkeletonPose& pose, float* palette, size_t first, size_t last)
+{
+    const int* parents = pose.parentIndices.data();
+    float* global = AffineFloats(pose.globalPoses.data());
+    const float* offset = AffineFloats(pose.offsetMatrices.data());
+    Affine3x4 local[4];
+
+    size_t i = first;
+    for (; i + 4 <= last; i += 4)
+    {
+        LocalAffine4(pose, i, local);
+        for (size_t k = 0; k < 4; k++)
+        {
+            MulAffineAVX(global + parents[i + k] * 12, &local[k].rows[0][0], global + (i + k) * 12);
+            MulAffineAVX(global + (i + k) * 12, offset + (i + k) * 12, palette + (i + k) * 12);
+        }
+    }
+
+    // Rest
+    for (; i < last; i++)
+    {
+        local[0] = AffineFromTRS(pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+        MulAffineAVX(global + parents[i] * 12, &local[0].rows[0][0], global + i * 12);
+        MulAffineAVX(global + i * 12, offset + i * 12, palette + i * 12);
+    }
+
+    _mm256_zeroupper();
+}
+
+// Picks the AVX2 or SSE version of the hierarchy-pass
+static void HierarchyRange(SkeletonPose& pose, size_t first, size_t last)
+{
+    if (CpuSupportsAVX2())
+        HierarchyRangeAVX(pose, first, last);
+    else
+        HierarchyRangeSSE(pose, first, last);
+}
+
+// Pulls the dirty-flag down from the parents, then evaluates every run of dirty bones in [first, last).
+// Returns the number of bones evaluated
+static size_t HierarchyDirtyRange(SkeletonPose& pose, size_t first, size_t last)
+{
+    const int* parents = pose.parentIndices.data();
+    uint8_t* dirty = pose.dirty.data();
+
+    for (size_t i = first; i < last; i++)
+        dirty[i] |= dirty[parents[i]];
+
+    size_t evaluated = 0;
+    size_t i = first;
+    while (i < last)
+    {
+        if (!dirty[i]) {
+            i++;
+            continue;
+        }
+
+        // Longest run of dirty bones from here, wherever in the level they are (a dirty subtree can be spread over several runs)
+        size_t runEnd = i + 1;
+        while (runEnd < last && dirty[runEnd])
+            runEnd++;
+
+        HierarchyRange(pose, i, runEnd);
+        evaluated += runEnd - i;
+        i = runEnd;
+    }
+    return evaluated;
+}
+
+// Bones evaluated / palette-entries written by one range of a level
+struct RangeCounts
+{
+    size_t evaluated = 0;
+    size_t written = 0;
+};
+
+// Fused version of HierarchyDirtyRange: dirty bones get a new global pose + palette-entry, bones that
+// changed in one of the last paletteCopies frames only get their (unchanged) palette-entry rewritten
+static RangeCounts PoseDirtyRange(SkeletonPose& pose, float* palette, unsigned int paletteCopies, size_t first, size_t last)
+{
+    const int* parents = pose.parentIndices.data();
+    uint8_t* dirty = pose.dirty.data();
+    uint8_t* stale = pose.paletteStale.data();
+    bool avx = CpuSupportsAVX2();
+
+    for (size_t i = first; i < last; i++)
+        dirty[i] |= dirty[parents[i]];
+
+    RangeCounts counts;
+    size_t i = first;
+    while (i < last)
+    {
+        size_t runEnd = i + 1;
+
+        if (dirty[i])
+        {
+            // Run of dirty bones
+            while (runEnd < last && dirty[runEnd])
+                runEnd++;
+
+            if (avx)
+                FusedRangeAVX(pose, palette, i, runEnd);
+            else
+                FusedRangeSSE(pose, palette, i, runEnd);
+
+            // This copy is done, the other copies still have the old entry
+            std::fill(stale + i, stale + runEnd, (uint8_t)(paletteCopies - 1));
+            counts.evaluated += runEnd - i;
+            counts.written += runEnd - i;
+        }
+        else if (stale[i])
+        {
+            // Run of unchanged bones whose entry in this copy is out of date
+            while (runEnd < last && !dirty[runEnd] && stale[runEnd])
+                runEnd++;
+
+            if (avx)
+                PaletteRangeAVX(pose, palette, i, runEnd);
+            else
+                PaletteRangeSSE(pose, palette, i, runEnd);
+
+            for (size_t k = i; k < runEnd; k++)
+                stale[k]--;
+            counts.written += runEnd - i;
+        }
+
+        i = runEnd;
+    }
+    return counts;
+}
+
+// ------------------------- PASSES -------------------------
+
+void InitSkeletonPose(SkeletonPose& pose, const SkeletonDesc& desc)
+{
+    size_t numBones = desc.bones.size();
+
+    pose.localTranslations.resize(numBones);
+    pose.localRotations.resize(numBones);
+    pose.localScales.resize(numBones);
+    pose.globalPoses.resize(numBones);
+    pose.offsetMatrices.resize(numBones);
+    pose.parentIndices.resize(numBones);
+    pose.dirty.resize(numBones);
+    pose.paletteStale.assign(numBones, 0);
+    pose.levelOffsets = desc.levelOffsets;
+
+    // Start runtime pose equal to bind pose
+    for (size_t i = 0; i < numBones; i++)
+    {
+        DecomposeTRS(desc.bones[i].localBindPose, pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+        pose.globalPoses[i] = Affine3x4();
+        pose.offsetMatrices[i] = AffineFromMat4(desc.bones[i].offsetMatrix);
+        pose.parentIndices[i] = desc.bones[i].parentIndex;
+    }
+
+    // Nothing computed yet
+    pose.MarkAllDirty();
+}
+
+size_t ComputeGlobalPoses(SkeletonPose& pose, ThreadPool* pool, size_t parallelMinBones)
+{
+    // Unrigged model, nothing to evaluate
+    if (pose.Size() == 0 || pose.levelOffsets.size() < 2)
+        return 0;
+
+    size_t evaluated = 0;
+
+    // Level 0 only has roots: local = global (doesnt have parent)
+    for (int i = pose.levelOffsets[0]; i < pose.levelOffsets[1]; i++)
+    {
+        if (!pose.dirty[i])
+            continue;
+
+        pose.globalPoses[i] = AffineFromTRS(pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+        evaluated++;
+    }
+
+    // Every other level only depends on the level before it
+    for (size_t level = 1; level + 1 < pose.levelOffsets.size(); level++)
+    {
+        size_t first = pose.levelOffsets[level];
+        size_t last = pose.levelOffsets[level + 1];
+
+        if (pool && last - first >= parallelMinBones)
+        {
+            std::atomic<size_t> levelEvaluated{ 0 };
+            pool->ParallelFor(last - first, parallelMinBones / 4, [&](size_t begin, size_t end) {
+                levelEvaluated += HierarchyDirtyRange(pose, first + begin, first + end);
+            });
+            evaluated += levelEvaluated;
+        }
+        else
+            evaluated += HierarchyDirtyRange(pose, first, last);
+    }
+
+    return evaluated;
+}
+
+PoseUpdateStats ComputePosePalette(SkeletonPose& pose, Affine3x4* outPalette, unsigned int paletteCopies, ThreadPool* pool, size_t parallelMinBones)
+{
+    PoseUpdateStats stats;
+    // Unrigged model, nothing to evaluate
+    if (pose.Size() == 0 || pose.levelOffsets.size() < 2)
+        return stats;
+
+    float* palette = AffineFloats(outPalette);
+    paletteCopies = std::max(paletteCopies, 1u);
+
+    // Level 0 only has roots: local = global (doesnt have parent)
+    for (int i = pose.levelOffsets[0]; i < pose.levelOffsets[1]; i++)
+    {
+        if (pose.dirty[i])
+        {
+            pose.globalPoses[i] = AffineFromTRS(pose.localTranslations[i], pose.localRotations[i], pose.localScales[i]);
+            pose.paletteStale[i] = (uint8_t)(paletteCopies - 1);
+            stats.bonesEvaluated++;
+        }
+        else if (pose.paletteStale[i])
+            pose.paletteStale[i]--;
+        else
+            continue;
+
+        Affine3x4 entry = AffineMul(pose.globalPoses[i], pose.offsetMatrices[i]);
+        std::copy(&entry.rows[0][0], &entry.rows[0][0] + 12, palette + i * 12);
+        stats.paletteWritten++;
+    }
+
+    // Every other level only depends on the level before it
+    for (size_t level = 1; level + 1 < pose.levelOffsets.size(); level++)
+    {
+        size_t first = pose.levelOffsets[level];
+        size_t last = pose.levelOffsets[level + 1];
+
+        if (pool && last - first >= parallelMinBones)
+        {
+            std::atomic<size_t> levelEvaluated{ 0 }, levelWritten{ 0 };
+            pool->ParallelFor(last - first, parallelMinBones / 4, [&](size_t begin, size_t end) {
+                RangeCounts counts = PoseDirtyRange(pose, palette, paletteCopies, first + begin, first + end);
+                levelEvaluated += counts.evaluated;
+                levelWritten += counts.written;
+            });
+            stats.bonesEvaluated += levelEvaluated;
+            stats.paletteWritten += levelWritten;
+        }
+        else
+        {
+            RangeCounts counts = PoseDirtyRange(pose, palette, paletteCopies, first, last);
+            stats.bonesEvaluated += counts.evaluated;
+            stats.paletteWritten += counts.written;
+        }
+    }
+
+    // Children have seen their parents' flags, everything is up to date
+    std::fill(pose.dirty.begin(), pose.dirty.end(), (uint8_t)0);
+    return stats;
+}
+
+// ------------------------- BENCHMARK -------------------------
+
+// Layout of Bone before the hot/cold split, used as the baseline
+struct BenchBoneAoS
+{
+    std::string name;
+    int parentIndex = -1;
+    glm::mat4 offsetMatrix{ 1.0f };
+    glm::mat4 localBindPose{ 1.0f };
+    glm::mat4 localPose{ 1.0f };
+    glm::mat4 globalPose{ 1.0f };
+};
+
+// Random depth-sorted skeleton, levels grow x2 (like limbs splitting into fingers)
+static void MakeBenchSkeleton(size_t numBones, SkeletonDesc& outDesc, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> angle(-1.0f, 1.0f);
+
+    outDesc.bones.resize(numBones);
+    outDesc.levelOffsets.assign(1, 0);
+
+    size_t levelStart = 0, levelSize = 1;
+    size_t prevStart = 0, prevSize = 0;
+    for (size_t i = 0; i < numBones; i++)
+    {
+        // Next level
+        if (i == levelStart + levelSize) {
+            outDesc.levelOffsets.push_back((int)i);
+            prevStart = levelStart;
+            prevSize = levelSize;
+            levelStart = i;
+            levelSize = std::min(levelSize * 2, numBones - i);
+        }
+
+        Bone& bone = outDesc.bones[i];
+        bone.name = "bone_" + std::to_string(i);
+        bone.parentIndex = (i == 0) ? -1 : (int)(prevStart + rng() % prevSize);
+
+        glm::vec3 axis = glm::normalize(glm::vec3(angle(rng), angle(rng), angle(rng)) + glm::vec3(0.0f, 0.0f, 2.0f));
+        bone.localBindPose = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(glm::mat4(1.0f), angle(rng), axis);
+        bone.offsetMatrix = glm::inverse(bone.localBindPose);
+    }
+    outDesc.levelOffsets.push_back((int)numBones);
+}
+
+void BenchmarkPoseKernels()
+{
+    using Clock = std::chrono::high_resolution_clock;
+    std::mt19937 rng(1234);
+
+    printf("\n**************************************************\n");
+    printf("Pose kernels: array-of-Bone mat4 vs SoA TRS/3x4 %s (hierarchy + palette, single thread)\n\n", CpuSupportsAVX2() ? "AVX2" : "SSE");
+    printf("%8s %16s %16s %10s\n", "Bones", "AoS (ns/bone)", "SoA (ns/bone)", "Speedup");
+
+    const size_t sizes[] = { 64, 256, 1024, 4096 };
+    for (size_t numBones : sizes)
+    {
+        SkeletonDesc desc;
+        MakeBenchSkeleton(numBones, desc, rng);
+
+        // Baseline, the old loops over an array of Bone
+        std::vector<BenchBoneAoS> aos(numBones);
+        for (size_t i = 0; i < numBones; i++)
+        {
+            aos[i].name = desc.bones[i].name;
+            aos[i].parentIndex = desc.bones[i].parentIndex;
+            aos[i].offsetMatrix = desc.bones[i].offsetMatrix;
+            aos[i].localBindPose = desc.bones[i].localBindPose;
+            aos[i].localPose = desc.bones[i].localBindPose;
+        }
+        std::vector<glm::mat4> aosPalette(numBones);
+
+        SkeletonPose pose;
+        InitSkeletonPose(pose, desc);
+        AlignedVector<Affine3x4> palette(numBones);
+
+        // Same amount of work for every size
+        size_t iterations = std::max<size_t>(50, 4000000 / numBones);
+
+        auto t0 = Clock::now();
+        for (size_t it = 0; it < iterations; it++)
+        {
+            for (size_t i = 0; i < numBones; i++)
+            {
+                BenchBoneAoS& bone = aos[i];
+                if (bone.parentIndex == -1)
+                    bone.globalPose = bone.localPose;
+                else
+                    bone.globalPose = aos[bone.parentIndex].globalPose * bone.localPose;
+            }
+            for (size_t i = 0; i < numBones; i++)
+                aosPalette[i] = aos[i].globalPose * aos[i].offsetMatrix;
+        }
+        auto t1 = Clock::now();
+        for (size_t it = 0; it < iterations; it++)
+        {
+            // Full evaluation, like an animated rig where every bone moves
+            pose.MarkAllDirty();
+            ComputePosePalette(pose, palette.data());
+        }
+        auto t2 = Clock::now();
+
+        // Both must agree
+        float maxDiff = 0.0f;
+        for (size_t i = 0; i < numBones; i++)
+        {
+            glm::mat4 m = AffineToMat4(palette[i]);
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    maxDiff = std::max(maxDiff, std::abs(m[c][r] - aosPalette[i][c][r]));
+        }
+
+        double aosNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)(iterations * numBones);
+        double soaNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / (double)(iterations * numBones);
+        printf("%8zu %16.2f %16.2f %9.2fx   (max diff %g)\n", numBones, aosNs, soaNs, aosNs / soaNs, maxDiff);
+    }
+    printf("\n");
+}
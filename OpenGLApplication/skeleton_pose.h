@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "skeleton.h"
+
+class ThreadPool;
+
+/*
+* Per-frame passes over a SkeletonPose: the hierarchy-pass
+* (local -> global) and the palette-pass (global * offset).
+*
+* Both work straight on the contiguous pose-arrays and use SSE, or AVX2
+* when the CPU has it. Bones of the same depth don't depend on each
+* other so they are done 4 at a time, and large levels are split over
+* worker-threads.
+*
+* Only bones marked dirty (and everything below them) are evaluated, so
+* a mostly static rig costs next to nothing. Bones are stored level-major
+* (sorted by depth), within a level they keep the order the model listed
+* them in (stable sort), so a dirty subtree is not necessarily contiguous.
+*/
+
+// What one ComputePosePalette call did
+struct PoseUpdateStats
+{
+    size_t bonesEvaluated = 0;  // New global pose computed
+    size_t paletteWritten = 0;  // Palette-entries written to the destination
+};
+
+// Sets up the pose-arrays from a (depth-sorted) description, local pose starts as bind pose and every bone is dirty
+void InitSkeletonPose(SkeletonPose& pose, const SkeletonDesc& desc);
+
+// globalPoses = parent.globalPose * TRS(local), as 3x4 affine, level by level (parents first), for dirty bones only.
+// Levels with at least parallelMinBones bones are split over the pool (nullptr = single thread).
+// Returns the number of bones evaluated. Keeps the dirty-flags, use it when only the global poses are needed
+size_t ComputeGlobalPoses(SkeletonPose& pose, ThreadPool* pool = nullptr, size_t parallelMinBones = 512);
+
+// Fused hierarchy- and palette-pass: global poses of dirty bones and outPalette[i] = globalPose * offsetMatrix,
+// the final bone-matrices used by the vertex-shader (mat3x4 in GLSL). outPalette is only written, never read.
+// paletteCopies = nr of palettes used round-robin (e.g. a triple-buffered GPU-buffer), a changed entry is
+// rewritten in each of them. Clears the dirty-flags
+PoseUpdateStats ComputePosePalette(SkeletonPose& pose, Affine3x4* outPalette, unsigned int paletteCopies = 1,
+    ThreadPool* pool = nullptr, size_t parallelMinBones = 512);
+
+// Times the SoA/SIMD kernels against the old array-of-Bone loops for 64/256/1024/4096 bones and prints the result
+void BenchmarkPoseKernels();
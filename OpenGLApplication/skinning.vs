@@ -1,32 +1,89 @@
 #version 330 core
 
-layout (location = 0) in vec3 aPosition;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in ivec4 aBoneIDs;
-layout (location = 3) in vec4 aWeights;
+// One source for every skinning-variant, the host picks the permutation with defines (see ShaderDefines):
+//   NUM_INFLUENCES       bones blended per vertex (default 4, see vertex_inputs.glsl)
+//   DUAL_QUAT_SKINNING   palette holds dual quaternions instead of 3x4 matrices (dual_quat.h)
+//   INSTANCED            crowd-instances, per-instance model-matrix and palette-offset (see Crowd)
+//   BONE_PALETTE_*, MAX_SHADER_BONES, PACKED_*   palette- and vertex-layout, from BonePaletteBuffer and vertex_packing.h
 
-uniform mat4 MVP;
+#include "vertex_inputs.glsl"
 
-// Must match your uploadBoneMatrices clamp
-uniform mat4 uBones[128];
+#ifdef INSTANCED
+// Per instance (divisor 1), see Crowd
+layout (location = 6) in mat4 aInstanceModel;   // Takes locations 6-9 (4/5 are the extra influences of 8-influence models)
+layout (location = 10) in int aPaletteOffset;   // First bone of this instance's palette
+#define PALETTE_OFFSET aPaletteOffset
+#endif
+
+#include "frame_constants.glsl"
+
+#include "bone_palette.glsl"
+
+#ifdef DUAL_QUAT_SKINNING
+// Adds a weighted bone, flipped when it is on the other hemisphere than the first one (q and -q are the same rotation)
+void AddBone(inout mat2x4 blend, vec4 pivot, int id, float weight)
+{
+    mat2x4 dq = GetBone(id);
+    blend += (dot(dq[0], pivot) < 0.0 ? -weight : weight) * dq;
+}
+#define ADD_BONE(id, weight) AddBone(blend, first[0], id, weight)
+#else
+#define ADD_BONE(id, weight) blend += weight * GetBone(id)
+#endif
 
 out vec3 vNormal;
 
 void main()
 {
-    // Compute skinning matrix
-    mat4 skinMatrix =
-          aWeights.x * uBones[aBoneIDs.x]
-        + aWeights.y * uBones[aBoneIDs.y]
-        + aWeights.z * uBones[aBoneIDs.z]
-        + aWeights.w * uBones[aBoneIDs.w];
+    // Blend the bones, only as many as the variant needs (dual quaternions relative to the first bone)
+    Bone first = GetBone(aBoneIDs.x);
+    Bone blend = aWeights.x * first;
+#if NUM_INFLUENCES > 1
+    ADD_BONE(aBoneIDs.y, aWeights.y);
+#endif
+#if NUM_INFLUENCES > 2
+    ADD_BONE(aBoneIDs.z, aWeights.z);
+#endif
+#if NUM_INFLUENCES > 3
+    ADD_BONE(aBoneIDs.w, aWeights.w);
+#endif
+#if NUM_INFLUENCES > 4
+    ADD_BONE(aBoneIDs2.x, aWeights2.x);
+    ADD_BONE(aBoneIDs2.y, aWeights2.y);
+    ADD_BONE(aBoneIDs2.z, aWeights2.z);
+    ADD_BONE(aBoneIDs2.w, aWeights2.w);
+#endif
 
+#ifdef DUAL_QUAT_SKINNING
+    // Back to a unit dual quaternion, all-zero weights (unweighted vertex) keep the bind pose (identity)
+    float blendLength = length(blend[0]);
+    blend = blendLength > 1e-6 ? blend / blendLength : mat2x4(vec4(0.0, 0.0, 0.0, 1.0), vec4(0.0));
+    vec3 r = blend[0].xyz;
+    float rw = blend[0].w;
+    vec3 d = blend[1].xyz;
+    float dw = blend[1].w;
+
+    // Rotate, then translate by 2 * dual * conjugate(real)
+    vec3 position = aPosition;
+    vec4 skinnedPosition = vec4(position + 2.0 * cross(r, cross(r, position) + rw * position), 1.0);
+    skinnedPosition.xyz += 2.0 * (rw * d - dw * r + cross(r, d));
+
+    // Transform normal (rotation only)
+    vec3 normal = aNormal;
+    vec3 skinnedNormal = normal + 2.0 * cross(r, cross(r, normal) + rw * normal);
+#else
     // Apply skinning
-    vec4 skinnedPosition = skinMatrix * vec4(aPosition, 1.0);
+    vec4 skinnedPosition = vec4(vec4(aPosition, 1.0) * blend, 1.0);
+    vec3 skinnedNormal = vec4(aNormal, 0.0) * blend;
+#endif
 
+#ifdef INSTANCED
+    // Skinned in model-space, then place the instance (instances are only rotated/translated)
+    gl_Position = uViewProjection * aInstanceModel * skinnedPosition;
+    vNormal = mat3(aInstanceModel) * skinnedNormal;
+#else
     // Final position
-    gl_Position = MVP * skinnedPosition;
-
-    // Transform normal
-    vNormal = mat3(skinMatrix) * aNormal;
-}
\ No newline at end of file
+    gl_Position = uModelViewProjection * skinnedPosition;
+    vNormal = skinnedNormal;
+#endif
+}
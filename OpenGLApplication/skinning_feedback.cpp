@@ -0,0 +1,79 @@
+#include "skinning_feedback.h"
+#include "bone_palette_buffer.h"
+#include "cpu_skinning.h"
+#include "shader.h"
+#include "shader_library.h"
+#include "gl_state.h"
+
+#include <glew.h>
+#include <cstdio>
+#include <vector>
+
+/*
+* Skinning pre-pass with transform feedback.
+*
+* The vertices are drawn as points with GL_RASTERIZER_DISCARD, so only the
+* vertex-shader runs. GL orders the captured writes before later draws that
+* read the buffer, no fence is needed between the pre-pass and the passes.
+*/
+
+// ------------------------- SETUP -------------------------
+
+bool SkinningFeedback::Create(size_t count, const BonePaletteBuffer& palette, ShaderLibrary& library, const std::string& defines)
+{
+    Destroy();
+
+    if (count == 0)
+        return false;
+
+    // Interleaved in the order of SkinnedVertex
+    std::vector<const char*> varyings = { "tfPosition", "tfNormal" };
+    // Built right away with whatever else is requested, the library owns the program
+    program = library.RequestFeedback("skinning_feedback.vs", varyings, palette.GetShaderDefines() + defines);
+    if (!program->IsLinked())
+        library.Build();
+    palette.BindToShader(*program);
+
+    vertexCount = count;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(SkinnedVertex), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    printf("Skinning pre-pass: %zu vertices skinned once per frame (transform feedback)\n", count);
+    return true;
+}
+
+void SkinningFeedback::Destroy()
+{
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+
+    program = nullptr;  // Owned by the library
+    buffer = 0;
+    vertexCount = 0;
+}
+
+// ------------------------- PER FRAME -------------------------
+
+void SkinningFeedback::Run(unsigned int sourceVAO)
+{
+    if (!buffer)
+        return;
+
+    program->Use();
+
+    // Only the vertex-shader is needed
+    glEnable(GL_RASTERIZER_DISCARD);
+    BindVertexArray(sourceVAO);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer);
+
+    // One point per vertex, captured in vertex-order
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)vertexCount);
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
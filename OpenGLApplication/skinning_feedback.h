@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+class Shader;
+class BonePaletteBuffer;
+class ShaderLibrary;
+
+/*
+* Skinning pre-pass: every vertex goes through the bone-palette once per
+* frame and the skinned position + normal are captured with transform
+* feedback into a plain vertex-buffer (same layout as SkinnedVertex).
+*
+* All passes that draw the mesh (weights, shaded, later depth-only...) then
+* read the pre-skinned vertices through a pass-through VAO instead of each
+* skinning the same vertices again.
+*/
+
+class SkinningFeedback
+{
+public:
+    SkinningFeedback() = default;
+
+    SkinningFeedback(const SkinningFeedback&) = delete;
+    SkinningFeedback& operator=(const SkinningFeedback&) = delete;
+
+    // (Re)creates the output-buffer for vertexCount vertices and gets the capture-program reading palette from library
+    // (which owns it), needs a current GL-context. defines are added to the program's (e.g. NUM_INFLUENCES for 8-influence vertices)
+    bool Create(size_t vertexCount, const BonePaletteBuffer& palette, ShaderLibrary& library, const std::string& defines = "");
+
+    // Frees the buffer, must be called while the context is still alive
+    void Destroy();
+
+    // Skins vertexCount vertices of sourceVAO (bind-pose layout of VertexGPU) with the bound bone-palette
+    void Run(unsigned int sourceVAO);
+
+    // Output, skinned vertices in the same order as the source
+    unsigned int GetBuffer() const { return buffer; }
+
+    // Capture-program, nullptr before Create(). Rebuilt programs need the palette connected again
+    const Shader* GetProgram() const { return program; }
+
+private:
+    Shader* program = nullptr;      // Owned by the ShaderLibrary passed to Create()
+    unsigned int buffer = 0;
+    size_t vertexCount = 0;
+};
@@ -0,0 +1,30 @@
+#version 330 core
+
+#include "vertex_inputs.glsl"
+
+#include "bone_palette.glsl"
+
+// Captured with transform feedback (interleaved, same layout as SkinnedVertex), nothing is rasterized
+out vec3 tfPosition;
+out vec3 tfNormal;
+
+void main()
+{
+    // Compute skinning matrix
+    mat3x4 skinMatrix =
+          aWeights.x * GetBone(aBoneIDs.x)
+        + aWeights.y * GetBone(aBoneIDs.y)
+        + aWeights.z * GetBone(aBoneIDs.z)
+        + aWeights.w * GetBone(aBoneIDs.w);
+#if NUM_INFLUENCES > 4
+    skinMatrix +=
+          aWeights2.x * GetBone(aBoneIDs2.x)
+        + aWeights2.y * GetBone(aBoneIDs2.y)
+        + aWeights2.z * GetBone(aBoneIDs2.z)
+        + aWeights2.w * GetBone(aBoneIDs2.w);
+#endif
+
+    // Skinned position and normal in model-space, the passes apply MVP themselves
+    tfPosition = vec4(aPosition, 1.0) * skinMatrix;
+    tfNormal = vec4(aNormal, 0.0) * skinMatrix;
+}
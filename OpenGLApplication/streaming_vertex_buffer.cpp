@@ -0,0 +1,111 @@
+#include "streaming_vertex_buffer.h"
+#include <glew.h>
+#include <cstdio>
+#include <iostream>
+
+/*
+* Vertex-buffer for data the CPU rewrites every frame.
+*
+* Orphaning with glBufferData every frame would also avoid the stall but
+* lets the driver reallocate, the regions + fences keep the same memory and
+* only ever wait on a frame that is NUM_REGIONS - 1 frames old.
+*/
+
+// ------------------------- SETUP -------------------------
+
+bool StreamingVertexBuffer::Create(size_t count, size_t vertexSize)
+{
+    Destroy();
+
+    if (count == 0 || vertexSize == 0)
+        return false;
+
+    regionSize = count * vertexSize;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, regionSize * NUM_REGIONS, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    printf("Streaming vertex buffer: %zu vertices x %u regions (%.2f MB)\n",
+        count, NUM_REGIONS, regionSize * NUM_REGIONS / (1024.0 * 1024.0));
+    return true;
+}
+
+void StreamingVertexBuffer::Destroy()
+{
+    for (void*& fence : fences)
+    {
+        if (fence)
+            glDeleteSync((GLsync)fence);
+        fence = nullptr;
+    }
+
+    if (buffer)
+    {
+        if (mapped) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    buffer = 0;
+    regionSize = 0;
+    current = 0;
+    mapped = false;
+}
+
+// ------------------------- PER FRAME -------------------------
+
+void* StreamingVertexBuffer::BeginWrite()
+{
+    if (!buffer)
+        return nullptr;
+
+    current = (current + 1) % NUM_REGIONS;
+
+    // Wait for the frame that last read this region, normally already done
+    if (fences[current])
+    {
+        GLsync fence = (GLsync)fences[current];
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);   // 1 ms
+
+        glDeleteSync(fence);
+        fences[current] = nullptr;
+    }
+
+    // Fence already guarantees the GPU is done with this region, the old contents are not needed either
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, current * regionSize, regionSize,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!ptr)
+        std::cerr << "Could not map streaming vertex buffer\n";
+
+    mapped = ptr != nullptr;
+    return ptr;
+}
+
+void StreamingVertexBuffer::EndWrite()
+{
+    if (!buffer || !mapped)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mapped = false;
+}
+
+void StreamingVertexBuffer::EndFrame()
+{
+    if (!buffer)
+        return;
+
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+
+/*
+* Vertex-buffer for data the CPU rewrites every frame (e.g. CPU-skinned vertices).
+*
+* The buffer is split into NUM_REGIONS regions of the same size, used
+* round-robin. A region is mapped unsynchronized (the driver never stalls
+* on the GPU still drawing from the buffer) and a fence per region makes
+* sure it is not rewritten before the frame that read it is done.
+*
+* Since every region holds the same vertex-layout, only the attribute-offsets
+* change from frame to frame, see GetRegionOffset().
+*/
+
+class StreamingVertexBuffer
+{
+public:
+    static const unsigned int NUM_REGIONS = 3;
+
+    StreamingVertexBuffer() = default;
+
+    StreamingVertexBuffer(const StreamingVertexBuffer&) = delete;
+    StreamingVertexBuffer& operator=(const StreamingVertexBuffer&) = delete;
+
+    // (Re)creates the buffer for vertexCount vertices of vertexSize bytes per region, needs a current GL-context
+    bool Create(size_t vertexCount, size_t vertexSize);
+
+    // Frees the buffer and fences, must be called while the context is still alive
+    void Destroy();
+
+    // Waits until the GPU is done with the next region and maps it (nullptr if not created or the map failed)
+    void* BeginWrite();
+
+    // Done writing, unmaps the region
+    void EndWrite();
+
+    // Call after the last draw reading this frame's region
+    void EndFrame();
+
+    unsigned int GetBuffer() const { return buffer; }
+
+    // Byte-offset of the current region, for the attribute-pointers
+    size_t GetRegionOffset() const { return current * regionSize; }
+
+private:
+    unsigned int buffer = 0;
+    void* fences[NUM_REGIONS] = {};     // GLsync of the last frame that used each region
+    size_t regionSize = 0;              // Bytes per region
+    unsigned int current = 0;           // Region used this frame
+    bool mapped = false;
+};
@@ -0,0 +1,126 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+/*
+* Small pool of worker-threads used to split loops over
+* many independent elements (meshes, vertices, bones...) across
+* all cores.
+*
+* Threads are started once and sleep between jobs, so it is cheap
+* enough to use every frame. The thread calling ParallelFor() works
+* on the job as well and only returns once every chunk is done.
+*/
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Calling thread is one of them
+    for (unsigned int i = 1; i < numThreads; i++)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+unsigned int ThreadPool::GetThreadCount() const
+{
+    return (unsigned int)workers.size() + 1;
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& fn)
+{
+    if (count == 0)
+        return;
+
+    minChunk = std::max<size_t>(1, minChunk);
+
+    // Aim for a few chunks per thread so uneven chunks even out
+    size_t chunkSize = std::max(minChunk, (count + GetThreadCount() * 4 - 1) / (GetThreadCount() * 4));
+    size_t numChunks = (count + chunkSize - 1) / chunkSize;
+
+    // Not worth waking anyone
+    if (workers.empty() || numChunks == 1) {
+        fn(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(submitMutex);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // Workers that woke up late for the previous job must be out before it is replaced
+        jobDone.wait(lock, [this] { return activeWorkers == 0; });
+
+        job = &fn;
+        jobCount = count;
+        jobChunkSize = chunkSize;
+        jobNumChunks = numChunks;
+        nextChunk = 0;
+        finishedChunks = 0;
+        generation++;
+    }
+    wakeWorkers.notify_all();
+
+    // Help out
+    RunChunks();
+
+    // Wait for the chunks other threads took
+    std::unique_lock<std::mutex> lock(mutex);
+    jobDone.wait(lock, [this] { return finishedChunks == jobNumChunks && activeWorkers == 0; });
+    job = nullptr;
+}
+
+// Takes chunks of the current job until there are none left
+void ThreadPool::RunChunks()
+{
+    for (;;)
+    {
+        size_t chunk = nextChunk.fetch_add(1);
+        if (chunk >= jobNumChunks)
+            return;
+
+        size_t begin = chunk * jobChunkSize;
+        size_t end = std::min(jobCount, begin + jobChunkSize);
+        (*job)(begin, end);
+
+        finishedChunks.fetch_add(1);
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned long long seenGeneration = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+
+            seenGeneration = generation;
+            activeWorkers++;
+        }
+
+        RunChunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeWorkers--;
+        }
+        jobDone.notify_all();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+* Small pool of worker-threads used to split loops over
+* many independent elements (meshes, vertices, bones...) across
+* all cores.
+*
+* Threads are started once and sleep between jobs, so it is cheap
+* enough to use every frame. The thread calling ParallelFor() works
+* on the job as well and only returns once every chunk is done.
+*/
+
+class ThreadPool
+{
+public:
+    // 0 = one thread per core (the calling thread counts as one of them)
+    explicit ThreadPool(unsigned int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Nr of threads working on a job, including the calling thread
+    unsigned int GetThreadCount() const;
+
+    // Calls fn(begin, end) for chunks covering [0, count), chunks are at least minChunk elements.
+    // Blocks until all chunks are done. Not reentrant, don't call from inside fn.
+    void ParallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    void WorkerLoop();
+    void RunChunks();
+
+    std::vector<std::thread> workers;
+
+    std::mutex submitMutex;             // Only one job at a time
+    std::mutex mutex;                   // Protects everything below except the atomics
+    std::condition_variable wakeWorkers;
+    std::condition_variable jobDone;
+
+    // Current job
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t jobCount = 0;
+    size_t jobChunkSize = 0;
+    size_t jobNumChunks = 0;
+    std::atomic<size_t> nextChunk{ 0 };
+    std::atomic<size_t> finishedChunks{ 0 };
+
+    unsigned long long generation = 0;  // Bumped for every job so sleeping workers know there is work
+    unsigned int activeWorkers = 0;     // Workers currently looking at the job
+    bool stopping = false;
+};
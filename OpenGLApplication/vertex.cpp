@@ -0,0 +1,35 @@
+#include "vertex.h"
+
+#include <glew.h>
+#include <cstddef>
+
+template<int N>
+void SetVertexGPUAttributes()
+{
+    using Vertex = VertexGPUT<N>;
+
+    // Vertex position
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+    glEnableVertexAttribArray(0);
+
+    // Vertex normal
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    glEnableVertexAttribArray(1);
+
+    // Bone IDs (integer attribute!) and weights, one ivec4/vec4 pair per 4 influences
+    for (int group = 0; group < N / 4; group++)
+    {
+        GLuint idLocation = 2 + group * 2;
+        size_t idOffset = offsetof(Vertex, BoneIDs) + group * 4 * sizeof(int);
+        size_t weightOffset = offsetof(Vertex, Weights) + group * 4 * sizeof(float);
+
+        glVertexAttribIPointer(idLocation, 4, GL_INT, sizeof(Vertex), (void*)idOffset);
+        glEnableVertexAttribArray(idLocation);
+
+        glVertexAttribPointer(idLocation + 1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)weightOffset);
+        glEnableVertexAttribArray(idLocation + 1);
+    }
+}
+
+template void SetVertexGPUAttributes<4>();
+template void SetVertexGPUAttributes<8>();
@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <glm/glm.hpp>
+
+/*
+* Vertex-layout shared between the loader, the model-cache and
+* the OpenGL upload.
+*
+* Kept in its own header since the baked model-cache stores these
+* structs byte for byte, any change here must also bump the
+* cache-version in model_cache.h.
+*
+* The nr of bone-influences per vertex is a template-parameter, 4 (fast,
+* the layout everything else uses) or 8 (quality, e.g. Vanguard needs 7).
+* VertexGPU is the 4-influence layout, 8-influence models are only kept
+* in that layout for the shaded GPU path (see SetVertexGPUAttributes).
+*/
+
+// Storage of the bone-ids/weights of a vertex, glm-vectors for 4 so the math-code can use them directly
+template<int N>
+struct VertexInfluences
+{
+    using Ids = std::array<int, N>;
+    using Weights = std::array<float, N>;
+};
+
+template<>
+struct VertexInfluences<4>
+{
+    using Ids = glm::ivec4;
+    using Weights = glm::vec4;
+};
+
+// GPU-side vertex structure, needed to "render"
+template<int N>
+struct VertexGPUT
+{
+    static_assert(N == 4 || N == 8, "Vertices have 4 or 8 bone-influences");
+    static const int NumInfluences = N;
+
+    glm::vec3 Position;                             // Vertex position
+    glm::vec3 Normal;                               // Vertex normal
+    typename VertexInfluences<N>::Ids BoneIDs;      // Indices of bones affecting this vertex, strongest first
+    typename VertexInfluences<N>::Weights Weights;  // Corresponding weights
+};
+
+using VertexGPU = VertexGPUT<4>;
+static_assert(sizeof(VertexGPU) == 56, "VertexGPU is stored byte for byte in the model-cache");
+
+// Vertex-attributes of VertexGPUT<N> for the bound VAO/VBO: 0 = position, 1 = normal,
+// then per 4 influences bone-ids + weights (2/3 for influences 0-3, 4/5 for 4-7)
+template<int N>
+void SetVertexGPUAttributes();
+
+extern template void SetVertexGPUAttributes<4>();
+extern template void SetVertexGPUAttributes<8>();
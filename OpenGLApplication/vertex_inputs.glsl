@@ -0,0 +1,38 @@
+// Model-vertex inputs (gVBO, see vertex.h and vertex_packing.h) shared by every shader reading the model's vertices.
+// Plain or packed layout is picked by the defines of GetPackedVertexDefines(), 8-influence models set NUM_INFLUENCES 8
+
+// Nr of bones blended per vertex, lower for the influence-bucket variants (see influence_buckets.h), 8 for 8-influence models
+#ifndef NUM_INFLUENCES
+#define NUM_INFLUENCES 4
+#endif
+
+#ifdef PACKED_VERTICES
+// Packed layout (vertex_packing.h): position in the model's bounding-box, octahedral normal
+layout (location = 0) in vec3 aPackedPosition;
+layout (location = 1) in vec2 aPackedNormal;
+
+vec3 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+#define aPosition (aPackedPosition * POSITION_SCALE + POSITION_OFFSET)
+#define aNormal DecodeOctahedral(aPackedNormal)
+#else
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+#endif
+#ifdef PACKED_BONE_IDS
+layout (location = 2) in uvec4 aPackedBoneIDs;  // 8/16-bit unsigned
+#define aBoneIDs ivec4(aPackedBoneIDs)
+#else
+layout (location = 2) in ivec4 aBoneIDs;
+#endif
+layout (location = 3) in vec4 aWeights;
+#if NUM_INFLUENCES > 4
+layout (location = 4) in ivec4 aBoneIDs2;  // Influences 4-7 of 8-influence models (VertexGPUT<8>)
+layout (location = 5) in vec4 aWeights2;
+#endif
@@ -0,0 +1,323 @@
+#include "vertex_packing.h"
+#include "cpu_skinning.h"
+
+#include <glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/*
+* Vertex-packing of skinned meshes.
+*
+* Weights are quantized with the largest-remainder method: every weight is
+* rounded down and the missing steps go to the weights that lost the most,
+* so they always sum to exactly 1 on the GPU (no scaling of the mesh). The
+* octahedral normal tries the 4 nearest snorm-values and keeps the best one.
+*/
+
+#define POSITION_STEPS 65535.0f
+#define NORMAL_STEPS 32767.0f
+
+// ------------------------- ENCODING -------------------------
+
+static glm::vec2 SignNotZero(glm::vec2 v)
+{
+    return glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+static glm::vec3 OctahedralDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+    if (n.z < 0.0f)
+    {
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * SignNotZero(glm::vec2(n.x, n.y));
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    float length = glm::length(n);
+    return length > 0.0f ? n / length : n;
+}
+
+// Snorm-value as read by the GPU
+static float SnormToFloat(int16_t v)
+{
+    return std::max(v / NORMAL_STEPS, -1.0f);
+}
+
+static void OctahedralEncode(glm::vec3 n, int16_t out[2])
+{
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (sum <= 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    n /= sum;
+
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+        e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * SignNotZero(e);
+
+    // Best of the 4 neighbouring snorm-values
+    glm::vec3 target = glm::normalize(n);
+    float bestDot = -2.0f;
+    for (int i = 0; i < 4; i++)
+    {
+        float x = (i & 1) ? ceilf(e.x * NORMAL_STEPS) : floorf(e.x * NORMAL_STEPS);
+        float y = (i & 2) ? ceilf(e.y * NORMAL_STEPS) : floorf(e.y * NORMAL_STEPS);
+        int16_t qx = (int16_t)glm::clamp(x, -NORMAL_STEPS, NORMAL_STEPS);
+        int16_t qy = (int16_t)glm::clamp(y, -NORMAL_STEPS, NORMAL_STEPS);
+
+        float d = glm::dot(OctahedralDecode(glm::vec2(SnormToFloat(qx), SnormToFloat(qy))), target);
+        if (d > bestDot) {
+            bestDot = d;
+            out[0] = qx;
+            out[1] = qy;
+        }
+    }
+}
+
+// Quantizes 4 weights to steps (255 or 65535) that sum to exactly steps, all 0 for vertices without bones
+static void QuantizeWeights(const glm::vec4& weights, unsigned int steps, unsigned int out[4])
+{
+    float sum = weights.x + weights.y + weights.z + weights.w;
+    if (sum <= 0.0f) {
+        out[0] = out[1] = out[2] = out[3] = 0;
+        return;
+    }
+
+    float remainder[4];
+    unsigned int total = 0;
+    for (int k = 0; k < 4; k++)
+    {
+        float scaled = std::max(weights[k], 0.0f) / sum * steps;
+        out[k] = (unsigned int)scaled;
+        remainder[k] = scaled - out[k];
+        total += out[k];
+    }
+
+    // Missing steps to the largest remainders
+    while (total < steps)
+    {
+        int best = 0;
+        for (int k = 1; k < 4; k++)
+            if (remainder[k] > remainder[best])
+                best = k;
+        out[best]++;
+        remainder[best] = -1.0f;
+        total++;
+    }
+}
+
+// ------------------------- PACKING -------------------------
+
+void PackVertices(const VertexGPU* vertices, size_t count, size_t numBones, PackedVertexFormat format, PackedVertices& out)
+{
+    out = PackedVertices();
+
+    if (numBones > 256)
+        format.wideBoneIds = true;
+
+    out.format = format;
+    out.count = count;
+    out.normalOffset = format.quantizePositions ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+    out.boneIdsOffset = out.normalOffset + 2 * sizeof(int16_t);
+    out.weightsOffset = out.boneIdsOffset + 4 * (format.wideBoneIds ? 2 : 1);
+    out.stride = out.weightsOffset + 4 * (format.wideWeights ? 2 : 1);
+
+    // Bounding-box of the model, the dequantisation
+    glm::vec3 minPos(0.0f), maxPos(0.0f);
+    if (count > 0)
+        minPos = maxPos = vertices[0].Position;
+    for (size_t v = 1; v < count; v++)
+    {
+        minPos = glm::min(minPos, vertices[v].Position);
+        maxPos = glm::max(maxPos, vertices[v].Position);
+    }
+    if (format.quantizePositions) {
+        out.positionScale = maxPos - minPos;
+        out.positionOffset = minPos;
+    }
+
+    int maxId = numBones > 0 ? (int)numBones - 1 : 0;
+    unsigned int weightSteps = format.wideWeights ? 65535 : 255;
+
+    out.data.assign(count * out.stride, 0);
+    for (size_t v = 0; v < count; v++)
+    {
+        const VertexGPU& vertex = vertices[v];
+        unsigned char* dst = out.data.data() + v * out.stride;
+
+        // Position
+        if (format.quantizePositions)
+        {
+            uint16_t q[3];
+            for (int c = 0; c < 3; c++)
+            {
+                float extent = out.positionScale[c];
+                float t = extent > 0.0f ? (vertex.Position[c] - minPos[c]) / extent : 0.0f;
+                q[c] = (uint16_t)lroundf(glm::clamp(t, 0.0f, 1.0f) * POSITION_STEPS);
+            }
+            memcpy(dst, q, sizeof(q));
+        }
+        else
+            memcpy(dst, &vertex.Position, sizeof(glm::vec3));
+
+        // Normal
+        int16_t normal[2];
+        OctahedralEncode(vertex.Normal, normal);
+        memcpy(dst + out.normalOffset, normal, sizeof(normal));
+
+        // Bone-ids, unused slots (weight 0) get bone 0
+        unsigned int weights[4];
+        QuantizeWeights(vertex.Weights, weightSteps, weights);
+        for (int k = 0; k < 4; k++)
+        {
+            int id = weights[k] > 0 ? glm::clamp(vertex.BoneIDs[k], 0, maxId) : 0;
+            if (format.wideBoneIds) {
+                uint16_t q = (uint16_t)id;
+                memcpy(dst + out.boneIdsOffset + k * 2, &q, 2);
+            }
+            else
+                dst[out.boneIdsOffset + k] = (unsigned char)id;
+        }
+
+        // Weights
+        for (int k = 0; k < 4; k++)
+        {
+            if (format.wideWeights) {
+                uint16_t q = (uint16_t)weights[k];
+                memcpy(dst + out.weightsOffset + k * 2, &q, 2);
+            }
+            else
+                dst[out.weightsOffset + k] = (unsigned char)weights[k];
+        }
+    }
+}
+
+void UnpackVertices(const PackedVertices& packed, std::vector<VertexGPU>& out)
+{
+    const PackedVertexFormat& format = packed.format;
+    float weightSteps = format.wideWeights ? 65535.0f : 255.0f;
+
+    out.resize(packed.count);
+    for (size_t v = 0; v < packed.count; v++)
+    {
+        const unsigned char* src = packed.data.data() + v * packed.stride;
+        VertexGPU& vertex = out[v];
+
+        if (format.quantizePositions)
+        {
+            uint16_t q[3];
+            memcpy(q, src, sizeof(q));
+            vertex.Position = glm::vec3(q[0], q[1], q[2]) / POSITION_STEPS * packed.positionScale + packed.positionOffset;
+        }
+        else
+            memcpy(&vertex.Position, src, sizeof(glm::vec3));
+
+        int16_t normal[2];
+        memcpy(normal, src + packed.normalOffset, sizeof(normal));
+        vertex.Normal = OctahedralDecode(glm::vec2(SnormToFloat(normal[0]), SnormToFloat(normal[1])));
+
+        for (int k = 0; k < 4; k++)
+        {
+            uint16_t id = 0, weight = 0;
+            if (format.wideBoneIds)
+                memcpy(&id, src + packed.boneIdsOffset + k * 2, 2);
+            else
+                id = src[packed.boneIdsOffset + k];
+
+            if (format.wideWeights)
+                memcpy(&weight, src + packed.weightsOffset + k * 2, 2);
+            else
+                weight = src[packed.weightsOffset + k];
+
+            vertex.BoneIDs[k] = id;
+            vertex.Weights[k] = weight / weightSteps;
+        }
+    }
+}
+
+// ------------------------- GPU -------------------------
+
+void SetPackedVertexAttributes(const PackedVertices& packed)
+{
+    const PackedVertexFormat& format = packed.format;
+    GLsizei stride = (GLsizei)packed.stride;
+
+    // Position (normalized to 0..1 in the bounding-box when quantized)
+    if (format.quantizePositions)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // Octahedral normal
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)packed.normalOffset);
+    glEnableVertexAttribArray(1);
+
+    // Bone IDs (unsigned integer attribute!)
+    glVertexAttribIPointer(2, 4, format.wideBoneIds ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, stride, (void*)packed.boneIdsOffset);
+    glEnableVertexAttribArray(2);
+
+    // Bone weights
+    glVertexAttribPointer(3, 4, format.wideWeights ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)packed.weightsOffset);
+    glEnableVertexAttribArray(3);
+}
+
+std::string GetPackedVertexDefines(const PackedVertices& packed)
+{
+    char defines[256];
+    snprintf(defines, sizeof(defines),
+        "#define PACKED_VERTICES\n#define PACKED_BONE_IDS\n"
+        "#define POSITION_SCALE vec3(%.9g, %.9g, %.9g)\n#define POSITION_OFFSET vec3(%.9g, %.9g, %.9g)\n",
+        packed.positionScale.x, packed.positionScale.y, packed.positionScale.z,
+        packed.positionOffset.x, packed.positionOffset.y, packed.positionOffset.z);
+    return defines;
+}
+
+// ------------------------- ERROR -------------------------
+
+PackingError MeasurePackingError(const VertexGPU* vertices, size_t count, const PackedVertices& packed,
+    const Affine3x4* palette, size_t numBones)
+{
+    PackingError error;
+    if (count == 0 || count != packed.count)
+        return error;
+
+    std::vector<VertexGPU> unpacked;
+    UnpackVertices(packed, unpacked);
+
+    // Both through the same CPU skinning, without bones the vertices are compared as they are
+    std::vector<SkinnedVertex> reference(count), result(count);
+    if (numBones > 0)
+    {
+        SkinningStreams streams;
+        BuildSkinningStreams(vertices, count, numBones, streams);
+        SkinVertices(streams, palette, reference.data());
+        BuildSkinningStreams(unpacked.data(), count, numBones, streams);
+        SkinVertices(streams, palette, result.data());
+    }
+    else
+    {
+        for (size_t v = 0; v < count; v++) {
+            reference[v] = { vertices[v].Position, vertices[v].Normal };
+            result[v] = { unpacked[v].Position, unpacked[v].Normal };
+        }
+    }
+
+    for (size_t v = 0; v < count; v++)
+    {
+        error.maxPosition = std::max(error.maxPosition, glm::length(result[v].Position - reference[v].Position));
+
+        float lengths = glm::length(result[v].Normal) * glm::length(reference[v].Normal);
+        if (lengths > 0.0f)
+        {
+            // In double, acos of a float this close to 1 is mostly rounding
+            double cosAngle = glm::clamp((double)glm::dot(result[v].Normal, reference[v].Normal) / lengths, -1.0, 1.0);
+            error.maxNormalDegrees = std::max(error.maxNormalDegrees, (float)glm::degrees(acos(cosAngle)));
+        }
+    }
+    return error;
+}
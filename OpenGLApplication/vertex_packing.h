@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "affine.h"
+#include "vertex.h"
+
+/*
+* Compact GPU-layout for skinned vertices, VertexGPU is 56 bytes.
+*
+*   Position    3 x 16-bit unorm in the model's bounding-box (+ 2 bytes padding), or 3 x float
+*   Normal      2 x 16-bit snorm, octahedral encoding
+*   BoneIDs     4 x 8-bit (16-bit for rigs with more than 256 bones)
+*   Weights     4 x 8-bit unorm (or 16-bit), the quantized weights sum to exactly 1
+*
+* which is 20 bytes per vertex with the defaults (24 with float positions,
+* 28 with 16-bit ids and weights). The whole model is drawn in one call so
+* the position dequantisation (scale + offset of the bounding-box) is one
+* per model, handed to the shaders as defines (GetPackedVertexDefines).
+*/
+
+struct PackedVertexFormat
+{
+    bool quantizePositions = true;  // 16-bit positions, else 32-bit floats
+    bool wideWeights = false;       // 16-bit weights instead of 8-bit
+    bool wideBoneIds = false;       // 16-bit bone-ids, always on for rigs with more than 256 bones
+};
+
+struct PackedVertices
+{
+    PackedVertexFormat format;
+    std::vector<unsigned char> data;
+    size_t count = 0;
+    size_t stride = 0;                              // Bytes per vertex
+    size_t normalOffset = 0;                        // Position is at 0
+    size_t boneIdsOffset = 0;
+    size_t weightsOffset = 0;
+    glm::vec3 positionScale = glm::vec3(1.0f);      // Position = stored (0..1 when quantized) * scale + offset
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+};
+
+// Packs count vertices, bone-ids outside [0, numBones) are clamped (their weight is normally 0 anyway)
+void PackVertices(const VertexGPU* vertices, size_t count, size_t numBones, PackedVertexFormat format, PackedVertices& out);
+
+// Decodes the vertices the same way the shaders do (for measuring the error)
+void UnpackVertices(const PackedVertices& packed, std::vector<VertexGPU>& out);
+
+// Vertex-attributes of the packed layout for the bound VAO/VBO, same locations as VertexGPU (0-3)
+void SetPackedVertexAttributes(const PackedVertices& packed);
+
+// PACKED_VERTICES, PACKED_BONE_IDS and the dequantisation (POSITION_SCALE/POSITION_OFFSET) for the shaders reading the packed VBO
+std::string GetPackedVertexDefines(const PackedVertices& packed);
+
+// Largest difference after skinning the original and the packed vertices with palette
+struct PackingError
+{
+    float maxPosition = 0.0f;       // Model units
+    float maxNormalDegrees = 0.0f;
+};
+PackingError MeasurePackingError(const VertexGPU* vertices, size_t count, const PackedVertices& packed,
+    const Affine3x4* palette, size_t numBones);
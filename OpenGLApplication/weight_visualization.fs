@@ -4,8 +4,7 @@ in vec3 vNormal;
 in vec4 vBoneIDs;
 in vec4 vWeights;
 
-uniform int uSelectedBone;
-uniform vec3 uLightDir;
+#include "frame_constants.glsl"
 
 out vec4 FragColor;
 
@@ -38,7 +37,7 @@ void main()
 
     // Simple diffuse lighting
     vec3 N = normalize(vNormal);
-    vec3 L = normalize(-uLightDir);
+    vec3 L = normalize(-uLightDir.xyz);
 
     float diffuse = max(dot(N, L), 0.0);
 
@@ -1,15 +1,9 @@
 #version 330 core
 
-layout (location = 0) in vec3 Position;
-layout (location = 1) in vec3 Normal;
-layout (location = 2) in ivec4 BoneIDs;
-layout (location = 3) in vec4 Weights;
+#include "vertex_inputs.glsl"
 
-// Maximum number of supported bones
-#define MAX_BONES 128
-
-uniform mat4 uBones[MAX_BONES];
-uniform mat4 MVP;
+// Vertices are already skinned (pre-pass) or in bind pose, no bone-palette needed
+#include "frame_constants.glsl"
 
 out vec3 vNormal;
 out vec4 vBoneIDs;
@@ -17,9 +11,9 @@ out vec4 vWeights;
 
 void main()
 {
-    vNormal = normalize(Normal);
-    vBoneIDs = vec4(BoneIDs);
-    vWeights = Weights;
+    vNormal = normalize(aNormal);
+    vBoneIDs = vec4(aBoneIDs);
+    vWeights = aWeights;
 
-    gl_Position = MVP * vec4(Position, 1.0);
+    gl_Position = uModelViewProjection * vec4(aPosition, 1.0);
 }
\ No newline at end of file